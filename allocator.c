@@ -0,0 +1,364 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "allocator.h"
+
+/*
+ * Heap allocator
+ */
+
+static void *mat_heap_alloc(void *ctx, size_t bytes, size_t align)
+{
+	(void)ctx;
+
+	if (align < sizeof(void *))
+		align = sizeof(void *);
+
+	if (bytes > SIZE_MAX - align)
+		return NULL;
+
+	/* aligned_alloc wants a multiple of the alignment */
+	return aligned_alloc(align, (bytes + align - 1) / align * align);
+}
+
+static void mat_heap_free(void *ctx, void *p, size_t bytes)
+{
+	(void)ctx;
+	(void)bytes;
+
+	free(p);
+}
+
+const struct mat_allocator mat_heap_allocator = {
+	.alloc = mat_heap_alloc,
+	.free = mat_heap_free,
+	.ctx = NULL,
+};
+
+static _Thread_local const struct mat_allocator *mat_current_allocator;
+
+const struct mat_allocator *mat_allocator_set(const struct mat_allocator *a)
+{
+	const struct mat_allocator *prev = mat_allocator_get();
+
+	mat_current_allocator = a;
+
+	return prev;
+}
+
+const struct mat_allocator *mat_allocator_get(void)
+{
+	return mat_current_allocator ? mat_current_allocator : &mat_heap_allocator;
+}
+
+/*
+ * Bump-pointer arena
+ */
+
+/* Space reserved in front of the data of every chunk, keeping the data aligned */
+#define MAT_ARENA_HEADER 64
+
+struct mat_arena_chunk {
+	struct mat_arena_chunk *next;
+	size_t size;
+};
+
+struct mat_arena {
+	struct mat_allocator allocator;
+	size_t chunk_bytes;
+	/* Chunk being filled first, older ones after it */
+	struct mat_arena_chunk *chunks;
+	/* Bytes used in the chunk being filled */
+	size_t used;
+	/* Data bytes of all chunks, the size of the single chunk kept on reset */
+	size_t total;
+};
+
+static unsigned char *mat_arena_chunk_data(struct mat_arena_chunk *chunk)
+{
+	return (unsigned char *)chunk + MAT_ARENA_HEADER;
+}
+
+/* Start filling a new chunk of at least size data bytes */
+static bool mat_arena_grow(struct mat_arena *arena, size_t size)
+{
+	if (size < arena->chunk_bytes)
+		size = arena->chunk_bytes;
+
+	if (size > SIZE_MAX - MAT_ARENA_HEADER)
+		return false;
+
+	struct mat_arena_chunk *chunk = aligned_alloc(MAT_ARENA_HEADER, MAT_ARENA_HEADER + size);
+	if (!chunk)
+		return false;
+
+	chunk->next = arena->chunks;
+	chunk->size = size;
+	arena->chunks = chunk;
+	arena->used = 0;
+	arena->total += size;
+
+	return true;
+}
+
+static void *mat_arena_alloc(void *ctx, size_t bytes, size_t align)
+{
+	struct mat_arena *arena = ctx;
+	struct mat_arena_chunk *chunk = arena->chunks;
+
+	if (chunk) {
+		const uintptr_t p = (uintptr_t)(mat_arena_chunk_data(chunk) + arena->used);
+		const size_t pad = -p & (align - 1);
+
+		if (pad <= chunk->size - arena->used && bytes <= chunk->size - arena->used - pad) {
+			arena->used += pad + bytes;
+			return (void *)(p + pad);
+		}
+	}
+
+	if (bytes > SIZE_MAX - align || !mat_arena_grow(arena, bytes + align))
+		return NULL;
+
+	return mat_arena_alloc(ctx, bytes, align);
+}
+
+static void mat_arena_free_block(void *ctx, void *p, size_t bytes)
+{
+	/* Blocks are only reclaimed by mat_arena_reset */
+	(void)ctx;
+	(void)p;
+	(void)bytes;
+}
+
+/* Free every chunk of the arena */
+static void mat_arena_release(struct mat_arena *arena)
+{
+	struct mat_arena_chunk *chunk = arena->chunks;
+
+	while (chunk) {
+		struct mat_arena_chunk *next = chunk->next;
+
+		free(chunk);
+		chunk = next;
+	}
+
+	arena->chunks = NULL;
+	arena->used = 0;
+	arena->total = 0;
+}
+
+struct mat_arena *mat_arena_new(size_t chunk_bytes)
+{
+	struct mat_arena *arena = malloc(sizeof(struct mat_arena));
+	if (!arena) {
+		perror(__func__);
+		return NULL;
+	}
+
+	arena->allocator.alloc = mat_arena_alloc;
+	arena->allocator.free = mat_arena_free_block;
+	arena->allocator.ctx = arena;
+	arena->chunk_bytes = chunk_bytes;
+	arena->chunks = NULL;
+	arena->used = 0;
+	arena->total = 0;
+
+	return arena;
+}
+
+void mat_arena_free(struct mat_arena *arena)
+{
+	if (!arena)
+		return;
+
+	mat_arena_release(arena);
+	free(arena);
+}
+
+void mat_arena_reset(struct mat_arena *arena)
+{
+	if (!arena) {
+		errno = EINVAL;
+		perror(__func__);
+		return;
+	}
+
+	arena->used = 0;
+
+	if (!arena->chunks || !arena->chunks->next)
+		return;
+
+	/* Replace the chunks by one that holds a whole round of allocations */
+	const size_t total = arena->total;
+
+	mat_arena_release(arena);
+	mat_arena_grow(arena, total);
+}
+
+const struct mat_allocator *mat_arena_allocator(struct mat_arena *arena)
+{
+	return arena ? &arena->allocator : NULL;
+}
+
+/*
+ * Size-class pool
+ */
+
+/* Space reserved in front of every block, which is also the largest alignment served */
+#define MAT_POOL_HEADER 64
+/* Smallest class, as a power of two */
+#define MAT_POOL_MIN_CLASS 6
+#define MAT_POOL_CLASSES (sizeof(size_t) * 8)
+
+struct mat_pool_block {
+	/* Every block of the pool, for reset and teardown */
+	struct mat_pool_block *next_all;
+	struct mat_pool_block *next_free;
+	size_t cls;
+};
+
+struct mat_pool {
+	struct mat_allocator allocator;
+	struct mat_pool_block *all;
+	struct mat_pool_block *free_list[MAT_POOL_CLASSES];
+};
+
+/* Smallest class holding bytes */
+static size_t mat_pool_class(size_t bytes)
+{
+	size_t cls = MAT_POOL_MIN_CLASS;
+
+	while (cls < MAT_POOL_CLASSES - 1 && ((size_t)1 << cls) < bytes)
+		cls++;
+
+	return cls;
+}
+
+static void *mat_pool_alloc(void *ctx, size_t bytes, size_t align)
+{
+	struct mat_pool *pool = ctx;
+
+	if (align > MAT_POOL_HEADER || bytes > SIZE_MAX / 2 - MAT_POOL_HEADER)
+		return NULL;
+
+	const size_t cls = mat_pool_class(bytes);
+	struct mat_pool_block *block = pool->free_list[cls];
+
+	if (block) {
+		pool->free_list[cls] = block->next_free;
+	} else {
+		block = aligned_alloc(MAT_POOL_HEADER, MAT_POOL_HEADER + ((size_t)1 << cls));
+		if (!block)
+			return NULL;
+
+		block->cls = cls;
+		block->next_all = pool->all;
+		pool->all = block;
+	}
+
+	return (unsigned char *)block + MAT_POOL_HEADER;
+}
+
+static void mat_pool_free_block(void *ctx, void *p, size_t bytes)
+{
+	struct mat_pool *pool = ctx;
+	struct mat_pool_block *block = (struct mat_pool_block *)((unsigned char *)p - MAT_POOL_HEADER);
+
+	(void)bytes;
+
+	block->next_free = pool->free_list[block->cls];
+	pool->free_list[block->cls] = block;
+}
+
+struct mat_pool *mat_pool_new(void)
+{
+	struct mat_pool *pool = calloc(1, sizeof(struct mat_pool));
+	if (!pool) {
+		perror(__func__);
+		return NULL;
+	}
+
+	pool->allocator.alloc = mat_pool_alloc;
+	pool->allocator.free = mat_pool_free_block;
+	pool->allocator.ctx = pool;
+
+	return pool;
+}
+
+void mat_pool_free(struct mat_pool *pool)
+{
+	if (!pool)
+		return;
+
+	struct mat_pool_block *block = pool->all;
+
+	while (block) {
+		struct mat_pool_block *next = block->next_all;
+
+		free(block);
+		block = next;
+	}
+
+	free(pool);
+}
+
+void mat_pool_reset(struct mat_pool *pool)
+{
+	if (!pool) {
+		errno = EINVAL;
+		perror(__func__);
+		return;
+	}
+
+	for (size_t cls = 0; cls < MAT_POOL_CLASSES; cls++)
+		pool->free_list[cls] = NULL;
+
+	for (struct mat_pool_block *block = pool->all; block; block = block->next_all) {
+		block->next_free = pool->free_list[block->cls];
+		pool->free_list[block->cls] = block;
+	}
+}
+
+const struct mat_allocator *mat_pool_allocator(struct mat_pool *pool)
+{
+	return pool ? &pool->allocator : NULL;
+}
+
+/*
+ * Spill pool
+ */
+
+static _Thread_local struct mat_pool *mat_spill_pool;
+static pthread_key_t mat_spill_key;
+static pthread_once_t mat_spill_once = PTHREAD_ONCE_INIT;
+
+static void mat_spill_destroy(void *pool)
+{
+	mat_pool_free(pool);
+}
+
+static void mat_spill_key_init(void)
+{
+	pthread_key_create(&mat_spill_key, mat_spill_destroy);
+}
+
+const struct mat_allocator *mat_spill_allocator(void)
+{
+	if (!mat_spill_pool) {
+		pthread_once(&mat_spill_once, mat_spill_key_init);
+
+		/* Without a pool, spills still work from the heap */
+		mat_spill_pool = mat_pool_new();
+		if (!mat_spill_pool)
+			return &mat_heap_allocator;
+
+		/* Released when the thread exits */
+		pthread_setspecific(mat_spill_key, mat_spill_pool);
+	}
+
+	return mat_pool_allocator(mat_spill_pool);
+}
@@ -0,0 +1,67 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stddef.h>
+
+/*
+ * Pluggable storage for integer and floating-point matrices. mat_alloc and
+ * fmat_alloc take each matrix from the calling thread's current allocator
+ * and record it in the matrix, so mat_free and fmat_free return the storage
+ * to the allocator it came from.
+ */
+struct mat_allocator {
+	/* Return bytes aligned to align (a power of two), or NULL */
+	void *(*alloc)(void *ctx, size_t bytes, size_t align);
+	/* Give back a block of the given size returned by alloc */
+	void (*free)(void *ctx, void *p, size_t bytes);
+	void *ctx;
+};
+
+/* The C heap, the default for every thread */
+extern const struct mat_allocator mat_heap_allocator;
+
+/* Make a the calling thread's current allocator, NULL restores the heap; returns the previous one */
+const struct mat_allocator *mat_allocator_set(const struct mat_allocator *a);
+/* Get the calling thread's current allocator */
+const struct mat_allocator *mat_allocator_get(void);
+
+/*
+ * Bump-pointer arena. Allocation is a pointer increment and freeing a single
+ * block does nothing; mat_arena_reset reclaims everything at once. The arena
+ * keeps its memory across resets, so a steady workload stops allocating.
+ */
+struct mat_arena;
+
+/* Allocate an arena that grows in chunks of at least chunk_bytes */
+struct mat_arena *mat_arena_new(size_t chunk_bytes);
+/* Delete an arena and everything allocated from it */
+void mat_arena_free(struct mat_arena *arena);
+/* Reclaim every block allocated from the arena */
+void mat_arena_reset(struct mat_arena *arena);
+/* Allocator interface of an arena */
+const struct mat_allocator *mat_arena_allocator(struct mat_arena *arena);
+
+/*
+ * Pool of power-of-two size classes. Freed blocks go onto their class's free
+ * list and are handed out again to requests of the same class;
+ * mat_pool_reset returns every outstanding block to the free lists at once.
+ */
+struct mat_pool;
+
+/* Allocate an empty pool */
+struct mat_pool *mat_pool_new(void);
+/* Delete a pool and everything allocated from it */
+void mat_pool_free(struct mat_pool *pool);
+/* Return every block allocated from the pool to its free list */
+void mat_pool_reset(struct mat_pool *pool);
+/* Allocator interface of a pool */
+const struct mat_allocator *mat_pool_allocator(struct mat_pool *pool);
+
+/*
+ * The calling thread's spill pool, created on first use and deleted when the
+ * thread exits. Stack matrices too large for their inline buffer take their
+ * storage from it, so a scope that spills on every call reuses one block.
+ */
+const struct mat_allocator *mat_spill_allocator(void);
+
+#endif /* ALLOCATOR_H */
@@ -0,0 +1,337 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fexpr.h"
+#include "fkernels.h"
+#include "threadpool.h"
+
+/* Elements evaluated at a time; one strip per stack slot stays in L1 */
+#define FEXPR_STRIP 512
+
+/* Elements below which evaluation stays on the calling thread */
+#define FEXPR_PARALLEL_MIN (256 * 1024)
+
+enum fexpr_op {
+	FEXPR_MAT,
+	FEXPR_ADD,
+	FEXPR_SUB,
+	FEXPR_MUL,
+	FEXPR_SCALE,
+	FEXPR_MAP,
+};
+
+struct fexpr {
+	enum fexpr_op op;
+	size_t rows, cols;
+	/* Operands; unary nodes only have lhs */
+	struct fexpr *lhs, *rhs;
+	/* Matrix read by FEXPR_MAT */
+	const struct fmatrix *m;
+	/* Factor of FEXPR_SCALE */
+	fval_t s;
+	/* Function of FEXPR_MAP */
+	fval_t (*fn)(fval_t);
+	/* Number of nodes in this subtree */
+	size_t size;
+};
+
+/* Allocate a node over the given operands, freeing them if that fails */
+static struct fexpr *fexpr_node(enum fexpr_op op, struct fexpr *lhs, struct fexpr *rhs)
+{
+	struct fexpr *e = calloc(1, sizeof(struct fexpr));
+	if (!e) {
+		perror(__func__);
+		fexpr_free(lhs);
+		fexpr_free(rhs);
+		return NULL;
+	}
+
+	e->op = op;
+	e->lhs = lhs;
+	e->rhs = rhs;
+	e->size = 1 + (lhs ? lhs->size : 0) + (rhs ? rhs->size : 0);
+	if (lhs) {
+		e->rows = lhs->rows;
+		e->cols = lhs->cols;
+	}
+
+	return e;
+}
+
+/* Node combining two operands of the same shape */
+static struct fexpr *fexpr_binary(enum fexpr_op op, struct fexpr *a, struct fexpr *b, const char *func)
+{
+	if (!a || !b || a->rows != b->rows || a->cols != b->cols) {
+		/* A NULL operand already reported its own failure */
+		if (a && b) {
+			errno = EINVAL;
+			perror(func);
+		}
+		fexpr_free(a);
+		fexpr_free(b);
+		return NULL;
+	}
+
+	return fexpr_node(op, a, b);
+}
+
+struct fexpr *fexpr_mat(const struct fmatrix *m)
+{
+	if (!m) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct fexpr *e = fexpr_node(FEXPR_MAT, NULL, NULL);
+	if (!e)
+		return NULL;
+
+	e->m = m;
+	e->rows = m->rows;
+	e->cols = m->cols;
+
+	return e;
+}
+
+struct fexpr *fexpr_add(struct fexpr *a, struct fexpr *b)
+{
+	return fexpr_binary(FEXPR_ADD, a, b, __func__);
+}
+
+struct fexpr *fexpr_sub(struct fexpr *a, struct fexpr *b)
+{
+	return fexpr_binary(FEXPR_SUB, a, b, __func__);
+}
+
+struct fexpr *fexpr_mul(struct fexpr *a, struct fexpr *b)
+{
+	return fexpr_binary(FEXPR_MUL, a, b, __func__);
+}
+
+struct fexpr *fexpr_scale(struct fexpr *a, fval_t s)
+{
+	if (!a)
+		return NULL;
+
+	struct fexpr *e = fexpr_node(FEXPR_SCALE, a, NULL);
+	if (!e)
+		return NULL;
+
+	e->s = s;
+
+	return e;
+}
+
+struct fexpr *fexpr_map(struct fexpr *a, fval_t (*fn)(fval_t))
+{
+	if (!a || !fn) {
+		if (a) {
+			errno = EINVAL;
+			perror(__func__);
+		}
+		fexpr_free(a);
+		return NULL;
+	}
+
+	struct fexpr *e = fexpr_node(FEXPR_MAP, a, NULL);
+	if (!e)
+		return NULL;
+
+	e->fn = fn;
+
+	return e;
+}
+
+void fexpr_free(struct fexpr *e)
+{
+	if (!e)
+		return;
+
+	fexpr_free(e->lhs);
+	fexpr_free(e->rhs);
+	free(e);
+}
+
+size_t fexpr_rows(const struct fexpr *e)
+{
+	return e ? e->rows : 0;
+}
+
+size_t fexpr_cols(const struct fexpr *e)
+{
+	return e ? e->cols : 0;
+}
+
+/*
+ * Evaluation
+ *
+ * The tree is flattened into post-order, a program for a small stack machine
+ * whose slots each hold one strip of values. Leaves push a pointer straight
+ * into the row of their matrix; operators pop their operands and push their
+ * result into the scratch strip of the slot it lands in. Every operator is one
+ * vectorized kernel call over a strip that is still in cache.
+ */
+
+/* Append the nodes of e to prog in post-order; return the stack depth it needs */
+static size_t fexpr_compile(const struct fexpr *e, const struct fexpr **prog, size_t *len)
+{
+	size_t depth = 1;
+
+	if (e->lhs)
+		depth = fexpr_compile(e->lhs, prog, len);
+	if (e->rhs) {
+		const size_t rhs_depth = 1 + fexpr_compile(e->rhs, prog, len);
+
+		if (rhs_depth > depth)
+			depth = rhs_depth;
+	}
+
+	prog[(*len)++] = e;
+
+	return depth;
+}
+
+struct fexpr_job {
+	const struct fexpr **prog;
+	size_t len;
+	size_t depth;
+	struct fmatrix *dest;
+	size_t ntasks;
+	/* depth strips of scratch and depth stack slots per task */
+	fval_t *scratch;
+	const fval_t **stacks;
+};
+
+/* Evaluate the n elements at (r, c); the root writes to out when it is not a leaf */
+static const fval_t *fexpr_run(const struct fexpr_job *job,
+			       fval_t *scratch,
+			       const fval_t **stack,
+			       size_t r,
+			       size_t c,
+			       size_t n,
+			       fval_t *out)
+{
+	size_t sp = 0;
+
+	for (size_t i = 0; i < job->len; i++) {
+		const struct fexpr *e = job->prog[i];
+		const size_t top = e->op == FEXPR_MAT ? sp : e->rhs ? sp - 2 : sp - 1;
+		fval_t *d = i + 1 == job->len && out ? out : scratch + top * FEXPR_STRIP;
+
+		switch (e->op) {
+		case FEXPR_MAT:
+			if (e->m->flags & FMAT_TRANSPOSED) {
+				for (size_t j = 0; j < n; j++)
+					d[j] = e->m->data[c + j][r];
+				stack[sp++] = d;
+			} else {
+				stack[sp++] = e->m->data[r] + c;
+			}
+			continue;
+		case FEXPR_ADD:
+			fkernels->add(d, stack[top], stack[top + 1], n);
+			break;
+		case FEXPR_SUB:
+			fkernels->sub(d, stack[top], stack[top + 1], n);
+			break;
+		case FEXPR_MUL:
+			fkernels->mul(d, stack[top], stack[top + 1], n);
+			break;
+		case FEXPR_SCALE:
+			fkernels->scale(d, e->s, stack[top], n);
+			break;
+		case FEXPR_MAP:
+			for (size_t j = 0; j < n; j++)
+				d[j] = e->fn(stack[top][j]);
+			break;
+		}
+
+		stack[top] = d;
+		sp = top + 1;
+	}
+
+	return stack[0];
+}
+
+/* Evaluate one band of rows of the destination */
+static void fexpr_task(void *arg, size_t task)
+{
+	const struct fexpr_job *job = arg;
+	struct fmatrix *dest = job->dest;
+	const bool trans = dest->flags & FMAT_TRANSPOSED;
+	const size_t r0 = dest->rows * task / job->ntasks;
+	const size_t r1 = dest->rows * (task + 1) / job->ntasks;
+	fval_t *scratch = job->scratch + task * job->depth * FEXPR_STRIP;
+	const fval_t **stack = job->stacks + task * job->depth;
+
+	for (size_t r = r0; r < r1; r++) {
+		for (size_t c = 0; c < dest->cols; c += FEXPR_STRIP) {
+			const size_t n = dest->cols - c < FEXPR_STRIP ? dest->cols - c : FEXPR_STRIP;
+			fval_t *out = trans ? NULL : dest->data[r] + c;
+			const fval_t *v = fexpr_run(job, scratch, stack, r, c, n, out);
+
+			if (trans)
+				for (size_t j = 0; j < n; j++)
+					dest->data[c + j][r] = v[j];
+			else if (v != out)
+				memmove(out, v, n * sizeof(fval_t));
+		}
+	}
+}
+
+struct fmatrix *fexpr_eval(struct fmatrix *dest, const struct fexpr *e)
+{
+	if (!e) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	if (dest) {
+		if (dest->rows != e->rows || dest->cols != e->cols) {
+			errno = EINVAL;
+			perror(__func__);
+			return NULL;
+		}
+	}
+
+	const struct fexpr **prog = malloc(e->size * sizeof(const struct fexpr *));
+	if (!prog) {
+		perror(__func__);
+		return NULL;
+	}
+
+	struct fexpr_job job = { .prog = prog, .ntasks = 1 };
+
+	job.depth = fexpr_compile(e, prog, &job.len);
+
+	if (e->rows * e->cols >= FEXPR_PARALLEL_MIN) {
+		job.ntasks = threadpool_get_threads();
+		if (job.ntasks > e->rows)
+			job.ntasks = e->rows;
+	}
+
+	job.scratch = aligned_alloc(FMATRIX_ALIGN, job.ntasks * job.depth * FEXPR_STRIP * sizeof(fval_t));
+	job.stacks = malloc(job.ntasks * job.depth * sizeof(const fval_t *));
+
+	struct fmatrix *m = NULL;
+
+	if (!job.scratch || !job.stacks)
+		perror(__func__);
+	else
+		m = dest ? dest : fmat_alloc(e->rows, e->cols);
+
+	if (m) {
+		job.dest = m;
+		threadpool_run(job.ntasks, fexpr_task, &job);
+	}
+
+	free(job.stacks);
+	free(job.scratch);
+	free(prog);
+
+	return m;
+}
@@ -0,0 +1,52 @@
+#ifndef FEXPR_H
+#define FEXPR_H
+
+#include <stddef.h>
+
+#include "fmatrix.h"
+
+/*
+ * Lazy element-wise expressions over floating-point matrices. Building an
+ * expression only records it; fexpr_eval then computes every element of the
+ * result in a single pass, strip by strip through cache-resident scratch,
+ * without materializing any intermediate matrix.
+ *
+ *	struct fexpr *e = fexpr_sub(fexpr_add(fexpr_mat(a), fexpr_mat(b)),
+ *				    fexpr_scale(fexpr_mat(c), 2.0));
+ *	fexpr_eval(dest, e);
+ *	fexpr_free(e);
+ *
+ * Every builder takes ownership of the expressions it is given and frees
+ * them if it fails, so a failure anywhere in a nested call yields NULL
+ * without leaking.
+ */
+struct fexpr;
+
+/* Expression reading a matrix, which must outlive the expression */
+struct fexpr *fexpr_mat(const struct fmatrix *m);
+/* a + b */
+struct fexpr *fexpr_add(struct fexpr *a, struct fexpr *b);
+/* a - b */
+struct fexpr *fexpr_sub(struct fexpr *a, struct fexpr *b);
+/* Element-wise (Hadamard) product of a and b */
+struct fexpr *fexpr_mul(struct fexpr *a, struct fexpr *b);
+/* s * a */
+struct fexpr *fexpr_scale(struct fexpr *a, fval_t s);
+/* fn applied to every element of a */
+struct fexpr *fexpr_map(struct fexpr *a, fval_t (*fn)(fval_t));
+/* Delete an expression and all of its operands */
+void fexpr_free(struct fexpr *e);
+
+/* Number of rows of the value of an expression */
+size_t fexpr_rows(const struct fexpr *e);
+/* Number of columns of the value of an expression */
+size_t fexpr_cols(const struct fexpr *e);
+
+/*
+ * Evaluate an expression into dest, or into a new matrix if dest is NULL.
+ * dest may be one of the matrices read, unless it is read in the other
+ * orientation through a transposed view.
+ */
+struct fmatrix *fexpr_eval(struct fmatrix *dest, const struct fexpr *e);
+
+#endif /* FEXPR_H */
@@ -0,0 +1,403 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fgemm.h"
+#include "fkernels.h"
+#include "threadpool.h"
+
+static size_t min_size(size_t a, size_t b)
+{
+	return a < b ? a : b;
+}
+
+/* Element (i, j) of an operand */
+static inline fval_t fgemm_at(const struct fgemm_operand *o, size_t i, size_t j)
+{
+	return o->trans ? o->data[o->i0 + j][o->j0 + i] : o->data[o->i0 + i][o->j0 + j];
+}
+
+/*
+ * Pack an mc x kc block of a, starting at (i0, p0), into mr-row micro-panels,
+ * scaled by alpha. Within a micro-panel the mr elements of one column are
+ * adjacent, so the micro-kernel reads a strictly sequentially. Missing edge
+ * rows are zeroed. A transposed a is read along its stored rows, which are
+ * the columns of the block.
+ */
+static void fgemm_pack_a(fval_t *out,
+			 const struct fgemm_operand *a,
+			 size_t i0,
+			 size_t p0,
+			 size_t mc,
+			 size_t kc,
+			 size_t mr,
+			 fval_t alpha)
+{
+	for (size_t ir = 0; ir < mc; ir += mr) {
+		const size_t rows = min_size(mr, mc - ir);
+
+		if (a->trans) {
+			for (size_t p = 0; p < kc; p++) {
+				const fval_t *col = a->data[a->i0 + p0 + p] + a->j0 + i0 + ir;
+				size_t i;
+
+				for (i = 0; i < rows; i++)
+					out[p * mr + i] = alpha * col[i];
+				for (; i < mr; i++)
+					out[p * mr + i] = 0.0;
+			}
+
+			out += mr * kc;
+			continue;
+		}
+
+		for (size_t i = 0; i < mr; i++) {
+			if (i < rows) {
+				const fval_t *row = a->data[a->i0 + i0 + ir + i] + a->j0 + p0;
+
+				for (size_t p = 0; p < kc; p++)
+					out[p * mr + i] = alpha * row[p];
+			} else {
+				for (size_t p = 0; p < kc; p++)
+					out[p * mr + i] = 0.0;
+			}
+		}
+
+		out += mr * kc;
+	}
+}
+
+/*
+ * Pack a kc x nc block of b, starting at (p0, j0), into nr-column micro-panels
+ * holding nr consecutive elements of each row. Missing edge columns are zeroed.
+ * A transposed b is read along its stored rows and scattered into the panel.
+ */
+static void fgemm_pack_b(fval_t *out,
+			 const struct fgemm_operand *b,
+			 size_t p0,
+			 size_t j0,
+			 size_t kc,
+			 size_t nc,
+			 size_t nr)
+{
+	for (size_t jr = 0; jr < nc; jr += nr) {
+		const size_t cols = min_size(nr, nc - jr);
+
+		if (b->trans) {
+			for (size_t j = 0; j < nr; j++) {
+				if (j < cols) {
+					const fval_t *col = b->data[b->i0 + j0 + jr + j] + b->j0 + p0;
+
+					for (size_t p = 0; p < kc; p++)
+						out[p * nr + j] = col[p];
+				} else {
+					for (size_t p = 0; p < kc; p++)
+						out[p * nr + j] = 0.0;
+				}
+			}
+
+			out += nr * kc;
+			continue;
+		}
+
+		for (size_t p = 0; p < kc; p++) {
+			const fval_t *row = b->data[b->i0 + p0 + p] + b->j0 + j0 + jr;
+			size_t j;
+
+			for (j = 0; j < cols; j++)
+				out[j] = row[j];
+			for (; j < nr; j++)
+				out[j] = 0.0;
+
+			out += nr;
+		}
+	}
+}
+
+/* c = beta * c over an m x n block; beta 0 clears without reading */
+static void fgemm_scale(size_t m, size_t n, fval_t beta, struct fgemm_operand c)
+{
+	if (beta == 1.0)
+		return;
+
+	for (size_t i = 0; i < m; i++) {
+		fval_t *d = c.data[c.i0 + i] + c.j0;
+
+		if (beta == 0.0)
+			memset(d, 0, n * sizeof(fval_t));
+		else
+			for (size_t j = 0; j < n; j++)
+				d[j] *= beta;
+	}
+}
+
+/*
+ * Unpacked product for operands too small to amortize packing: i-k-j order,
+ * or dot products along stored rows when b is transposed
+ */
+static void fgemm_small(size_t m,
+			size_t n,
+			size_t k,
+			fval_t alpha,
+			struct fgemm_operand a,
+			struct fgemm_operand b,
+			fval_t beta,
+			struct fgemm_operand c)
+{
+	fgemm_scale(m, n, beta, c);
+
+	for (size_t i = 0; i < m; i++) {
+		fval_t *restrict d = c.data[c.i0 + i] + c.j0;
+
+		if (b.trans) {
+			for (size_t j = 0; j < n; j++) {
+				const fval_t *bcol = b.data[b.i0 + j] + b.j0;
+				fval_t sum = 0.0;
+
+				for (size_t p = 0; p < k; p++)
+					sum += fgemm_at(&a, i, p) * bcol[p];
+				d[j] += alpha * sum;
+			}
+			continue;
+		}
+
+		for (size_t p = 0; p < k; p++) {
+			const fval_t aik = alpha * fgemm_at(&a, i, p);
+			const fval_t *restrict brow = b.data[b.i0 + p] + b.j0;
+
+			for (size_t j = 0; j < n; j++)
+				d[j] += aik * brow[j];
+		}
+	}
+}
+
+/*
+ * Packing buffers of the calling thread, kept from one product to the next
+ * so that repeated products do not allocate. Freed when the thread exits.
+ */
+struct fgemm_buffers {
+	fval_t *apack;
+	size_t apack_bytes;
+	fval_t *bpack;
+	size_t bpack_bytes;
+};
+
+static _Thread_local struct fgemm_buffers fgemm_buffers;
+static pthread_key_t fgemm_buffers_key;
+static pthread_once_t fgemm_buffers_once = PTHREAD_ONCE_INIT;
+
+static void fgemm_buffers_release(void *arg)
+{
+	struct fgemm_buffers *bufs = arg;
+
+	free(bufs->apack);
+	free(bufs->bpack);
+	*bufs = (struct fgemm_buffers){ 0 };
+}
+
+static void fgemm_buffers_key_create(void)
+{
+	pthread_key_create(&fgemm_buffers_key, fgemm_buffers_release);
+}
+
+/* Grow one of this thread's packing buffers to at least bytes */
+static fval_t *fgemm_reserve(fval_t **buf, size_t *cap, size_t bytes)
+{
+	if (*cap >= bytes)
+		return *buf;
+
+	fval_t *grown = aligned_alloc(FMATRIX_ALIGN, bytes);
+	if (!grown)
+		return NULL;
+
+	free(*buf);
+	*buf = grown;
+	*cap = bytes;
+
+	pthread_once(&fgemm_buffers_once, fgemm_buffers_key_create);
+	pthread_setspecific(fgemm_buffers_key, &fgemm_buffers);
+
+	return grown;
+}
+
+/* One (jc, pc) step of the blocked product, shared by all tasks */
+struct fgemm_job {
+	const struct fkernels *kern;
+	size_t m, n, k;
+	fval_t alpha;
+	struct fgemm_operand a, b, c;
+	/* Whether the first pc step adds to c rather than overwriting it */
+	bool accumulate;
+
+	size_t jc, nc;
+	size_t pc, kc;
+
+	/* Work items are (MC block of a, slice of nr-panels of b) pairs */
+	size_t mblocks;
+	size_t slices;
+	size_t ntasks;
+
+	fval_t *bpack;
+	/* One MC x KC packing buffer per task */
+	fval_t *apack;
+	size_t apack_len;
+};
+
+static void fgemm_pack_b_task(void *arg, size_t task)
+{
+	const struct fgemm_job *job = arg;
+	const size_t nr = job->kern->nr;
+	const size_t panels = (job->nc + nr - 1) / nr;
+	const size_t p0 = panels * task / job->ntasks;
+	const size_t p1 = panels * (task + 1) / job->ntasks;
+
+	if (p0 == p1)
+		return;
+
+	fgemm_pack_b(job->bpack + p0 * nr * job->kc,
+		     &job->b,
+		     job->pc,
+		     job->jc + p0 * nr,
+		     job->kc,
+		     min_size(p1 * nr, job->nc) - p0 * nr,
+		     nr);
+}
+
+static void fgemm_compute_task(void *arg, size_t task)
+{
+	const struct fgemm_job *job = arg;
+	const struct fkernels *kern = job->kern;
+	const size_t mr = kern->mr;
+	const size_t nr = kern->nr;
+	const size_t panels = (job->nc + nr - 1) / nr;
+	const size_t nitems = job->mblocks * job->slices;
+	const bool accumulate = job->pc > 0 || job->accumulate;
+	fval_t *apack = job->apack + task * job->apack_len;
+	size_t packed = SIZE_MAX;
+
+	for (size_t item = task; item < nitems; item += job->ntasks) {
+		const size_t block = item / job->slices;
+		const size_t slice = item % job->slices;
+		const size_t ic = block * FGEMM_MC;
+		const size_t mc = min_size(FGEMM_MC, job->m - ic);
+		const size_t jr0 = panels * slice / job->slices * nr;
+		const size_t jr1 = min_size(panels * (slice + 1) / job->slices * nr, job->nc);
+
+		if (jr0 >= jr1)
+			continue;
+
+		if (block != packed) {
+			fgemm_pack_a(apack,
+				     &job->a,
+				     ic,
+				     job->pc,
+				     mc,
+				     job->kc,
+				     mr,
+				     job->alpha);
+			packed = block;
+		}
+
+		for (size_t jr = jr0; jr < jr1; jr += nr)
+			for (size_t ir = 0; ir < mc; ir += mr)
+				kern->gemm(job->kc,
+					   apack + ir * job->kc,
+					   job->bpack + jr * job->kc,
+					   job->c.data,
+					   job->c.i0 + ic + ir,
+					   job->c.j0 + job->jc + jr,
+					   min_size(mr, mc - ir),
+					   min_size(nr, jr1 - jr),
+					   accumulate);
+	}
+}
+
+void fgemm_general(size_t m,
+		   size_t n,
+		   size_t k,
+		   fval_t alpha,
+		   struct fgemm_operand a,
+		   struct fgemm_operand b,
+		   fval_t beta,
+		   struct fgemm_operand c)
+{
+	const struct fkernels *kern = fkernels;
+	const size_t mr = kern->mr;
+	const size_t nr = kern->nr;
+
+	if (!m || !n)
+		return;
+
+	if (!k || alpha == 0.0) {
+		fgemm_scale(m, n, beta, c);
+		return;
+	}
+
+	if (m * n * k < FGEMM_SMALL) {
+		fgemm_small(m, n, k, alpha, a, b, beta, c);
+		return;
+	}
+
+	struct fgemm_job job = {
+		.kern = kern,
+		.m = m,
+		.n = n,
+		.k = k,
+		.alpha = alpha,
+		.a = a,
+		.b = b,
+		.c = c,
+		.accumulate = beta != 0.0,
+		.mblocks = (m + FGEMM_MC - 1) / FGEMM_MC,
+	};
+
+	/* Split columns of b as well when there are fewer blocks of a than threads */
+	const size_t nthreads = threadpool_get_threads();
+
+	job.slices = (nthreads + job.mblocks - 1) / job.mblocks;
+	job.ntasks = min_size(nthreads, job.mblocks * job.slices);
+
+	/* Size the packing buffers for the blocks actually used */
+	const size_t mc_max = min_size(FGEMM_MC, (m + mr - 1) / mr * mr);
+	const size_t nc_max = min_size(FGEMM_NC, (n + nr - 1) / nr * nr);
+	const size_t kc_max = min_size(FGEMM_KC, k);
+	const size_t a_bytes = (mc_max * kc_max * sizeof(fval_t) + FMATRIX_ALIGN - 1) /
+			       FMATRIX_ALIGN * FMATRIX_ALIGN;
+	const size_t b_bytes = (kc_max * nc_max * sizeof(fval_t) + FMATRIX_ALIGN - 1) /
+			       FMATRIX_ALIGN * FMATRIX_ALIGN;
+
+	job.apack_len = a_bytes / sizeof(fval_t);
+	job.apack = fgemm_reserve(&fgemm_buffers.apack, &fgemm_buffers.apack_bytes, job.ntasks * a_bytes);
+	job.bpack = fgemm_reserve(&fgemm_buffers.bpack, &fgemm_buffers.bpack_bytes, b_bytes);
+
+	if (!job.apack || !job.bpack) {
+		fgemm_small(m, n, k, alpha, a, b, beta, c);
+		return;
+	}
+
+	/* The kernels can only overwrite or add, so apply any other beta up front */
+	if (job.accumulate)
+		fgemm_scale(m, n, beta, c);
+
+	for (job.jc = 0; job.jc < n; job.jc += FGEMM_NC) {
+		job.nc = min_size(FGEMM_NC, n - job.jc);
+
+		for (job.pc = 0; job.pc < k; job.pc += FGEMM_KC) {
+			job.kc = min_size(FGEMM_KC, k - job.pc);
+
+			threadpool_run(job.ntasks, fgemm_pack_b_task, &job);
+			threadpool_run(job.ntasks, fgemm_compute_task, &job);
+		}
+	}
+}
+
+void fgemm(fval_t alpha, const struct fmatrix *a, const struct fmatrix *b, fval_t beta, struct fmatrix *c)
+{
+	const struct fgemm_operand ao = { a->data, 0, 0, a->flags & FMAT_TRANSPOSED };
+	const struct fgemm_operand bo = { b->data, 0, 0, b->flags & FMAT_TRANSPOSED };
+	const struct fgemm_operand co = { c->data, 0, 0, false };
+
+	fgemm_general(a->rows, b->cols, a->cols, alpha, ao, bo, beta, co);
+}
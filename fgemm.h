@@ -0,0 +1,53 @@
+#ifndef FGEMM_H
+#define FGEMM_H
+
+#include <stdbool.h>
+
+#include "fmatrix.h"
+
+/*
+ * Blocked GEMM engine behind the floating-point multiplication routines.
+ * Not part of the public API: callers validate dimensions beforehand.
+ */
+
+/*
+ * Cache blocking: MC x KC panel of a for L2, KC x NC panel of b for L3.
+ * MC and NC are multiples of every micro-kernel's register tile.
+ */
+#define FGEMM_MC 144
+#define FGEMM_KC 256
+#define FGEMM_NC 4096
+
+/* Products with fewer multiply-adds than this skip packing entirely */
+#define FGEMM_SMALL (64 * 64 * 64)
+
+/*
+ * Block of a matrix whose top-left element is data[i0][j0]. With trans set
+ * the block is read transposed: its element (i, j) is data[i0 + j][j0 + i].
+ */
+struct fgemm_operand {
+	fval_t *const *data;
+	size_t i0, j0;
+	bool trans;
+};
+
+/*
+ * c = alpha * a * b + beta * c, where c is an m x n block, a is m x k and
+ * b is k x n. With beta 0 the old contents of c are never read.
+ */
+void fgemm_general(size_t m,
+		   size_t n,
+		   size_t k,
+		   fval_t alpha,
+		   struct fgemm_operand a,
+		   struct fgemm_operand b,
+		   fval_t beta,
+		   struct fgemm_operand c);
+
+/*
+ * c = alpha * a * b + beta * c, where c is a->rows x b->cols and
+ * a->cols == b->rows; a and b may be transposed views, c may not
+ */
+void fgemm(fval_t alpha, const struct fmatrix *a, const struct fmatrix *b, fval_t beta, struct fmatrix *c);
+
+#endif /* FGEMM_H */
@@ -0,0 +1,695 @@
+#include <immintrin.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fkernels.h"
+
+/* ---------------- Scalar ---------------- */
+
+#define SCALAR_MR 4
+#define SCALAR_NR 8
+
+static void scalar_gemm(size_t kc,
+			const fval_t *restrict a,
+			const fval_t *restrict b,
+			fval_t *const *c,
+			size_t ci,
+			size_t cj,
+			size_t rows,
+			size_t cols,
+			bool accumulate)
+{
+	fval_t ab[SCALAR_MR][SCALAR_NR] = { 0 };
+
+	for (size_t p = 0; p < kc; p++) {
+		for (size_t i = 0; i < SCALAR_MR; i++) {
+			const fval_t ai = a[i];
+
+			for (size_t j = 0; j < SCALAR_NR; j++)
+				ab[i][j] += ai * b[j];
+		}
+
+		a += SCALAR_MR;
+		b += SCALAR_NR;
+	}
+
+	for (size_t i = 0; i < rows; i++) {
+		fval_t *row = c[ci + i] + cj;
+
+		if (accumulate)
+			for (size_t j = 0; j < cols; j++)
+				row[j] += ab[i][j];
+		else
+			for (size_t j = 0; j < cols; j++)
+				row[j] = ab[i][j];
+	}
+}
+
+static void scalar_add(fval_t *d, const fval_t *a, const fval_t *b, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		d[i] = a[i] + b[i];
+}
+
+static void scalar_sub(fval_t *d, const fval_t *a, const fval_t *b, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		d[i] = a[i] - b[i];
+}
+
+static void scalar_mul(fval_t *d, const fval_t *a, const fval_t *b, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		d[i] = a[i] * b[i];
+}
+
+static void scalar_madd(fval_t *d, const fval_t *a, const fval_t *b, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		d[i] += a[i] * b[i];
+}
+
+static void scalar_msub(fval_t *d, const fval_t *a, const fval_t *b, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		d[i] -= a[i] * b[i];
+}
+
+static void scalar_scale(fval_t *d, fval_t s, const fval_t *a, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		d[i] = s * a[i];
+}
+
+static void scalar_axpy(fval_t *restrict d, fval_t s, const fval_t *restrict x, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		d[i] += s * x[i];
+}
+
+static fval_t scalar_dot(const fval_t *a, const fval_t *b, size_t n)
+{
+	fval_t sum = 0.0;
+
+	for (size_t i = 0; i < n; i++)
+		sum += a[i] * b[i];
+
+	return sum;
+}
+
+static void scalar_trans4(void *const *d, const void *const *s)
+{
+	for (size_t i = 0; i < 4; i++)
+		for (size_t j = 0; j < 4; j++)
+			memcpy((unsigned char *)d[j] + i * 8, (const unsigned char *)s[i] + j * 8, 8);
+}
+
+static const struct fkernels scalar_kernels = {
+	.name = "scalar",
+	.mr = SCALAR_MR,
+	.nr = SCALAR_NR,
+	.gemm = scalar_gemm,
+	.add = scalar_add,
+	.sub = scalar_sub,
+	.mul = scalar_mul,
+	.madd = scalar_madd,
+	.msub = scalar_msub,
+	.scale = scalar_scale,
+	.axpy = scalar_axpy,
+	.dot = scalar_dot,
+	.trans4 = scalar_trans4,
+};
+
+/* ---------------- AVX2 + FMA ---------------- */
+
+#define AVX2_MR 6
+#define AVX2_NR 8
+
+#define AVX2 __attribute__((target("avx2,fma")))
+
+/* Write one 8-wide row of the tile back to c */
+AVX2 static inline void avx2_store_row(fval_t *row, __m256d lo, __m256d hi, bool accumulate)
+{
+	if (accumulate) {
+		lo = _mm256_add_pd(lo, _mm256_loadu_pd(row));
+		hi = _mm256_add_pd(hi, _mm256_loadu_pd(row + 4));
+	}
+
+	_mm256_storeu_pd(row, lo);
+	_mm256_storeu_pd(row + 4, hi);
+}
+
+AVX2 static void avx2_gemm(size_t kc,
+			   const fval_t *restrict a,
+			   const fval_t *restrict b,
+			   fval_t *const *c,
+			   size_t ci,
+			   size_t cj,
+			   size_t rows,
+			   size_t cols,
+			   bool accumulate)
+{
+	__m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+	__m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+	__m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+	__m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+	__m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+	__m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+
+	for (size_t p = 0; p < kc; p++) {
+		const __m256d b0 = _mm256_load_pd(b);
+		const __m256d b1 = _mm256_load_pd(b + 4);
+		__m256d ai;
+
+		ai = _mm256_broadcast_sd(a + 0);
+		c00 = _mm256_fmadd_pd(ai, b0, c00);
+		c01 = _mm256_fmadd_pd(ai, b1, c01);
+		ai = _mm256_broadcast_sd(a + 1);
+		c10 = _mm256_fmadd_pd(ai, b0, c10);
+		c11 = _mm256_fmadd_pd(ai, b1, c11);
+		ai = _mm256_broadcast_sd(a + 2);
+		c20 = _mm256_fmadd_pd(ai, b0, c20);
+		c21 = _mm256_fmadd_pd(ai, b1, c21);
+		ai = _mm256_broadcast_sd(a + 3);
+		c30 = _mm256_fmadd_pd(ai, b0, c30);
+		c31 = _mm256_fmadd_pd(ai, b1, c31);
+		ai = _mm256_broadcast_sd(a + 4);
+		c40 = _mm256_fmadd_pd(ai, b0, c40);
+		c41 = _mm256_fmadd_pd(ai, b1, c41);
+		ai = _mm256_broadcast_sd(a + 5);
+		c50 = _mm256_fmadd_pd(ai, b0, c50);
+		c51 = _mm256_fmadd_pd(ai, b1, c51);
+
+		a += AVX2_MR;
+		b += AVX2_NR;
+	}
+
+	if (rows == AVX2_MR && cols == AVX2_NR) {
+		avx2_store_row(c[ci + 0] + cj, c00, c01, accumulate);
+		avx2_store_row(c[ci + 1] + cj, c10, c11, accumulate);
+		avx2_store_row(c[ci + 2] + cj, c20, c21, accumulate);
+		avx2_store_row(c[ci + 3] + cj, c30, c31, accumulate);
+		avx2_store_row(c[ci + 4] + cj, c40, c41, accumulate);
+		avx2_store_row(c[ci + 5] + cj, c50, c51, accumulate);
+		return;
+	}
+
+	/* Edge tile: spill the registers and copy only the valid corner */
+	fval_t ab[AVX2_MR][AVX2_NR];
+
+	_mm256_storeu_pd(ab[0], c00);
+	_mm256_storeu_pd(ab[0] + 4, c01);
+	_mm256_storeu_pd(ab[1], c10);
+	_mm256_storeu_pd(ab[1] + 4, c11);
+	_mm256_storeu_pd(ab[2], c20);
+	_mm256_storeu_pd(ab[2] + 4, c21);
+	_mm256_storeu_pd(ab[3], c30);
+	_mm256_storeu_pd(ab[3] + 4, c31);
+	_mm256_storeu_pd(ab[4], c40);
+	_mm256_storeu_pd(ab[4] + 4, c41);
+	_mm256_storeu_pd(ab[5], c50);
+	_mm256_storeu_pd(ab[5] + 4, c51);
+
+	for (size_t i = 0; i < rows; i++) {
+		fval_t *row = c[ci + i] + cj;
+
+		if (accumulate)
+			for (size_t j = 0; j < cols; j++)
+				row[j] += ab[i][j];
+		else
+			for (size_t j = 0; j < cols; j++)
+				row[j] = ab[i][j];
+	}
+}
+
+AVX2 static void avx2_add(fval_t *d, const fval_t *a, const fval_t *b, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+		_mm256_storeu_pd(d + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+	for (; i < n; i++)
+		d[i] = a[i] + b[i];
+}
+
+AVX2 static void avx2_sub(fval_t *d, const fval_t *a, const fval_t *b, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+		_mm256_storeu_pd(d + i, _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+	for (; i < n; i++)
+		d[i] = a[i] - b[i];
+}
+
+AVX2 static void avx2_mul(fval_t *d, const fval_t *a, const fval_t *b, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+		_mm256_storeu_pd(d + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+	for (; i < n; i++)
+		d[i] = a[i] * b[i];
+}
+
+AVX2 static void avx2_madd(fval_t *d, const fval_t *a, const fval_t *b, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+		_mm256_storeu_pd(d + i,
+				 _mm256_fmadd_pd(_mm256_loadu_pd(a + i),
+						 _mm256_loadu_pd(b + i),
+						 _mm256_loadu_pd(d + i)));
+	for (; i < n; i++)
+		d[i] += a[i] * b[i];
+}
+
+AVX2 static void avx2_msub(fval_t *d, const fval_t *a, const fval_t *b, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+		_mm256_storeu_pd(d + i,
+				 _mm256_fnmadd_pd(_mm256_loadu_pd(a + i),
+						  _mm256_loadu_pd(b + i),
+						  _mm256_loadu_pd(d + i)));
+	for (; i < n; i++)
+		d[i] -= a[i] * b[i];
+}
+
+AVX2 static void avx2_scale(fval_t *d, fval_t s, const fval_t *a, size_t n)
+{
+	const __m256d vs = _mm256_set1_pd(s);
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+		_mm256_storeu_pd(d + i, _mm256_mul_pd(vs, _mm256_loadu_pd(a + i)));
+	for (; i < n; i++)
+		d[i] = s * a[i];
+}
+
+AVX2 static void avx2_axpy(fval_t *d, fval_t s, const fval_t *x, size_t n)
+{
+	const __m256d vs = _mm256_set1_pd(s);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		_mm256_storeu_pd(d + i,
+				 _mm256_fmadd_pd(vs, _mm256_loadu_pd(x + i), _mm256_loadu_pd(d + i)));
+		_mm256_storeu_pd(d + i + 4,
+				 _mm256_fmadd_pd(vs,
+						 _mm256_loadu_pd(x + i + 4),
+						 _mm256_loadu_pd(d + i + 4)));
+	}
+	for (; i + 4 <= n; i += 4)
+		_mm256_storeu_pd(d + i,
+				 _mm256_fmadd_pd(vs, _mm256_loadu_pd(x + i), _mm256_loadu_pd(d + i)));
+	for (; i < n; i++)
+		d[i] += s * x[i];
+}
+
+AVX2 static fval_t avx2_dot(const fval_t *a, const fval_t *b, size_t n)
+{
+	__m256d s0 = _mm256_setzero_pd();
+	__m256d s1 = _mm256_setzero_pd();
+	size_t i = 0;
+
+	/* Two accumulators hide the latency of the fused multiply-add */
+	for (; i + 8 <= n; i += 8) {
+		s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), s0);
+		s1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4), s1);
+	}
+	for (; i + 4 <= n; i += 4)
+		s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), s0);
+
+	const __m256d s = _mm256_add_pd(s0, s1);
+	const __m128d h = _mm_add_pd(_mm256_castpd256_pd128(s), _mm256_extractf128_pd(s, 1));
+	fval_t sum = _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+
+	for (; i < n; i++)
+		sum += a[i] * b[i];
+
+	return sum;
+}
+
+/* Also used by the AVX-512 table, as 4 x 4 tiles fill a 256-bit register row */
+AVX2 static void avx2_trans4(void *const *d, const void *const *s)
+{
+	const __m256d r0 = _mm256_loadu_pd(s[0]);
+	const __m256d r1 = _mm256_loadu_pd(s[1]);
+	const __m256d r2 = _mm256_loadu_pd(s[2]);
+	const __m256d r3 = _mm256_loadu_pd(s[3]);
+
+	/* Interleave pairs of rows, then swap 128-bit halves across the pairs */
+	const __m256d t0 = _mm256_unpacklo_pd(r0, r1);
+	const __m256d t1 = _mm256_unpackhi_pd(r0, r1);
+	const __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+	const __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+
+	_mm256_storeu_pd(d[0], _mm256_permute2f128_pd(t0, t2, 0x20));
+	_mm256_storeu_pd(d[1], _mm256_permute2f128_pd(t1, t3, 0x20));
+	_mm256_storeu_pd(d[2], _mm256_permute2f128_pd(t0, t2, 0x31));
+	_mm256_storeu_pd(d[3], _mm256_permute2f128_pd(t1, t3, 0x31));
+}
+
+static const struct fkernels avx2_kernels = {
+	.name = "avx2",
+	.mr = AVX2_MR,
+	.nr = AVX2_NR,
+	.gemm = avx2_gemm,
+	.add = avx2_add,
+	.sub = avx2_sub,
+	.mul = avx2_mul,
+	.madd = avx2_madd,
+	.msub = avx2_msub,
+	.scale = avx2_scale,
+	.axpy = avx2_axpy,
+	.dot = avx2_dot,
+	.trans4 = avx2_trans4,
+};
+
+/* ---------------- AVX-512 ---------------- */
+
+#define AVX512_MR 8
+#define AVX512_NR 16
+
+#define AVX512 __attribute__((target("avx512f")))
+
+/* Write one 16-wide row of the tile back to c */
+AVX512 static inline void avx512_store_row(fval_t *row, __m512d lo, __m512d hi, bool accumulate)
+{
+	if (accumulate) {
+		lo = _mm512_add_pd(lo, _mm512_loadu_pd(row));
+		hi = _mm512_add_pd(hi, _mm512_loadu_pd(row + 8));
+	}
+
+	_mm512_storeu_pd(row, lo);
+	_mm512_storeu_pd(row + 8, hi);
+}
+
+AVX512 static void avx512_gemm(size_t kc,
+			       const fval_t *restrict a,
+			       const fval_t *restrict b,
+			       fval_t *const *c,
+			       size_t ci,
+			       size_t cj,
+			       size_t rows,
+			       size_t cols,
+			       bool accumulate)
+{
+	__m512d c00 = _mm512_setzero_pd(), c01 = _mm512_setzero_pd();
+	__m512d c10 = _mm512_setzero_pd(), c11 = _mm512_setzero_pd();
+	__m512d c20 = _mm512_setzero_pd(), c21 = _mm512_setzero_pd();
+	__m512d c30 = _mm512_setzero_pd(), c31 = _mm512_setzero_pd();
+	__m512d c40 = _mm512_setzero_pd(), c41 = _mm512_setzero_pd();
+	__m512d c50 = _mm512_setzero_pd(), c51 = _mm512_setzero_pd();
+	__m512d c60 = _mm512_setzero_pd(), c61 = _mm512_setzero_pd();
+	__m512d c70 = _mm512_setzero_pd(), c71 = _mm512_setzero_pd();
+
+	for (size_t p = 0; p < kc; p++) {
+		const __m512d b0 = _mm512_load_pd(b);
+		const __m512d b1 = _mm512_load_pd(b + 8);
+		__m512d ai;
+
+		ai = _mm512_set1_pd(a[0]);
+		c00 = _mm512_fmadd_pd(ai, b0, c00);
+		c01 = _mm512_fmadd_pd(ai, b1, c01);
+		ai = _mm512_set1_pd(a[1]);
+		c10 = _mm512_fmadd_pd(ai, b0, c10);
+		c11 = _mm512_fmadd_pd(ai, b1, c11);
+		ai = _mm512_set1_pd(a[2]);
+		c20 = _mm512_fmadd_pd(ai, b0, c20);
+		c21 = _mm512_fmadd_pd(ai, b1, c21);
+		ai = _mm512_set1_pd(a[3]);
+		c30 = _mm512_fmadd_pd(ai, b0, c30);
+		c31 = _mm512_fmadd_pd(ai, b1, c31);
+		ai = _mm512_set1_pd(a[4]);
+		c40 = _mm512_fmadd_pd(ai, b0, c40);
+		c41 = _mm512_fmadd_pd(ai, b1, c41);
+		ai = _mm512_set1_pd(a[5]);
+		c50 = _mm512_fmadd_pd(ai, b0, c50);
+		c51 = _mm512_fmadd_pd(ai, b1, c51);
+		ai = _mm512_set1_pd(a[6]);
+		c60 = _mm512_fmadd_pd(ai, b0, c60);
+		c61 = _mm512_fmadd_pd(ai, b1, c61);
+		ai = _mm512_set1_pd(a[7]);
+		c70 = _mm512_fmadd_pd(ai, b0, c70);
+		c71 = _mm512_fmadd_pd(ai, b1, c71);
+
+		a += AVX512_MR;
+		b += AVX512_NR;
+	}
+
+	if (rows == AVX512_MR && cols == AVX512_NR) {
+		avx512_store_row(c[ci + 0] + cj, c00, c01, accumulate);
+		avx512_store_row(c[ci + 1] + cj, c10, c11, accumulate);
+		avx512_store_row(c[ci + 2] + cj, c20, c21, accumulate);
+		avx512_store_row(c[ci + 3] + cj, c30, c31, accumulate);
+		avx512_store_row(c[ci + 4] + cj, c40, c41, accumulate);
+		avx512_store_row(c[ci + 5] + cj, c50, c51, accumulate);
+		avx512_store_row(c[ci + 6] + cj, c60, c61, accumulate);
+		avx512_store_row(c[ci + 7] + cj, c70, c71, accumulate);
+		return;
+	}
+
+	/* Edge tile: write each valid row through a column mask */
+	const __mmask8 mlo = cols >= 8 ? 0xff : (__mmask8)((1u << cols) - 1);
+	const __mmask8 mhi = cols <= 8 ? 0 : (__mmask8)((1u << (cols - 8)) - 1);
+	const __m512d tile[AVX512_MR][2] = {
+		{ c00, c01 }, { c10, c11 }, { c20, c21 }, { c30, c31 },
+		{ c40, c41 }, { c50, c51 }, { c60, c61 }, { c70, c71 },
+	};
+
+	for (size_t i = 0; i < rows; i++) {
+		fval_t *row = c[ci + i] + cj;
+		__m512d lo = tile[i][0];
+		__m512d hi = tile[i][1];
+
+		if (accumulate) {
+			lo = _mm512_add_pd(lo, _mm512_maskz_loadu_pd(mlo, row));
+			hi = _mm512_add_pd(hi, _mm512_maskz_loadu_pd(mhi, row + 8));
+		}
+
+		_mm512_mask_storeu_pd(row, mlo, lo);
+		_mm512_mask_storeu_pd(row + 8, mhi, hi);
+	}
+}
+
+AVX512 static void avx512_add(fval_t *d, const fval_t *a, const fval_t *b, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+		_mm512_storeu_pd(d + i, _mm512_add_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+
+	if (i < n) {
+		const __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+
+		_mm512_mask_storeu_pd(d + i,
+				      m,
+				      _mm512_add_pd(_mm512_maskz_loadu_pd(m, a + i),
+						    _mm512_maskz_loadu_pd(m, b + i)));
+	}
+}
+
+AVX512 static void avx512_sub(fval_t *d, const fval_t *a, const fval_t *b, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+		_mm512_storeu_pd(d + i, _mm512_sub_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+
+	if (i < n) {
+		const __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+
+		_mm512_mask_storeu_pd(d + i,
+				      m,
+				      _mm512_sub_pd(_mm512_maskz_loadu_pd(m, a + i),
+						    _mm512_maskz_loadu_pd(m, b + i)));
+	}
+}
+
+AVX512 static void avx512_mul(fval_t *d, const fval_t *a, const fval_t *b, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+		_mm512_storeu_pd(d + i, _mm512_mul_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+
+	if (i < n) {
+		const __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+
+		_mm512_mask_storeu_pd(d + i,
+				      m,
+				      _mm512_mul_pd(_mm512_maskz_loadu_pd(m, a + i),
+						    _mm512_maskz_loadu_pd(m, b + i)));
+	}
+}
+
+AVX512 static void avx512_madd(fval_t *d, const fval_t *a, const fval_t *b, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+		_mm512_storeu_pd(d + i,
+				 _mm512_fmadd_pd(_mm512_loadu_pd(a + i),
+						 _mm512_loadu_pd(b + i),
+						 _mm512_loadu_pd(d + i)));
+
+	if (i < n) {
+		const __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+
+		_mm512_mask_storeu_pd(d + i,
+				      m,
+				      _mm512_fmadd_pd(_mm512_maskz_loadu_pd(m, a + i),
+						      _mm512_maskz_loadu_pd(m, b + i),
+						      _mm512_maskz_loadu_pd(m, d + i)));
+	}
+}
+
+AVX512 static void avx512_msub(fval_t *d, const fval_t *a, const fval_t *b, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+		_mm512_storeu_pd(d + i,
+				 _mm512_fnmadd_pd(_mm512_loadu_pd(a + i),
+						  _mm512_loadu_pd(b + i),
+						  _mm512_loadu_pd(d + i)));
+
+	if (i < n) {
+		const __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+
+		_mm512_mask_storeu_pd(d + i,
+				      m,
+				      _mm512_fnmadd_pd(_mm512_maskz_loadu_pd(m, a + i),
+						       _mm512_maskz_loadu_pd(m, b + i),
+						       _mm512_maskz_loadu_pd(m, d + i)));
+	}
+}
+
+AVX512 static void avx512_scale(fval_t *d, fval_t s, const fval_t *a, size_t n)
+{
+	const __m512d vs = _mm512_set1_pd(s);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+		_mm512_storeu_pd(d + i, _mm512_mul_pd(vs, _mm512_loadu_pd(a + i)));
+
+	if (i < n) {
+		const __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+
+		_mm512_mask_storeu_pd(d + i, m, _mm512_mul_pd(vs, _mm512_maskz_loadu_pd(m, a + i)));
+	}
+}
+
+AVX512 static void avx512_axpy(fval_t *d, fval_t s, const fval_t *x, size_t n)
+{
+	const __m512d vs = _mm512_set1_pd(s);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+		_mm512_storeu_pd(d + i,
+				 _mm512_fmadd_pd(vs, _mm512_loadu_pd(x + i), _mm512_loadu_pd(d + i)));
+
+	if (i < n) {
+		const __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+
+		_mm512_mask_storeu_pd(d + i,
+				      m,
+				      _mm512_fmadd_pd(vs,
+						      _mm512_maskz_loadu_pd(m, x + i),
+						      _mm512_maskz_loadu_pd(m, d + i)));
+	}
+}
+
+AVX512 static fval_t avx512_dot(const fval_t *a, const fval_t *b, size_t n)
+{
+	__m512d s0 = _mm512_setzero_pd();
+	__m512d s1 = _mm512_setzero_pd();
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		s0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), s0);
+		s1 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 8), _mm512_loadu_pd(b + i + 8), s1);
+	}
+	for (; i + 8 <= n; i += 8)
+		s0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), s0);
+
+	if (i < n) {
+		const __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+
+		s1 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(m, a + i), _mm512_maskz_loadu_pd(m, b + i), s1);
+	}
+
+	return _mm512_reduce_add_pd(_mm512_add_pd(s0, s1));
+}
+
+static const struct fkernels avx512_kernels = {
+	.name = "avx512",
+	.mr = AVX512_MR,
+	.nr = AVX512_NR,
+	.gemm = avx512_gemm,
+	.add = avx512_add,
+	.sub = avx512_sub,
+	.mul = avx512_mul,
+	.madd = avx512_madd,
+	.msub = avx512_msub,
+	.scale = avx512_scale,
+	.axpy = avx512_axpy,
+	.dot = avx512_dot,
+	.trans4 = avx2_trans4,
+};
+
+/* ---------------- Dispatch ---------------- */
+
+const struct fkernels *fkernels = &scalar_kernels;
+
+/* Whether the CPU runs the AVX2 table */
+static bool fkernels_avx2(void)
+{
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+/* Whether the CPU runs the AVX-512 table, whose trans4 is the AVX2 one */
+static bool fkernels_avx512(void)
+{
+	return fkernels_avx2() && __builtin_cpu_supports("avx512f");
+}
+
+const struct fkernels *fkernels_available(size_t i)
+{
+	const struct fkernels *tables[3];
+	size_t n = 0;
+
+	__builtin_cpu_init();
+
+	tables[n++] = &scalar_kernels;
+	if (fkernels_avx2())
+		tables[n++] = &avx2_kernels;
+	if (fkernels_avx512())
+		tables[n++] = &avx512_kernels;
+
+	return i < n ? tables[i] : NULL;
+}
+
+__attribute__((constructor)) static void fkernels_select(void)
+{
+	const char *isa = getenv("MATRIX_ISA");
+	int cap = 2;
+
+	if (isa && !strcmp(isa, "scalar"))
+		cap = 0;
+	else if (isa && !strcmp(isa, "avx2"))
+		cap = 1;
+
+	__builtin_cpu_init();
+
+	if (cap >= 2 && fkernels_avx512())
+		fkernels = &avx512_kernels;
+	else if (cap >= 1 && fkernels_avx2())
+		fkernels = &avx2_kernels;
+	else
+		fkernels = &scalar_kernels;
+}
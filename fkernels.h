@@ -0,0 +1,77 @@
+#ifndef FKERNELS_H
+#define FKERNELS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "fmatrix.h"
+
+/*
+ * Floating-point compute kernels, selected once at startup from the
+ * instruction sets the CPU supports. The MATRIX_ISA environment variable
+ * ("scalar", "avx2" or "avx512") caps the selection, e.g. for testing.
+ * Not part of the public API.
+ */
+
+struct fkernels {
+	const char *name;
+
+	/* Register tile of the GEMM micro-kernel */
+	size_t mr, nr;
+
+	/*
+	 * Multiply a packed mr x kc micro-panel of a (mr values per step) by a
+	 * packed kc x nr micro-panel of b (nr values per step) and store the
+	 * valid rows x cols corner of the tile to c at (ci, cj), adding to the
+	 * existing values if accumulate is set.
+	 */
+	void (*gemm)(size_t kc,
+		     const fval_t *a,
+		     const fval_t *b,
+		     fval_t *const *c,
+		     size_t ci,
+		     size_t cj,
+		     size_t rows,
+		     size_t cols,
+		     bool accumulate);
+
+	/* d = a + b over n elements */
+	void (*add)(fval_t *d, const fval_t *a, const fval_t *b, size_t n);
+	/* d = a - b over n elements */
+	void (*sub)(fval_t *d, const fval_t *a, const fval_t *b, size_t n);
+	/* d = a * b element by element over n elements */
+	void (*mul)(fval_t *d, const fval_t *a, const fval_t *b, size_t n);
+	/* d += a * b element by element over n elements */
+	void (*madd)(fval_t *d, const fval_t *a, const fval_t *b, size_t n);
+	/* d -= a * b element by element over n elements */
+	void (*msub)(fval_t *d, const fval_t *a, const fval_t *b, size_t n);
+	/* d = s * a over n elements */
+	void (*scale)(fval_t *d, fval_t s, const fval_t *a, size_t n);
+	/* d += s * x over n elements */
+	void (*axpy)(fval_t *d, fval_t s, const fval_t *x, size_t n);
+	/* Sum of a[i] * b[i] over n elements */
+	fval_t (*dot)(const fval_t *a, const fval_t *b, size_t n);
+
+	/*
+	 * Transpose a 4 x 4 tile of 64-bit elements: element j of source row
+	 * s[i] becomes element i of destination row d[j]. Only bit patterns are
+	 * moved, so integer and floating-point matrices share it. The tiles must
+	 * not overlap.
+	 */
+	void (*trans4)(void *const *d, const void *const *s);
+};
+
+/* Edge of the tile handled by the transpose kernel */
+#define FKERNELS_TRANS_TILE 4
+
+/* Kernels for the running CPU */
+extern const struct fkernels *fkernels;
+
+/*
+ * The i-th kernel table the running CPU supports, scalar first and the
+ * widest last; NULL past the last. Lets tests run every table whichever one
+ * was selected.
+ */
+const struct fkernels *fkernels_available(size_t i);
+
+#endif /* FKERNELS_H */
@@ -1,9 +1,96 @@
-#include <ctype.h>
 #include <errno.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+#include "fgemm.h"
+#include "fkernels.h"
 #include "fmatrix.h"
+#include "fmatrix_lu.h"
+#include "layout.h"
+#include "parse.h"
+
+size_t fmat_stride(size_t cols)
+{
+	const size_t per_line = FMATRIX_ALIGN / sizeof(fval_t);
+
+	return (cols + per_line - 1) / per_line * per_line;
+}
+
+/* Number of slab elements spanned by a matrix, from its first to its last element */
+static size_t fmat_span(const struct fmatrix *m)
+{
+	return (m->rows - 1) * m->stride + m->cols;
+}
+
+/* True if both matrices keep their elements in slabs with the same row stride */
+static bool fmat_same_layout(const struct fmatrix *a, const struct fmatrix *b)
+{
+	return a->buf && b->buf && a->stride == b->stride;
+}
+
+/* Element (r, c) of a matrix or view */
+static inline fval_t *fmat_at(const struct fmatrix *m, size_t r, size_t c)
+{
+	return m->flags & FMAT_TRANSPOSED ? &m->data[c][r] : &m->data[r][c];
+}
+
+/* The matrix a view reads, in its stored orientation */
+static struct fmatrix fmat_storage(const struct fmatrix *m)
+{
+	if (!(m->flags & FMAT_TRANSPOSED))
+		return *m;
+
+	return (struct fmatrix){
+		.cols = m->rows, .rows = m->cols, .data = m->data, .buf = m->buf, .stride = m->stride
+	};
+}
+
+/* True if both matrices are read in the same orientation */
+static bool fmat_same_orientation(const struct fmatrix *a, const struct fmatrix *b)
+{
+	return !((a->flags ^ b->flags) & FMAT_TRANSPOSED);
+}
+
+/* Offset of the slab in the block holding a matrix, after the struct and row table */
+static size_t fmat_buf_offset(size_t rows)
+{
+	const size_t head = sizeof(struct fmatrix) + rows * sizeof(fval_t *);
+
+	return (head + FMATRIX_ALIGN - 1) / FMATRIX_ALIGN * FMATRIX_ALIGN;
+}
+
+/* Bytes of the block holding a view over rows stored rows: the struct and its row table */
+static size_t fmat_view_size(size_t rows)
+{
+	return sizeof(struct fmatrix) + rows * sizeof(fval_t *);
+}
+
+size_t fmat_block_size(size_t rows, size_t stride)
+{
+	return fmat_buf_offset(rows) + rows * stride * sizeof(fval_t);
+}
+
+struct fmatrix *fmat_layout(unsigned char *block, size_t rows, size_t cols, const struct mat_allocator *alloc)
+{
+	const size_t stride = fmat_stride(cols);
+	struct fmatrix *m = (struct fmatrix *)block;
+	fval_t **data = (fval_t **)(block + sizeof(struct fmatrix));
+	fval_t *buf = (fval_t *)(block + fmat_buf_offset(rows));
+
+	/* Copy over a temporary matrix that holds the const rows and columns */
+	struct fmatrix m_temp = {
+		.cols = cols, .rows = rows, .data = data, .buf = buf, .stride = stride, .alloc = alloc
+	};
+	memcpy(m, &m_temp, sizeof(struct fmatrix));
+
+	memset(buf, 0, rows * stride * sizeof(fval_t));
+
+	for (size_t row = 0; row < rows; row++)
+		data[row] = buf + row * stride;
+
+	return m;
+}
 
 struct fmatrix *fmat_alloc(const size_t rows, const size_t cols)
 {
@@ -13,63 +100,116 @@ struct fmatrix *fmat_alloc(const size_t rows, const size_t cols)
 		return NULL;
 	}
 
-	size_t row;
+	const size_t stride = fmat_stride(cols);
 
-	/* Allocate the struct */
-	struct fmatrix *m = malloc(sizeof(struct fmatrix));
-	if (!m) {
+	if (rows > SIZE_MAX / 2 / sizeof(fval_t) / stride) {
+		errno = ENOMEM;
 		perror(__func__);
-		goto error;
+		return NULL;
 	}
 
-	/* Copy over a temporary matrix that holds the const rows and columns */
-	struct fmatrix m_temp = { .cols = cols, .rows = rows, .data = NULL };
-	memcpy(m, &m_temp, sizeof(struct fmatrix));
-
-	/* Allocate the rows */
-	m->data = calloc(rows, sizeof(fval_t *));
-	if (!m->data) {
+	/* The struct, the row-pointer table and the aligned slab share one block */
+	const struct mat_allocator *alloc = mat_allocator_get();
+	unsigned char *block = alloc->alloc(alloc->ctx, fmat_block_size(rows, stride), FMATRIX_ALIGN);
+	if (!block) {
+		errno = ENOMEM;
 		perror(__func__);
-		goto error_rows;
+		return NULL;
 	}
 
-	/* Allocate the columns */
-	for (row = 0; row < rows; row++) {
-		m->data[row] = calloc(cols, sizeof(fval_t));
-		if (!m->data[row]) {
-			perror(__func__);
-			goto error_columns;
-		}
+	return fmat_layout(block, rows, cols, alloc);
+}
+
+void fmat_free(struct fmatrix *m)
+{
+	if (!m || !m->alloc)
+		return;
+
+	if (m->flags & FMAT_VIEW) {
+		m->alloc->free(m->alloc->ctx, m, fmat_view_size(fmat_storage(m).rows));
+		return;
 	}
 
-	return m;
+	m->alloc->free(m->alloc->ctx, m, fmat_block_size(m->rows, m->stride));
+}
 
-error_columns:
-	while (row > 0) {
-		row--;
-		free(m->data[row]);
+struct fmatrix *fmat_inline(void *storage, size_t bytes, size_t rows, size_t cols)
+{
+	if (!storage || !rows || !cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
 	}
 
-	free(m->data);
-error_rows:
-	free(m);
-error:
-	return NULL;
+	const size_t stride = fmat_stride(cols);
+
+	/* The first two bounds keep the block size from overflowing */
+	const bool fits = (uintptr_t)storage % FMATRIX_ALIGN == 0 && rows <= bytes / sizeof(fval_t *) &&
+			  stride <= bytes / sizeof(fval_t) / rows && fmat_block_size(rows, stride) <= bytes;
+
+	if (fits)
+		return fmat_layout(storage, rows, cols, NULL);
+
+	/* Too large for the inline buffer: take the storage from the spill pool instead */
+	const struct mat_allocator *prev = mat_allocator_set(mat_spill_allocator());
+	struct fmatrix *m = fmat_alloc(rows, cols);
+
+	mat_allocator_set(prev);
+
+	return m;
 }
 
-void fmat_free(struct fmatrix *m)
+void fmat_scope_free(struct fmatrix **m)
 {
-	if (!m)
-		return;
+	fmat_free(*m);
+}
+
+struct fmatrix *fmat_block_view(const struct fmatrix *m, size_t row, size_t col, size_t rows, size_t cols)
+{
+	if (!m || !rows || !cols || row > m->rows || rows > m->rows - row || col > m->cols ||
+	    cols > m->cols - col) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	/* Carve the block out of the storage; a transposed parent gives a transposed view */
+	const bool trans = m->flags & FMAT_TRANSPOSED;
+	const struct fmatrix storage = fmat_storage(m);
+	const size_t srow = trans ? col : row;
+	const size_t scol = trans ? row : col;
+	const size_t srows = trans ? cols : rows;
+	const size_t scols = trans ? rows : cols;
 
-	for (size_t row = 0; row < m->rows; row++)
-		if (m->data[row])
-			free(m->data[row]);
+	const struct mat_allocator *alloc = mat_allocator_get();
+	unsigned char *block = alloc->alloc(alloc->ctx, fmat_view_size(srows), FMATRIX_ALIGN);
+	if (!block) {
+		errno = ENOMEM;
+		perror(__func__);
+		return NULL;
+	}
 
-	if (m->data)
-		free(m->data);
+	struct fmatrix *v = (struct fmatrix *)block;
+	fval_t **data = (fval_t **)(block + sizeof(struct fmatrix));
+	/* A block of whole rows is still one run of the parent's slab */
+	fval_t *buf = storage.buf && !scol && scols == storage.cols ? storage.buf + srow * storage.stride : NULL;
 
-	free(m);
+	/* Copy over a temporary matrix that holds the const rows and columns */
+	struct fmatrix v_temp = {
+		.cols = cols,
+		.rows = rows,
+		.data = data,
+		.buf = buf,
+		.stride = storage.stride,
+		.alloc = alloc,
+		.flags = FMAT_VIEW | (m->flags & FMAT_TRANSPOSED),
+	};
+	memcpy(v, &v_temp, sizeof(struct fmatrix));
+
+	for (size_t r = 0; r < srows; r++)
+		data[r] = storage.data[srow + r] + scol;
+
+	return v;
 }
 
 void fmat_set_identity(struct fmatrix *m)
@@ -117,7 +257,7 @@ void fmat_print(struct fmatrix *m)
 
 	for (size_t row = 0; row < m->rows; row++) {
 		for (size_t col = 0; col < m->cols; col++)
-			printf("%.1f  ", m->data[row][col]);
+			printf("%.1f  ", *fmat_at(m, row, col));
 
 		printf("\n");
 	}
@@ -134,6 +274,13 @@ void fmat_shift_east(struct fmatrix *m, size_t nshifts)
 		return;
 	}
 
+	if (m->flags & FMAT_TRANSPOSED) {
+		struct fmatrix storage = fmat_storage(m);
+
+		fmat_shift_south(&storage, nshifts);
+		return;
+	}
+
 	for (size_t r = 0; r < m->rows; r++) {
 		for (ssize_t c = m->cols - 1; c >= 0; c--) {
 			ssize_t src = c - nshifts;
@@ -150,6 +297,13 @@ void fmat_shift_west(struct fmatrix *m, size_t nshifts)
 		return;
 	}
 
+	if (m->flags & FMAT_TRANSPOSED) {
+		struct fmatrix storage = fmat_storage(m);
+
+		fmat_shift_north(&storage, nshifts);
+		return;
+	}
+
 	for (size_t r = 0; r < m->rows; r++) {
 		for (size_t c = 0; c < m->cols; c++) {
 			size_t src = c + nshifts;
@@ -166,6 +320,13 @@ void fmat_shift_north(struct fmatrix *m, size_t nshifts)
 		return;
 	}
 
+	if (m->flags & FMAT_TRANSPOSED) {
+		struct fmatrix storage = fmat_storage(m);
+
+		fmat_shift_west(&storage, nshifts);
+		return;
+	}
+
 	for (size_t r = 0; r < m->rows; r++) {
 		size_t src = r + nshifts;
 		for (size_t c = 0; c < m->cols; c++) {
@@ -182,6 +343,13 @@ void fmat_shift_south(struct fmatrix *m, size_t nshifts)
 		return;
 	}
 
+	if (m->flags & FMAT_TRANSPOSED) {
+		struct fmatrix storage = fmat_storage(m);
+
+		fmat_shift_east(&storage, nshifts);
+		return;
+	}
+
 	for (ssize_t r = m->rows - 1; r >= 0; r--) {
 		ssize_t src = r - nshifts;
 		for (size_t c = 0; c < m->cols; c++) {
@@ -198,7 +366,7 @@ void fmat_set(struct fmatrix *m, size_t row, size_t col, fval_t val)
 		return;
 	}
 
-	m->data[row][col] = val;
+	*fmat_at(m, row, col) = val;
 }
 
 void fmat_reset(struct fmatrix *m)
@@ -209,9 +377,15 @@ void fmat_reset(struct fmatrix *m)
 		return;
 	}
 
-	for (size_t row = 0; row < m->rows; row++)
-		for (size_t col = 0; col < m->cols; col++)
-			m->data[row][col] = 0.0;
+	const struct fmatrix storage = fmat_storage(m);
+
+	if (storage.buf) {
+		memset(storage.buf, 0, fmat_span(&storage) * sizeof(fval_t));
+		return;
+	}
+
+	for (size_t row = 0; row < storage.rows; row++)
+		memset(storage.data[row], 0, storage.cols * sizeof(fval_t));
 }
 
 void fmat_set_row_gf2(struct fmatrix *m, size_t row, unsigned long long bits)
@@ -226,8 +400,133 @@ void fmat_set_row_gf2(struct fmatrix *m, size_t row, unsigned long long bits)
 		fmat_set(m, row, col, (bits >> ((m->cols - 1) - col) & 0x1));
 }
 
+/* Transposition */
+
+/* Edge of the blocks the transpose works through; a source and destination block fit in L1 */
+#define FMAT_TRANS_BLOCK 32
+
+/* Transpose the kernel tile at (r, c) of src into (c, r) of dest */
+static void fmat_trans_tile(struct fmatrix *dest, const struct fmatrix *src, size_t r, size_t c)
+{
+	const void *s[FKERNELS_TRANS_TILE];
+	void *d[FKERNELS_TRANS_TILE];
+
+	for (size_t i = 0; i < FKERNELS_TRANS_TILE; i++) {
+		s[i] = src->data[r + i] + c;
+		d[i] = dest->data[c + i] + r;
+	}
+
+	fkernels->trans4(d, s);
+}
+
+/* Exchange the kernel tiles at (r, c) and (c, r) of a square matrix, transposing both */
+static void fmat_trans_swap_tiles(struct fmatrix *m, size_t r, size_t c)
+{
+	fval_t tmp[FKERNELS_TRANS_TILE][FKERNELS_TRANS_TILE];
+	const void *a[FKERNELS_TRANS_TILE];
+	const void *b[FKERNELS_TRANS_TILE];
+	void *ad[FKERNELS_TRANS_TILE];
+	void *t[FKERNELS_TRANS_TILE];
+
+	for (size_t i = 0; i < FKERNELS_TRANS_TILE; i++) {
+		a[i] = m->data[r + i] + c;
+		b[i] = m->data[c + i] + r;
+		ad[i] = m->data[r + i] + c;
+		t[i] = tmp[i];
+	}
+
+	fkernels->trans4(t, a);
+	if (r != c)
+		fkernels->trans4(ad, b);
+
+	for (size_t i = 0; i < FKERNELS_TRANS_TILE; i++)
+		memcpy(m->data[c + i] + r, tmp[i], sizeof(tmp[i]));
+}
+
+/* Out-of-place transpose, block by block so that the strided side stays in cache */
+static void fmat_trans_tiled(struct fmatrix *dest, const struct fmatrix *src)
+{
+	const size_t tile = FKERNELS_TRANS_TILE;
+
+	for (size_t r0 = 0; r0 < src->rows; r0 += FMAT_TRANS_BLOCK) {
+		const size_t r1 = r0 + FMAT_TRANS_BLOCK < src->rows ? r0 + FMAT_TRANS_BLOCK : src->rows;
+
+		for (size_t c0 = 0; c0 < src->cols; c0 += FMAT_TRANS_BLOCK) {
+			const size_t c1 = c0 + FMAT_TRANS_BLOCK < src->cols ? c0 + FMAT_TRANS_BLOCK : src->cols;
+			size_t r = r0;
+
+			for (; r + tile <= r1; r += tile) {
+				size_t c = c0;
+
+				for (; c + tile <= c1; c += tile)
+					fmat_trans_tile(dest, src, r, c);
+				for (; c < c1; c++)
+					for (size_t i = r; i < r + tile; i++)
+						dest->data[c][i] = src->data[i][c];
+			}
+
+			for (; r < r1; r++)
+				for (size_t c = c0; c < c1; c++)
+					dest->data[c][r] = src->data[r][c];
+		}
+	}
+}
+
+/* In-place transpose of a square matrix, exchanging tiles across the diagonal */
+static void fmat_trans_square(struct fmatrix *m)
+{
+	const size_t tile = FKERNELS_TRANS_TILE;
+	const size_t n = m->rows;
+
+	for (size_t r0 = 0; r0 < n; r0 += FMAT_TRANS_BLOCK) {
+		const size_t r1 = r0 + FMAT_TRANS_BLOCK < n ? r0 + FMAT_TRANS_BLOCK : n;
+
+		for (size_t c0 = r0; c0 < n; c0 += FMAT_TRANS_BLOCK) {
+			const size_t c1 = c0 + FMAT_TRANS_BLOCK < n ? c0 + FMAT_TRANS_BLOCK : n;
+
+			for (size_t r = r0; r < r1; r += tile) {
+				for (size_t c = c0 == r0 ? r : c0; c < c1; c += tile) {
+					if (r + tile <= n && c + tile <= n) {
+						fmat_trans_swap_tiles(m, r, c);
+						continue;
+					}
+
+					/* Partial tile on the last rows or columns */
+					const size_t ie = r + tile < n ? r + tile : n;
+					const size_t je = c + tile < n ? c + tile : n;
+
+					for (size_t i = r; i < ie; i++) {
+						for (size_t j = r == c ? i + 1 : c; j < je; j++) {
+							const fval_t tmp = m->data[i][j];
+
+							m->data[i][j] = m->data[j][i];
+							m->data[j][i] = tmp;
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
 /* ---------------- Operations ---------------- */
 
+struct fmatrix fmat_trans_view(const struct fmatrix *m)
+{
+	if (!m) {
+		errno = EINVAL;
+		perror(__func__);
+		return (struct fmatrix){ .data = NULL };
+	}
+
+	return (struct fmatrix){
+		.cols = m->rows,
+		.rows = m->cols,
+		.data = m->data,
+		.flags = m->flags ^ FMAT_TRANSPOSED,
+	};
+}
+
 struct fmatrix *fmat_copy(struct fmatrix *dest, const struct fmatrix *src)
 {
 	if (!src) {
@@ -248,9 +547,28 @@ struct fmatrix *fmat_copy(struct fmatrix *dest, const struct fmatrix *src)
 			return NULL;
 	}
 
-	for (size_t r = 0; r < src->rows; r++)
-		for (size_t c = 0; c < src->cols; c++)
-			dest->data[r][c] = src->data[r][c];
+	struct fmatrix d = fmat_storage(dest);
+	const struct fmatrix s = fmat_storage(src);
+
+	/* Copying between orientations transposes the storage */
+	if (!fmat_same_orientation(dest, src)) {
+		if (d.data == s.data)
+			fmat_trans_square(&d);
+		else
+			fmat_trans_tiled(&d, &s);
+		return dest;
+	}
+
+	if (d.data == s.data)
+		return dest;
+
+	if (fmat_same_layout(&d, &s)) {
+		memcpy(d.buf, s.buf, fmat_span(&s) * sizeof(fval_t));
+		return dest;
+	}
+
+	for (size_t r = 0; r < s.rows; r++)
+		memcpy(d.data[r], s.data[r], s.cols * sizeof(fval_t));
 
 	return dest;
 }
@@ -265,12 +583,36 @@ bool fmat_equal(const struct fmatrix *a, const struct fmatrix *b)
 
 	for (size_t r = 0; r < a->rows; r++)
 		for (size_t c = 0; c < a->cols; c++)
-			if (a->data[r][c] != b->data[r][c])
+			if (*fmat_at(a, r, c) != *fmat_at(b, r, c))
 				return false;
 
 	return true;
 }
 
+/*
+ * dest = a + b, or a - b, over operands that are not all read in the same
+ * orientation, block by block so that the operands walked across their
+ * stored rows stay in cache
+ */
+static void fmat_add_mixed(struct fmatrix *dest,
+			   const struct fmatrix *a,
+			   const struct fmatrix *b,
+			   bool subtract)
+{
+	for (size_t r0 = 0; r0 < dest->rows; r0 += FMAT_TRANS_BLOCK) {
+		const size_t r1 = r0 + FMAT_TRANS_BLOCK < dest->rows ? r0 + FMAT_TRANS_BLOCK : dest->rows;
+
+		for (size_t c0 = 0; c0 < dest->cols; c0 += FMAT_TRANS_BLOCK) {
+			const size_t c1 = c0 + FMAT_TRANS_BLOCK < dest->cols ? c0 + FMAT_TRANS_BLOCK : dest->cols;
+
+			for (size_t r = r0; r < r1; r++)
+				for (size_t c = c0; c < c1; c++)
+					*fmat_at(dest, r, c) = subtract ? *fmat_at(a, r, c) - *fmat_at(b, r, c)
+									: *fmat_at(a, r, c) + *fmat_at(b, r, c);
+		}
+	}
+}
+
 struct fmatrix *fmat_add(struct fmatrix *dest, const struct fmatrix *a, const struct fmatrix *b)
 {
 	if (!a || !b || a->rows != b->rows || a->cols != b->cols) {
@@ -291,9 +633,23 @@ struct fmatrix *fmat_add(struct fmatrix *dest, const struct fmatrix *a, const st
 			return NULL;
 	}
 
-	for (size_t r = 0; r < a->rows; r++)
-		for (size_t c = 0; c < a->cols; c++)
-			dest->data[r][c] = a->data[r][c] + b->data[r][c];
+	if (!fmat_same_orientation(dest, a) || !fmat_same_orientation(dest, b)) {
+		fmat_add_mixed(dest, a, b, false);
+		return dest;
+	}
+
+	const struct fmatrix d = fmat_storage(dest);
+	const struct fmatrix sa = fmat_storage(a);
+	const struct fmatrix sb = fmat_storage(b);
+
+	/* Walk the slabs in one pass when all three share a layout */
+	if (fmat_same_layout(&d, &sa) && fmat_same_layout(&d, &sb)) {
+		fkernels->add(d.buf, sa.buf, sb.buf, fmat_span(&sa));
+		return dest;
+	}
+
+	for (size_t r = 0; r < sa.rows; r++)
+		fkernels->add(d.data[r], sa.data[r], sb.data[r], sa.cols);
 
 	return dest;
 }
@@ -318,9 +674,23 @@ struct fmatrix *fmat_sub(struct fmatrix *dest, const struct fmatrix *a, const st
 			return NULL;
 	}
 
-	for (size_t r = 0; r < a->rows; r++)
-		for (size_t c = 0; c < a->cols; c++)
-			dest->data[r][c] = a->data[r][c] - b->data[r][c];
+	if (!fmat_same_orientation(dest, a) || !fmat_same_orientation(dest, b)) {
+		fmat_add_mixed(dest, a, b, true);
+		return dest;
+	}
+
+	const struct fmatrix d = fmat_storage(dest);
+	const struct fmatrix sa = fmat_storage(a);
+	const struct fmatrix sb = fmat_storage(b);
+
+	/* Walk the slabs in one pass when all three share a layout */
+	if (fmat_same_layout(&d, &sa) && fmat_same_layout(&d, &sb)) {
+		fkernels->sub(d.buf, sa.buf, sb.buf, fmat_span(&sa));
+		return dest;
+	}
+
+	for (size_t r = 0; r < sa.rows; r++)
+		fkernels->sub(d.data[r], sa.data[r], sb.data[r], sa.cols);
 
 	return dest;
 }
@@ -345,16 +715,34 @@ struct fmatrix *fmat_mul(struct fmatrix *dest, const struct fmatrix *a, const st
 			return NULL;
 	}
 
-	for (size_t i = 0; i < a->rows; i++) {
-		for (size_t j = 0; j < b->cols; j++) {
-			fval_t sum = 0;
-			for (size_t k = 0; k < a->cols; k++)
-				sum += a->data[i][k] * b->data[k][j];
-			dest->data[i][j] = sum;
-		}
+	return fmat_gemm(1.0, a, b, 0.0, dest);
+}
+
+struct fmatrix *fmat_gemm(fval_t alpha,
+			  const struct fmatrix *a,
+			  const struct fmatrix *b,
+			  fval_t beta,
+			  struct fmatrix *c)
+{
+	if (!a || !b || !c || a->cols != b->rows || c->rows != a->rows || c->cols != b->cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
 	}
 
-	return dest;
+	/* Into a transposed view, accumulate b^T * a^T into its storage instead */
+	if (c->flags & FMAT_TRANSPOSED) {
+		struct fmatrix ct = fmat_trans_view(c);
+		const struct fmatrix at = fmat_trans_view(a);
+		const struct fmatrix bt = fmat_trans_view(b);
+
+		fgemm(alpha, &bt, &at, beta, &ct);
+		return c;
+	}
+
+	fgemm(alpha, a, b, beta, c);
+
+	return c;
 }
 
 struct fmatrix *fmat_trans(struct fmatrix *dest, const struct fmatrix *src)
@@ -377,11 +765,10 @@ struct fmatrix *fmat_trans(struct fmatrix *dest, const struct fmatrix *src)
 			return NULL;
 	}
 
-	for (size_t r = 0; r < src->rows; r++)
-		for (size_t c = 0; c < src->cols; c++)
-			dest->data[c][r] = src->data[r][c];
+	/* The transpose of src is a copy of its transposed view */
+	const struct fmatrix view = fmat_trans_view(src);
 
-	return dest;
+	return fmat_copy(dest, &view);
 }
 
 struct fmatrix *fmat_inv(struct fmatrix *dest, const struct fmatrix *src)
@@ -392,196 +779,154 @@ struct fmatrix *fmat_inv(struct fmatrix *dest, const struct fmatrix *src)
 		return NULL;
 	}
 
-	if (dest) {
-		if (dest->rows != src->rows || dest->cols != src->cols) {
-			errno = EINVAL;
-			perror(__func__);
-			return NULL;
-		}
-	} else {
-		dest = fmat_alloc(src->rows, src->cols);
-		if (!dest)
-			return NULL;
+	if (dest && (dest->rows != src->rows || dest->cols != src->cols)) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct fmat_lu *lu = fmat_lu_new(src);
+	if (!lu)
+		return NULL;
+
+	struct fmatrix *inv = fmat_lu_inv(dest, lu);
+
+	fmat_lu_free(lu);
+
+	return inv;
+}
+
+struct fmatrix *fmat_inv_ws(struct fmatrix *dest,
+			    const struct fmatrix *src,
+			    struct fmat_workspace *ws)
+{
+	if (!src || src->rows != src->cols || !ws) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
 	}
 
-	struct fmatrix *tmp_mat = fmat_alloc(src->rows, src->cols);
-	if (!tmp_mat) {
+	if (dest && (dest->rows != src->rows || dest->cols != src->cols)) {
+		errno = EINVAL;
 		perror(__func__);
-		fmat_free(dest);
 		return NULL;
 	}
 
-	double *inv_row = NULL;
-	double *a_row = NULL;
-	double *inv_i = NULL;
-	double factor = 0.0;
-	double pivot = 0.0;
-	double *a_i = NULL;
-	size_t max_row = 0;
-	double tmp = 0.0;
+	const size_t mark = fmat_workspace_mark(ws);
 
-	/* Copy src to a, initialize inv as identity */
+	struct fmat_lu *lu = fmat_lu_new_ws(src, ws);
+	if (!lu)
+		return NULL;
 
-	for (size_t r = 0; r < src->rows; r++)
-		for (size_t c = 0; c < src->cols; c++) {
-			tmp_mat->data[r][c] = (double)src->data[r][c];
-			dest->data[r][c] = (r == c) ? 1.0 : 0.0;
-		}
+	struct fmatrix *inv = fmat_lu_inv(dest, lu);
 
-	for (size_t r = 0; r < src->rows; r++) {
-		/* Pivot search */
+	fmat_workspace_release(ws, mark);
 
-		max_row = r;
+	return inv;
+}
 
-		for (size_t i = r; i < src->rows; i++)
-			if (fabs(tmp_mat->data[i][r]) > fabs(tmp_mat->data[max_row][r]))
-				max_row = i;
+struct fmatrix *fmat_set_string(const char *str)
+{
+	if (!str) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
 
-		if (fabs(tmp_mat->data[max_row][r]) < 1e-12) {
-			fprintf(stderr, "%s: matrix is singular\n", __func__);
-			fmat_free(tmp_mat);
-			fmat_free(dest);
-			return NULL;
-		}
+	return fmat_set_stringn(str, strlen(str));
+}
 
-		/* Swap rows in a and inv */
+struct fmatrix *fmat_set_stringn(const char *str, size_t len)
+{
+	if (!str) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
 
-		if (max_row != r)
-			for (size_t c = 0; c < src->cols; c++) {
-				tmp = tmp_mat->data[r][c];
-				tmp_mat->data[r][c] = tmp_mat->data[max_row][c];
-				tmp_mat->data[max_row][c] = tmp;
+	struct mat_parse ps;
+	struct fmatrix *m = NULL;
 
-				tmp = dest->data[r][c];
-				dest->data[r][c] = dest->data[max_row][c];
-				dest->data[max_row][c] = tmp;
-			}
+	mat_parse_init(&ps, false, __func__);
+	mat_parse_feed(&ps, str, len, true);
 
-		/* Cache pivot row */
+	if (mat_parse_finish(&ps))
+		m = fmat_alloc(ps.rows, ps.cols);
 
-		a_row = tmp_mat->data[r];
-		inv_row = dest->data[r];
-		pivot = a_row[r];
+	if (m)
+		for (size_t r = 0; r < ps.rows; r++)
+			for (size_t c = 0; c < ps.cols; c++)
+				m->data[r][c] = ps.vals[r * ps.cols + c].f;
 
-		/* Eliminate other rows */
+	mat_parse_release(&ps);
 
-		for (size_t i = 0; i < src->rows; i++) {
-			if (i == r)
-				continue;
+	return m;
+}
 
-			factor = tmp_mat->data[i][r] / pivot;
-			a_i = tmp_mat->data[i];
-			inv_i = dest->data[i];
+/* Store row r of a streamed matrix straight into the destination */
+static bool fmat_read_row(void *ctx, size_t r, const union mat_parse_val *vals, size_t cols)
+{
+	struct fmatrix *m = ctx;
 
-			for (size_t c = 0; c < src->cols; c++) {
-				a_i[c] -= factor * a_row[c];
-				inv_i[c] -= factor * inv_row[c];
-			}
-		}
+	if (r >= m->rows || cols != m->cols)
+		return false;
+
+	for (size_t c = 0; c < cols; c++)
+		*fmat_at(m, r, c) = vals[c].f;
+
+	return true;
+}
 
-		/* Normalize pivot row */
+/* Read a matrix from f, or from fd if f is NULL */
+static struct fmatrix *fmat_read_stream(struct fmatrix *dest, FILE *f, int fd, const char *func)
+{
+	struct mat_parse ps;
+	struct fmatrix *m = NULL;
 
-		for (size_t c = 0; c < src->cols; c++) {
-			a_row[c] /= pivot;
-			inv_row[c] /= pivot;
+	mat_parse_init(&ps, false, func);
+	if (dest) {
+		ps.row = fmat_read_row;
+		ps.ctx = dest;
+	}
+
+	if (mat_parse_stream(&ps, f, fd) && mat_parse_finish(&ps)) {
+		if (!dest) {
+			m = fmat_alloc(ps.rows, ps.cols);
+			if (m)
+				for (size_t r = 0; r < ps.rows; r++)
+					for (size_t c = 0; c < ps.cols; c++)
+						m->data[r][c] = ps.vals[r * ps.cols + c].f;
+		} else if (ps.rows == dest->rows) {
+			m = dest;
+		} else {
+			fprintf(stderr, "%s: Shape does not match the destination\n", func);
+			errno = EINVAL;
 		}
 	}
 
-	fmat_free(tmp_mat);
+	mat_parse_release(&ps);
 
-	return dest;
+	return m;
 }
 
-struct fmatrix *fmat_set_string(const char *str)
+struct fmatrix *fmat_read(struct fmatrix *dest, FILE *f)
 {
-	if (!str) {
+	if (!f) {
 		errno = EINVAL;
 		perror(__func__);
 		return NULL;
 	}
 
-	/* Count rows and columns */
-	size_t current_cols = 0;
-	const char *p = str;
-	int in_number = 0;
-	size_t rows = 0;
-	size_t cols = 0;
-	size_t r = 0;
-	size_t c = 0;
-	char *endptr;
-
-	while (*p) {
-		if (isdigit(*p) || *p == '.' || *p == '-' || *p == '+') {
-			if (!in_number) {
-				in_number = 1;
-				current_cols++;
-			}
-		} else {
-			in_number = 0;
-			if (*p == ';') {
-				if (cols == 0)
-					cols = current_cols;
-				else if (current_cols != cols) {
-					fprintf(stderr,
-						"%s: Inconsistent number of columns\n",
-						__func__);
-					return NULL;
-				}
-				rows++;
-				current_cols = 0;
-			}
-		}
-		p++;
-	}
-	if (current_cols > 0) {
-		if (cols == 0)
-			cols = current_cols;
-		else if (current_cols != cols) {
-			fprintf(stderr, "%s: Inconsistent number of columns\n", __func__);
-			return NULL;
-		}
-		rows++;
-	}
+	return fmat_read_stream(dest, f, -1, __func__);
+}
 
-	struct fmatrix *m = fmat_alloc(rows, cols);
-	if (!m) {
+struct fmatrix *fmat_read_fd(struct fmatrix *dest, int fd)
+{
+	if (fd < 0) {
+		errno = EINVAL;
 		perror(__func__);
 		return NULL;
 	}
 
-	p = str; /* Parse numbers into the matrix */
-
-	while (*p && r < rows) {
-		/* Skip non-numeric, non-minus/plus characters except row separator ; */
-
-		while (*p && !isdigit(*p) && *p != '.' && *p != '-' && *p != '+' && *p != ';')
-			p++;
-
-		if (!*p)
-			break;
-		if (*p == ';') {
-			r++;
-			c = 0;
-			p++;
-			continue;
-		}
-
-		fval_t val = strtod(p, &endptr);
-		if (endptr == p) {
-			fprintf(stderr, "%s: Failed to parse number near '%s'\n", __func__, p);
-			fmat_free(m);
-			return NULL;
-		}
-
-		if (c >= cols) {
-			fprintf(stderr, "%s: Too many columns in row %zu\n", __func__, r);
-			fmat_free(m);
-			return NULL;
-		}
-
-		m->data[r][c++] = val;
-		p = endptr;
-	}
-
-	return m;
+	return fmat_read_stream(dest, NULL, fd, __func__);
 }
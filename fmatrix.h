@@ -6,93 +6,111 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "allocator.h"
+
 /* Scalar type for matrix elements */
 typedef double fval_t;
 
+/* Alignment in bytes of the element slab and of every row within it */
+#define FMATRIX_ALIGN 64
+
+/*
+ * Elements live in one contiguous slab: row r starts at buf + r * stride.
+ * The row-pointer table in data is a view onto the slab, so m->data[r][c]
+ * and m->buf[r * m->stride + c] address the same element.
+ */
 struct fmatrix {
 	const size_t cols, rows;
 	fval_t **data;
+	fval_t *buf;
+	size_t stride;
+	/* Allocator owning the storage, NULL if the matrix does not own it */
+	const struct mat_allocator *alloc;
+	/* FMAT_* view flags */
+	unsigned flags;
 };
 
-/* Stack-allocated matrix */
-#define FMATRIX(name, R, C)                                   \
-	fval_t name##_buf[R][C];                              \
-	fval_t *name##_rowptrs[R];                            \
-	for (size_t i = 0; i < (R); i++)                      \
-		name##_rowptrs[i] = name##_buf[i];            \
-	struct fmatrix name##_obj = { C, R, name##_rowptrs }; \
-	struct fmatrix *name = &name##_obj;                   \
-	memset(name##_buf, 0, sizeof(name##_buf))
-
-#define FMAT_MUL(name, A, B)                                                              \
-	FMATRIX(name, (A)->rows, (B)->cols);                                              \
-	do {                                                                              \
-		if ((A)->cols != (B)->rows) {                                             \
-			fprintf(stderr, "FMAT_MUL: dimension mismatch\n");                \
-		} else {                                                                  \
-			for (size_t i = 0; i < (A)->rows; i++) {                          \
-				for (size_t j = 0; j < (B)->cols; j++) {                  \
-					fval_t sum = 0.0;                                 \
-					for (size_t k = 0; k < (A)->cols; k++)            \
-						sum += (A)->data[i][k] * (B)->data[k][j]; \
-					name->data[i][j] = sum;                           \
-				}                                                         \
-			}                                                                 \
-		}                                                                         \
+/* Element (r, c) is stored at data[c][r]; set on views from fmat_trans_view */
+#define FMAT_TRANSPOSED 0x1
+/* The elements belong to another matrix, fmat_free only releases the view */
+#define FMAT_VIEW 0x2
+
+/* Scratch arena, see fmatrix_workspace.h */
+struct fmat_workspace;
+
+/* Bytes of inline storage of a scoped matrix, including its struct and row table */
+#ifndef FMATRIX_INLINE_BYTES
+#define FMATRIX_INLINE_BYTES 4096
+#endif
+
+/* Set up a rows x cols matrix in storage, or in the spill pool if it does not fit; see FMATRIX */
+struct fmatrix *fmat_inline(void *storage, size_t bytes, size_t rows, size_t cols);
+/* Release a scoped matrix; the cleanup handler of FMATRIX */
+void fmat_scope_free(struct fmatrix **m);
+
+/*
+ * Scoped matrix, zeroed and released when name goes out of scope. It lives in
+ * an inline buffer of FMATRIX_INLINE_BYTES on the stack when it fits and spills
+ * to the thread's spill pool when it does not, so runtime sizes cannot
+ * overflow small thread stacks. name is NULL if spilling fails.
+ */
+#define FMATRIX(name, R, C)                                                        \
+	_Alignas(FMATRIX_ALIGN) unsigned char name##_inline[FMATRIX_INLINE_BYTES]; \
+	__attribute__((cleanup(fmat_scope_free))) struct fmatrix *name =           \
+		fmat_inline(name##_inline, sizeof(name##_inline), (R), (C))
+
+#define FMAT_MUL(name, A, B)                                               \
+	FMATRIX(name, (A)->rows, (B)->cols);                               \
+	do {                                                               \
+		if ((A)->cols != (B)->rows)                                \
+			fprintf(stderr, "FMAT_MUL: dimension mismatch\n"); \
+		else if (name)                                             \
+			fmat_mul(name, (A), (B));                          \
 	} while (0)
 
-#define FMAT_ADD(name, A, B)                                                                  \
-	FMATRIX(name, (A)->rows, (A)->cols);                                                  \
-	do {                                                                                  \
-		if ((A)->rows != (B)->rows || (A)->cols != (B)->cols) {                       \
-			fprintf(stderr, "FMAT_ADD: dimension mismatch\n");                    \
-		} else {                                                                      \
-			for (size_t i = 0; i < (A)->rows; i++) {                              \
-				for (size_t j = 0; j < (A)->cols; j++) {                      \
-					name->data[i][j] = (A)->data[i][j] + (B)->data[i][j]; \
-				}                                                             \
-			}                                                                     \
-		}                                                                             \
+#define FMAT_ADD(name, A, B)                                               \
+	FMATRIX(name, (A)->rows, (A)->cols);                               \
+	do {                                                               \
+		if ((A)->rows != (B)->rows || (A)->cols != (B)->cols)      \
+			fprintf(stderr, "FMAT_ADD: dimension mismatch\n"); \
+		else if (name)                                             \
+			fmat_add(name, (A), (B));                          \
 	} while (0)
 
-#define FMAT_SUB(name, A, B)                                                                  \
-	FMATRIX(name, (A)->rows, (A)->cols);                                                  \
-	do {                                                                                  \
-		if ((A)->rows != (B)->rows || (A)->cols != (B)->cols) {                       \
-			fprintf(stderr, "FMAT_SUB: dimension mismatch\n");                    \
-		} else {                                                                      \
-			for (size_t i = 0; i < (A)->rows; i++) {                              \
-				for (size_t j = 0; j < (A)->cols; j++) {                      \
-					name->data[i][j] = (A)->data[i][j] - (B)->data[i][j]; \
-				}                                                             \
-			}                                                                     \
-		}                                                                             \
+#define FMAT_SUB(name, A, B)                                               \
+	FMATRIX(name, (A)->rows, (A)->cols);                               \
+	do {                                                               \
+		if ((A)->rows != (B)->rows || (A)->cols != (B)->cols)      \
+			fprintf(stderr, "FMAT_SUB: dimension mismatch\n"); \
+		else if (name)                                             \
+			fmat_sub(name, (A), (B));                          \
 	} while (0)
 
-#define FMAT_TRANS(name, A)                                         \
-	FMATRIX(name, (A)->cols, (A)->rows);                        \
-	do {                                                        \
-		for (size_t i = 0; i < (A)->rows; i++) {            \
-			for (size_t j = 0; j < (A)->cols; j++) {    \
-				name->data[j][i] = (A)->data[i][j]; \
-			}                                           \
-		}                                                   \
+#define FMAT_TRANS(name, A)                    \
+	FMATRIX(name, (A)->cols, (A)->rows);   \
+	do {                                   \
+		if (name)                      \
+			fmat_trans(name, (A)); \
 	} while (0)
 
-#define FMAT_COPY(name, A)                                          \
-	FMATRIX(name, (A)->rows, (A)->cols);                        \
-	do {                                                        \
-		for (size_t i = 0; i < (A)->rows; i++) {            \
-			for (size_t j = 0; j < (A)->cols; j++) {    \
-				name->data[i][j] = (A)->data[i][j]; \
-			}                                           \
-		}                                                   \
+#define FMAT_COPY(name, A)                    \
+	FMATRIX(name, (A)->rows, (A)->cols);  \
+	do {                                  \
+		if (name)                     \
+			fmat_copy(name, (A)); \
 	} while (0)
 
 /* Allocate an empty floating-point matrix */
 struct fmatrix *fmat_alloc(const size_t rows, const size_t cols);
 /* Delete a floating-point matrix */
 void fmat_free(struct fmatrix *m);
+/*
+ * View of the rows x cols block of m at (row, col), aliasing the storage of
+ * m through its own row table. Every operation accepts the view, so a block
+ * is updated in place without copying it out; fmat_free releases the view
+ * alone. It is valid as long as m is.
+ */
+struct fmatrix *fmat_block_view(const struct fmatrix *m, size_t row, size_t col, size_t rows, size_t cols);
 
 /* Set the floating-point matrix to an idenitity matrix */
 void fmat_set_identity(struct fmatrix *m);
@@ -100,6 +118,17 @@ void fmat_set_identity(struct fmatrix *m);
 struct fmatrix *fmat_identity_new(const size_t dims);
 /* Allocate a new floating-point matrix from string input */
 struct fmatrix *fmat_set_string(const char *str);
+/* Allocate a new floating-point matrix from the first len bytes of str, which need not be NUL-terminated */
+struct fmatrix *fmat_set_stringn(const char *str, size_t len);
+/*
+ * Read a floating-point matrix written as for fmat_set_string from f up to its end, a
+ * fixed-size chunk at a time. With dest, which must have the shape read, each
+ * row goes straight into it and memory stays bounded by one row; with a NULL
+ * dest the values are buffered and a new matrix is returned.
+ */
+struct fmatrix *fmat_read(struct fmatrix *dest, FILE *f);
+/* Read a floating-point matrix from the file descriptor fd, as fmat_read */
+struct fmatrix *fmat_read_fd(struct fmatrix *dest, int fd);
 
 /* Shift all fields of the floating-point matrix up */
 void fmat_shift_north(struct fmatrix *m, size_t nshifts);
@@ -123,16 +152,39 @@ void fmat_set_row_gf2(struct fmatrix *m, size_t row, unsigned long long bits);
 /* Print a floating-point matrix */
 void fmat_print(struct fmatrix *m);
 
+/*
+ * Transposed view of a matrix, sharing its storage. Copy, comparison, add,
+ * sub, mul and trans read views in place and accept them as destinations,
+ * so a product like A^T * B never materializes A^T. A view owns nothing and
+ * is never freed; it is valid as long as the matrix it views. Other than a
+ * square copy or trans in place, an operation must not write to storage it
+ * also reads in the other orientation.
+ */
+struct fmatrix fmat_trans_view(const struct fmatrix *m);
+
 /* Add two floating-point matrices */
 struct fmatrix *fmat_add(struct fmatrix *dest, const struct fmatrix *a, const struct fmatrix *b);
 /* Subtract two floating-point matrices */
 struct fmatrix *fmat_sub(struct fmatrix *dest, const struct fmatrix *a, const struct fmatrix *b);
 /* Multiply two floating-point matrices */
 struct fmatrix *fmat_mul(struct fmatrix *dest, const struct fmatrix *a, const struct fmatrix *b);;
-/* Transpose a floating-point matrix */
+/*
+ * Accumulate a product in place, c = alpha * a * b + beta * c, in one pass of
+ * the blocked kernel. With beta 0 the old contents of c are never read.
+ */
+struct fmatrix *fmat_gemm(fval_t alpha,
+			  const struct fmatrix *a,
+			  const struct fmatrix *b,
+			  fval_t beta,
+			  struct fmatrix *c);
+/* Transpose a floating-point matrix; dest may be src if it is square */
 struct fmatrix *fmat_trans(struct fmatrix *dest, const struct fmatrix *src);
 /* Compute the inverse of a floating-point matrix */
 struct fmatrix *fmat_inv(struct fmatrix *dest, const struct fmatrix *src);
+/* Compute the inverse with scratch space from ws, sized by fmat_lu_workspace_size */
+struct fmatrix *fmat_inv_ws(struct fmatrix *dest,
+			    const struct fmatrix *src,
+			    struct fmat_workspace *ws);
 /* Copy a floating-point matrix */
 struct fmatrix *fmat_copy(struct fmatrix *dest, const struct fmatrix *src);
 
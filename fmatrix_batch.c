@@ -0,0 +1,507 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fkernels.h"
+#include "fmatrix_batch.h"
+#include "threadpool.h"
+
+/* Matrices processed at a time; the runs of one strip of a 4 x 4 inverse stay in L1 */
+#define FBATCH_STRIP 128
+
+/* Elements of a batch below which operations stay on the calling thread */
+#define FBATCH_PARALLEL_MIN (256 * 1024)
+
+/* Scratch strips of the largest operation, the 4 x 4 inverse */
+#define FBATCH_TEMPS 15
+
+/* Offset of the elements in the block holding a batch, after the struct */
+static size_t fbatch_data_offset(void)
+{
+	return (sizeof(struct fmat_batch) + FMATRIX_ALIGN - 1) / FMATRIX_ALIGN * FMATRIX_ALIGN;
+}
+
+/* Bytes of the block holding a batch */
+static size_t fbatch_size(const struct fmat_batch *b)
+{
+	return fbatch_data_offset() + b->rows * b->cols * b->stride * sizeof(fval_t);
+}
+
+struct fmat_batch *fmat_batch_alloc(size_t count, size_t rows, size_t cols)
+{
+	if (!count || !rows || !cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	/* Round each run up so that every run starts on a FMATRIX_ALIGN boundary */
+	const size_t per_line = FMATRIX_ALIGN / sizeof(fval_t);
+	const size_t limit = (SIZE_MAX / 2 - fbatch_data_offset()) / sizeof(fval_t);
+
+	const size_t stride = count <= limit - per_line ? (count + per_line - 1) / per_line * per_line : 0;
+
+	if (!stride || rows > limit / cols || rows * cols > limit / stride) {
+		errno = ENOMEM;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct fmat_batch b_temp = { .count = count, .rows = rows, .cols = cols, .stride = stride };
+
+	/* The struct and the aligned runs share one block */
+	const struct mat_allocator *alloc = mat_allocator_get();
+	unsigned char *block = alloc->alloc(alloc->ctx, fbatch_size(&b_temp), FMATRIX_ALIGN);
+	if (!block) {
+		errno = ENOMEM;
+		perror(__func__);
+		return NULL;
+	}
+
+	b_temp.data = (fval_t *)(block + fbatch_data_offset());
+	b_temp.alloc = alloc;
+
+	/* Copy over the temporary batch that holds the const dimensions */
+	struct fmat_batch *b = (struct fmat_batch *)block;
+	memcpy(b, &b_temp, sizeof(struct fmat_batch));
+
+	memset(b->data, 0, rows * cols * b->stride * sizeof(fval_t));
+
+	return b;
+}
+
+void fmat_batch_free(struct fmat_batch *b)
+{
+	if (!b || !b->alloc)
+		return;
+
+	b->alloc->free(b->alloc->ctx, b, fbatch_size(b));
+}
+
+void fmat_batch_set(struct fmat_batch *b, size_t k, size_t row, size_t col, fval_t val)
+{
+	if (!b || k >= b->count || row >= b->rows || col >= b->cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return;
+	}
+
+	FMAT_BATCH_ELEM(b, row, col)[k] = val;
+}
+
+fval_t fmat_batch_get(const struct fmat_batch *b, size_t k, size_t row, size_t col)
+{
+	if (!b || k >= b->count || row >= b->rows || col >= b->cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return 0.0;
+	}
+
+	return FMAT_BATCH_ELEM(b, row, col)[k];
+}
+
+struct fmat_batch *fmat_batch_load(struct fmat_batch *b, size_t k, const struct fmatrix *m)
+{
+	if (!b || !m || k >= b->count || m->rows != b->rows || m->cols != b->cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	const bool trans = m->flags & FMAT_TRANSPOSED;
+
+	for (size_t r = 0; r < b->rows; r++)
+		for (size_t c = 0; c < b->cols; c++)
+			FMAT_BATCH_ELEM(b, r, c)[k] = trans ? m->data[c][r] : m->data[r][c];
+
+	return b;
+}
+
+struct fmatrix *fmat_batch_store(struct fmatrix *dest, const struct fmat_batch *b, size_t k)
+{
+	if (!b || k >= b->count) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	if (dest) {
+		if (dest->rows != b->rows || dest->cols != b->cols) {
+			errno = EINVAL;
+			perror(__func__);
+			return NULL;
+		}
+	} else {
+		dest = fmat_alloc(b->rows, b->cols);
+		if (!dest)
+			return NULL;
+	}
+
+	const bool trans = dest->flags & FMAT_TRANSPOSED;
+
+	for (size_t r = 0; r < b->rows; r++) {
+		for (size_t c = 0; c < b->cols; c++) {
+			if (trans)
+				dest->data[c][r] = FMAT_BATCH_ELEM(b, r, c)[k];
+			else
+				dest->data[r][c] = FMAT_BATCH_ELEM(b, r, c)[k];
+		}
+	}
+
+	return dest;
+}
+
+/*
+ * Operations
+ *
+ * Every operation is written once, over strips: the lanes k..k + n of each
+ * element run. Each step of the scalar algorithm becomes one vectorized
+ * kernel call over the strip, and the strips are spread over the threads.
+ */
+
+struct fbatch_job {
+	/* Apply the operation to matrices k..k + n */
+	void (*strip)(const struct fbatch_job *job, size_t k, size_t n);
+	struct fmat_batch *dest;
+	const struct fmat_batch *a, *b;
+	struct fvector *det;
+	size_t nstrips;
+	size_t ntasks;
+};
+
+/* Run one band of strips */
+static void fbatch_task(void *arg, size_t task)
+{
+	const struct fbatch_job *job = arg;
+	const size_t count = job->a->count;
+	const size_t s0 = job->nstrips * task / job->ntasks;
+	const size_t s1 = job->nstrips * (task + 1) / job->ntasks;
+
+	for (size_t s = s0; s < s1; s++) {
+		const size_t k = s * FBATCH_STRIP;
+
+		job->strip(job, k, count - k < FBATCH_STRIP ? count - k : FBATCH_STRIP);
+	}
+}
+
+static void fbatch_run(struct fbatch_job *job)
+{
+	const struct fmat_batch *a = job->a;
+
+	job->nstrips = (a->count + FBATCH_STRIP - 1) / FBATCH_STRIP;
+	job->ntasks = 1;
+
+	if (a->count * a->rows * a->cols >= FBATCH_PARALLEL_MIN) {
+		job->ntasks = threadpool_get_threads();
+		if (job->ntasks > job->nstrips)
+			job->ntasks = job->nstrips;
+	}
+
+	threadpool_run(job->ntasks, fbatch_task, job);
+}
+
+/* Validate dest against the given shape, or allocate it if NULL */
+static struct fmat_batch *fbatch_dest(struct fmat_batch *dest, size_t count, size_t rows, size_t cols, const char *func)
+{
+	if (dest) {
+		if (dest->count != count || dest->rows != rows || dest->cols != cols) {
+			errno = EINVAL;
+			perror(func);
+			return NULL;
+		}
+		return dest;
+	}
+
+	return fmat_batch_alloc(count, rows, cols);
+}
+
+/* Pointers to the strip at lane k of every element of b, row by row */
+static void fbatch_lanes(const struct fmat_batch *b, size_t k, fval_t **p)
+{
+	for (size_t e = 0; e < b->rows * b->cols; e++)
+		p[e] = b->data + e * b->stride + k;
+}
+
+static void fbatch_add_strip(const struct fbatch_job *job, size_t k, size_t n)
+{
+	const size_t elems = job->a->rows * job->a->cols;
+
+	for (size_t e = 0; e < elems; e++)
+		fkernels->add(job->dest->data + e * job->dest->stride + k,
+			      job->a->data + e * job->a->stride + k,
+			      job->b->data + e * job->b->stride + k,
+			      n);
+}
+
+static void fbatch_mul_strip(const struct fbatch_job *job, size_t k, size_t n)
+{
+	const struct fmat_batch *a = job->a;
+	const struct fmat_batch *b = job->b;
+
+	for (size_t i = 0; i < a->rows; i++) {
+		for (size_t j = 0; j < b->cols; j++) {
+			fval_t *d = FMAT_BATCH_ELEM(job->dest, i, j) + k;
+
+			fkernels->mul(d, FMAT_BATCH_ELEM(a, i, 0) + k, FMAT_BATCH_ELEM(b, 0, j) + k, n);
+			for (size_t l = 1; l < a->cols; l++)
+				fkernels->madd(d, FMAT_BATCH_ELEM(a, i, l) + k, FMAT_BATCH_ELEM(b, l, j) + k, n);
+		}
+	}
+}
+
+static void fbatch_trans_strip(const struct fbatch_job *job, size_t k, size_t n)
+{
+	const struct fmat_batch *a = job->a;
+
+	for (size_t i = 0; i < a->rows; i++)
+		for (size_t j = 0; j < a->cols; j++)
+			memcpy(FMAT_BATCH_ELEM(job->dest, j, i) + k, FMAT_BATCH_ELEM(a, i, j) + k, n * sizeof(fval_t));
+}
+
+/* d = a * b - c * e */
+static void fbatch_cross(fval_t *d, const fval_t *a, const fval_t *b, const fval_t *c, const fval_t *e, size_t n)
+{
+	fkernels->mul(d, a, b, n);
+	fkernels->msub(d, c, e, n);
+}
+
+/* d = x0 * y0 - x1 * y1 + x2 * y2 */
+static void fbatch_cof(fval_t *d, const fval_t *const *x, const fval_t *const *y, size_t n)
+{
+	fkernels->mul(d, x[0], y[0], n);
+	fkernels->msub(d, x[1], y[1], n);
+	fkernels->madd(d, x[2], y[2], n);
+}
+
+/*
+ * Determinants of the strip of an order 2 to 4 batch whose elements are at
+ * a, into det. Leaves in t the minors the inverse goes on to use: the first
+ * row of cofactors of order 3, and the 2 x 2 minors of the top and bottom
+ * row pairs of order 4.
+ */
+static void fbatch_det_strip(size_t order, fval_t *const *a, fval_t *det, fval_t (*t)[FBATCH_STRIP], size_t n)
+{
+	switch (order) {
+	case 2:
+		fbatch_cross(det, a[0], a[3], a[1], a[2], n);
+		break;
+	case 3:
+		/* Cyclic indices give the cofactors their signs */
+		for (size_t j = 0; j < 3; j++)
+			fbatch_cross(t[j], a[3 + (j + 1) % 3], a[6 + (j + 2) % 3], a[3 + (j + 2) % 3], a[6 + (j + 1) % 3], n);
+
+		fkernels->mul(det, a[0], t[0], n);
+		fkernels->madd(det, a[1], t[1], n);
+		fkernels->madd(det, a[2], t[2], n);
+		break;
+	case 4:
+		/* t[0..5] are the minors of rows 0 and 1, t[6..11] those of rows 2 and 3 */
+		fbatch_cross(t[0], a[0], a[5], a[4], a[1], n);
+		fbatch_cross(t[1], a[0], a[6], a[4], a[2], n);
+		fbatch_cross(t[2], a[0], a[7], a[4], a[3], n);
+		fbatch_cross(t[3], a[1], a[6], a[5], a[2], n);
+		fbatch_cross(t[4], a[1], a[7], a[5], a[3], n);
+		fbatch_cross(t[5], a[2], a[7], a[6], a[3], n);
+		fbatch_cross(t[6], a[8], a[13], a[12], a[9], n);
+		fbatch_cross(t[7], a[8], a[14], a[12], a[10], n);
+		fbatch_cross(t[8], a[8], a[15], a[12], a[11], n);
+		fbatch_cross(t[9], a[9], a[14], a[13], a[10], n);
+		fbatch_cross(t[10], a[9], a[15], a[13], a[11], n);
+		fbatch_cross(t[11], a[10], a[15], a[14], a[11], n);
+
+		fkernels->mul(det, t[0], t[11], n);
+		fkernels->msub(det, t[1], t[10], n);
+		fkernels->madd(det, t[2], t[9], n);
+		fkernels->madd(det, t[3], t[8], n);
+		fkernels->msub(det, t[4], t[7], n);
+		fkernels->madd(det, t[5], t[6], n);
+		break;
+	}
+}
+
+static void fbatch_det_strip_job(const struct fbatch_job *job, size_t k, size_t n)
+{
+	fval_t *a[16];
+	fval_t t[FBATCH_TEMPS][FBATCH_STRIP];
+
+	fbatch_lanes(job->a, k, a);
+	fbatch_det_strip(job->a->rows, a, job->det->data + k, t, n);
+}
+
+/*
+ * Element (i, j) of the order 4 inverse, times the determinant, is
+ * x0 * y0 - x1 * y1 + x2 * y2 negated when i + j is odd. Operands index the
+ * elements 0..15, then the minors t[0..11] of fbatch_det_strip as 16..27.
+ */
+static const unsigned char fbatch_inv4_terms[16][6] = {
+	{ 5, 27, 6, 26, 7, 25 },  { 1, 27, 2, 26, 3, 25 },  { 13, 21, 14, 20, 15, 19 }, { 9, 21, 10, 20, 11, 19 },
+	{ 4, 27, 6, 24, 7, 23 },  { 0, 27, 2, 24, 3, 23 },  { 12, 21, 14, 18, 15, 17 }, { 8, 21, 10, 18, 11, 17 },
+	{ 4, 26, 5, 24, 7, 22 },  { 0, 26, 1, 24, 3, 22 },  { 12, 20, 13, 18, 15, 16 }, { 8, 20, 9, 18, 11, 16 },
+	{ 4, 25, 5, 23, 6, 22 },  { 0, 25, 1, 23, 2, 22 },  { 12, 19, 13, 17, 14, 16 }, { 8, 19, 9, 17, 10, 16 },
+};
+
+static void fbatch_inv_strip(const struct fbatch_job *job, size_t k, size_t n)
+{
+	const size_t order = job->a->rows;
+	fval_t *a[16];
+	fval_t *d[16];
+	fval_t t[FBATCH_TEMPS][FBATCH_STRIP];
+	/* Determinant, its reciprocal and the negated reciprocal */
+	fval_t *det = job->det ? job->det->data + k : t[FBATCH_TEMPS - 3];
+	fval_t *r = t[FBATCH_TEMPS - 2];
+	fval_t *nr = t[FBATCH_TEMPS - 1];
+
+	fbatch_lanes(job->a, k, a);
+	fbatch_lanes(job->dest, k, d);
+	fbatch_det_strip(order, a, det, t, n);
+
+	for (size_t j = 0; j < n; j++) {
+		r[j] = 1.0 / det[j];
+		nr[j] = -r[j];
+	}
+
+	switch (order) {
+	case 2:
+		fkernels->mul(d[0], a[3], r, n);
+		fkernels->mul(d[1], a[1], nr, n);
+		fkernels->mul(d[2], a[2], nr, n);
+		fkernels->mul(d[3], a[0], r, n);
+		break;
+	case 3:
+		for (size_t i = 1; i < 3; i++) {
+			const size_t i1 = 3 * ((i + 1) % 3);
+			const size_t i2 = 3 * ((i + 2) % 3);
+
+			for (size_t j = 0; j < 3; j++)
+				fbatch_cross(t[3 * i + j],
+					     a[i1 + (j + 1) % 3],
+					     a[i2 + (j + 2) % 3],
+					     a[i1 + (j + 2) % 3],
+					     a[i2 + (j + 1) % 3],
+					     n);
+		}
+
+		/* The inverse is the transposed cofactor matrix over the determinant */
+		for (size_t i = 0; i < 3; i++)
+			for (size_t j = 0; j < 3; j++)
+				fkernels->mul(d[3 * j + i], t[3 * i + j], r, n);
+		break;
+	case 4: {
+		const fval_t *ops[28];
+
+		for (size_t e = 0; e < 16; e++)
+			ops[e] = a[e];
+		for (size_t m = 0; m < 12; m++)
+			ops[16 + m] = t[m];
+
+		for (size_t e = 0; e < 16; e++) {
+			const unsigned char *terms = fbatch_inv4_terms[e];
+			const fval_t *x[3] = { ops[terms[0]], ops[terms[2]], ops[terms[4]] };
+			const fval_t *y[3] = { ops[terms[1]], ops[terms[3]], ops[terms[5]] };
+
+			fbatch_cof(d[e], x, y, n);
+			fkernels->mul(d[e], d[e], (e / 4 + e % 4) % 2 ? nr : r, n);
+		}
+		break;
+	}
+	}
+}
+
+struct fmat_batch *fmat_batch_add(struct fmat_batch *dest, const struct fmat_batch *a, const struct fmat_batch *b)
+{
+	if (!a || !b || a->count != b->count || a->rows != b->rows || a->cols != b->cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct fbatch_job job = { .strip = fbatch_add_strip, .a = a, .b = b };
+
+	job.dest = fbatch_dest(dest, a->count, a->rows, a->cols, __func__);
+	if (!job.dest)
+		return NULL;
+
+	fbatch_run(&job);
+
+	return job.dest;
+}
+
+struct fmat_batch *fmat_batch_mul(struct fmat_batch *dest, const struct fmat_batch *a, const struct fmat_batch *b)
+{
+	if (!a || !b || a->count != b->count || a->cols != b->rows || (dest && (dest == a || dest == b))) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct fbatch_job job = { .strip = fbatch_mul_strip, .a = a, .b = b };
+
+	job.dest = fbatch_dest(dest, a->count, a->rows, b->cols, __func__);
+	if (!job.dest)
+		return NULL;
+
+	fbatch_run(&job);
+
+	return job.dest;
+}
+
+struct fmat_batch *fmat_batch_trans(struct fmat_batch *dest, const struct fmat_batch *a)
+{
+	if (!a || (dest && dest == a)) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct fbatch_job job = { .strip = fbatch_trans_strip, .a = a };
+
+	job.dest = fbatch_dest(dest, a->count, a->cols, a->rows, __func__);
+	if (!job.dest)
+		return NULL;
+
+	fbatch_run(&job);
+
+	return job.dest;
+}
+
+struct fvector *fmat_batch_det(struct fvector *dest, const struct fmat_batch *a)
+{
+	if (!a || a->rows != a->cols || a->rows < 2 || a->rows > 4 || (dest && dest->len != a->count)) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct fbatch_job job = { .strip = fbatch_det_strip_job, .a = a, .det = dest };
+
+	if (!job.det) {
+		job.det = fvec_alloc(a->count);
+		if (!job.det)
+			return NULL;
+	}
+
+	fbatch_run(&job);
+
+	return job.det;
+}
+
+struct fmat_batch *fmat_batch_inv(struct fmat_batch *dest, const struct fmat_batch *a, struct fvector *det)
+{
+	if (!a || a->rows != a->cols || a->rows < 2 || a->rows > 4 || (dest && dest == a) ||
+	    (det && det->len != a->count)) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct fbatch_job job = { .strip = fbatch_inv_strip, .a = a, .det = det };
+
+	job.dest = fbatch_dest(dest, a->count, a->rows, a->cols, __func__);
+	if (!job.dest)
+		return NULL;
+
+	fbatch_run(&job);
+
+	return job.dest;
+}
@@ -0,0 +1,66 @@
+#ifndef FMATRIX_BATCH_H
+#define FMATRIX_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "fmatrix.h"
+#include "fvector.h"
+
+/*
+ * Batch of count small matrices of one shape, stored as structure of arrays:
+ * element (r, c) of every matrix forms one aligned run of count values,
+ * matrix k at index k of the run. An operation on the batch is then the
+ * scalar algorithm with every scalar replaced by a vector of lanes, so each
+ * vector instruction advances 4 or 8 matrices at once and no matrix pays for
+ * its own allocation, row table or call.
+ */
+struct fmat_batch {
+	const size_t count, rows, cols;
+	/* Distance between the runs of two elements, count rounded up for alignment */
+	size_t stride;
+	fval_t *data;
+	/* Allocator owning the storage, NULL if the batch does not own it */
+	const struct mat_allocator *alloc;
+};
+
+/* Run holding element (r, c) of every matrix of the batch */
+#define FMAT_BATCH_ELEM(b, r, c) ((b)->data + ((r) * (b)->cols + (c)) * (b)->stride)
+
+/* Allocate a zeroed batch of count rows x cols matrices */
+struct fmat_batch *fmat_batch_alloc(size_t count, size_t rows, size_t cols);
+/* Delete a batch */
+void fmat_batch_free(struct fmat_batch *b);
+
+/* Set element (row, col) of matrix k */
+void fmat_batch_set(struct fmat_batch *b, size_t k, size_t row, size_t col, fval_t val);
+/* Get element (row, col) of matrix k */
+fval_t fmat_batch_get(const struct fmat_batch *b, size_t k, size_t row, size_t col);
+
+/* Copy m into matrix k of the batch */
+struct fmat_batch *fmat_batch_load(struct fmat_batch *b, size_t k, const struct fmatrix *m);
+/* Copy matrix k of the batch into dest, or into a new matrix if dest is NULL */
+struct fmatrix *fmat_batch_store(struct fmatrix *dest, const struct fmat_batch *b, size_t k);
+
+/*
+ * Operations apply to every matrix of the batch and write into dest, or into a
+ * new batch if dest is NULL. dest must not be one of the operands of mul,
+ * trans or inv.
+ */
+
+/* dest[k] = a[k] + b[k] */
+struct fmat_batch *fmat_batch_add(struct fmat_batch *dest, const struct fmat_batch *a, const struct fmat_batch *b);
+/* dest[k] = a[k] * b[k] */
+struct fmat_batch *fmat_batch_mul(struct fmat_batch *dest, const struct fmat_batch *a, const struct fmat_batch *b);
+/* dest[k] = a[k]^T */
+struct fmat_batch *fmat_batch_trans(struct fmat_batch *dest, const struct fmat_batch *a);
+/* dest->data[k] = det(a[k]) for square matrices of order 2 to 4 */
+struct fvector *fmat_batch_det(struct fvector *dest, const struct fmat_batch *a);
+/*
+ * dest[k] = a[k]^-1 for square matrices of order 2 to 4, by the adjugate over
+ * the determinant. A singular matrix yields non-finite elements; the
+ * determinants are stored to det unless it is NULL, so callers can tell.
+ */
+struct fmat_batch *fmat_batch_inv(struct fmat_batch *dest, const struct fmat_batch *a, struct fvector *det);
+
+#endif /* FMATRIX_BATCH_H */
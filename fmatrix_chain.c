@@ -0,0 +1,291 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fmatrix_chain.h"
+#include "fmatrix_workspace.h"
+
+/* One product of the plan, in execution order */
+struct fmat_chain_step {
+	/* Operands: matrix ref of the chain below n, else the result of step ref - n */
+	size_t lhs, rhs;
+	size_t rows, cols;
+	/* Workspace holding the result; unused by the last step, which writes to dest */
+	size_t slot;
+};
+
+struct fmat_chain {
+	size_t n;
+	/* Matrix i of the chain is dims[i] x dims[i + 1] */
+	size_t *dims;
+	size_t cost;
+	/* n - 1 steps, each operand computed before the step using it */
+	struct fmat_chain_step *steps;
+	/* Results of the steps while executing */
+	struct fmatrix **results;
+	/* Workspaces shared by intermediate results that are never live together */
+	struct fmat_workspace **slots;
+	size_t nslots;
+};
+
+/* Append the steps of the product of matrices i..j; return its operand ref */
+static size_t fmat_chain_build(struct fmat_chain *chain, const size_t *split, size_t i, size_t j, size_t *nsteps)
+{
+	if (i == j)
+		return i;
+
+	const size_t n = chain->n;
+	const size_t k = split[i * n + j];
+	const size_t lhs = fmat_chain_build(chain, split, i, k, nsteps);
+	const size_t rhs = fmat_chain_build(chain, split, k + 1, j, nsteps);
+	struct fmat_chain_step *step = &chain->steps[*nsteps];
+
+	step->lhs = lhs;
+	step->rhs = rhs;
+	step->rows = chain->dims[i];
+	step->cols = chain->dims[j + 1];
+
+	return n + (*nsteps)++;
+}
+
+/*
+ * Classic O(n^3) dynamic program over the chain: cost[i][j] is the cheapest
+ * product of matrices i..j and split[i][j] the matrix it splits after.
+ * Returns false if the tables cannot be allocated.
+ */
+static bool fmat_chain_order(struct fmat_chain *chain, size_t *split)
+{
+	const size_t n = chain->n;
+	const size_t *p = chain->dims;
+	size_t *cost = calloc(n * n, sizeof(size_t));
+	if (!cost)
+		return false;
+
+	for (size_t len = 2; len <= n; len++) {
+		for (size_t i = 0; i + len <= n; i++) {
+			const size_t j = i + len - 1;
+
+			cost[i * n + j] = SIZE_MAX;
+			for (size_t k = i; k < j; k++) {
+				const size_t c = cost[i * n + k] + cost[(k + 1) * n + j] + p[i] * p[k + 1] * p[j + 1];
+
+				if (c < cost[i * n + j]) {
+					cost[i * n + j] = c;
+					split[i * n + j] = k;
+				}
+			}
+		}
+	}
+
+	chain->cost = cost[n - 1];
+	free(cost);
+
+	return true;
+}
+
+/*
+ * Give every intermediate result a workspace. Results are produced in step
+ * order and die once their step has run, so a workspace is recycled as soon
+ * as its result has been consumed. Sizes each workspace for the largest
+ * result it holds and allocates them; returns false on failure.
+ */
+static bool fmat_chain_assign(struct fmat_chain *chain)
+{
+	const size_t n = chain->n;
+	size_t *size = calloc(n, sizeof(size_t));
+	bool *busy = calloc(n, sizeof(bool));
+	bool ok = false;
+
+	if (!size || !busy)
+		goto out;
+
+	for (size_t t = 0; t + 2 < n; t++) {
+		struct fmat_chain_step *step = &chain->steps[t];
+		const size_t bytes = fmat_workspace_matrix_size(step->rows, step->cols);
+		size_t slot = 0;
+
+		while (slot < chain->nslots && busy[slot])
+			slot++;
+		if (slot == chain->nslots)
+			chain->nslots++;
+
+		step->slot = slot;
+		busy[slot] = true;
+		if (bytes > size[slot])
+			size[slot] = bytes;
+
+		if (step->lhs >= n)
+			busy[chain->steps[step->lhs - n].slot] = false;
+		if (step->rhs >= n)
+			busy[chain->steps[step->rhs - n].slot] = false;
+	}
+
+	chain->slots = calloc(chain->nslots ? chain->nslots : 1, sizeof(struct fmat_workspace *));
+	if (!chain->slots)
+		goto out;
+
+	for (size_t s = 0; s < chain->nslots; s++) {
+		chain->slots[s] = fmat_workspace_new(size[s]);
+		if (!chain->slots[s])
+			goto out;
+	}
+
+	ok = true;
+out:
+	free(size);
+	free(busy);
+	return ok;
+}
+
+struct fmat_chain *fmat_chain_new(const struct fmatrix *const *m, size_t n)
+{
+	if (!m || !n) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		if (!m[i] || (i + 1 < n && m[i + 1] && m[i]->cols != m[i + 1]->rows)) {
+			errno = EINVAL;
+			perror(__func__);
+			return NULL;
+		}
+	}
+
+	struct fmat_chain *chain = calloc(1, sizeof(struct fmat_chain));
+	if (!chain) {
+		perror(__func__);
+		return NULL;
+	}
+
+	chain->n = n;
+	chain->dims = malloc((n + 1) * sizeof(size_t));
+	chain->steps = malloc(n * sizeof(struct fmat_chain_step));
+	chain->results = malloc(n * sizeof(struct fmatrix *));
+	size_t *split = malloc(n * n * sizeof(size_t));
+
+	if (!chain->dims || !chain->steps || !chain->results || !split)
+		goto error;
+
+	for (size_t i = 0; i < n; i++)
+		chain->dims[i] = m[i]->rows;
+	chain->dims[n] = m[n - 1]->cols;
+
+	if (!fmat_chain_order(chain, split))
+		goto error;
+
+	size_t nsteps = 0;
+
+	fmat_chain_build(chain, split, 0, n - 1, &nsteps);
+
+	if (!fmat_chain_assign(chain))
+		goto error;
+
+	free(split);
+
+	return chain;
+
+error:
+	perror(__func__);
+	free(split);
+	fmat_chain_free(chain);
+	return NULL;
+}
+
+void fmat_chain_free(struct fmat_chain *chain)
+{
+	if (!chain)
+		return;
+
+	if (chain->slots)
+		for (size_t s = 0; s < chain->nslots; s++)
+			fmat_workspace_free(chain->slots[s]);
+
+	free(chain->slots);
+	free(chain->results);
+	free(chain->steps);
+	free(chain->dims);
+	free(chain);
+}
+
+size_t fmat_chain_cost(const struct fmat_chain *chain)
+{
+	return chain ? chain->cost : 0;
+}
+
+/* Operand ref of a step, as a matrix */
+static const struct fmatrix *fmat_chain_operand(const struct fmat_chain *chain,
+						const struct fmatrix *const *m,
+						size_t ref)
+{
+	return ref < chain->n ? m[ref] : chain->results[ref - chain->n];
+}
+
+struct fmatrix *fmat_chain_mul(struct fmatrix *dest,
+			       struct fmat_chain *chain,
+			       const struct fmatrix *const *m)
+{
+	if (!chain || !m) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	const size_t n = chain->n;
+
+	for (size_t i = 0; i < n; i++) {
+		if (!m[i] || m[i] == dest || m[i]->rows != chain->dims[i] || m[i]->cols != chain->dims[i + 1]) {
+			errno = EINVAL;
+			perror(__func__);
+			return NULL;
+		}
+	}
+
+	if (dest) {
+		if (dest->rows != chain->dims[0] || dest->cols != chain->dims[n]) {
+			errno = EINVAL;
+			perror(__func__);
+			return NULL;
+		}
+	} else {
+		dest = fmat_alloc(chain->dims[0], chain->dims[n]);
+		if (!dest)
+			return NULL;
+	}
+
+	if (n == 1)
+		return fmat_copy(dest, m[0]);
+
+	for (size_t t = 0; t + 1 < n; t++) {
+		const struct fmat_chain_step *step = &chain->steps[t];
+		struct fmatrix *res = dest;
+
+		/* The workspace is free again: whatever it held has been consumed */
+		if (t + 2 < n) {
+			struct fmat_workspace *ws = chain->slots[step->slot];
+
+			fmat_workspace_release(ws, 0);
+			res = fmat_workspace_matrix(ws, step->rows, step->cols);
+		}
+
+		chain->results[t] = res;
+		fmat_mul(res, fmat_chain_operand(chain, m, step->lhs), fmat_chain_operand(chain, m, step->rhs));
+	}
+
+	return dest;
+}
+
+struct fmatrix *fmat_mul_chain(struct fmatrix *dest, const struct fmatrix *const *m, size_t n)
+{
+	struct fmat_chain *chain = fmat_chain_new(m, n);
+	if (!chain)
+		return NULL;
+
+	struct fmatrix *res = fmat_chain_mul(dest, chain, m);
+
+	fmat_chain_free(chain);
+
+	return res;
+}
@@ -0,0 +1,33 @@
+#ifndef FMATRIX_CHAIN_H
+#define FMATRIX_CHAIN_H
+
+#include <stddef.h>
+
+#include "fmatrix.h"
+
+/*
+ * Matrix-chain products, m[0] * m[1] * ... * m[n - 1], in the order with the
+ * fewest multiply-adds. Planning looks only at the shapes, so a plan is made
+ * once and executed for any chain of the same shapes; it keeps the storage of
+ * its intermediate products, which executions reuse instead of allocating.
+ */
+struct fmat_chain;
+
+/* Plan the product of n matrices with the shapes of m */
+struct fmat_chain *fmat_chain_new(const struct fmatrix *const *m, size_t n);
+/* Delete a plan and its intermediate storage */
+void fmat_chain_free(struct fmat_chain *chain);
+/* Multiply-adds of the planned order */
+size_t fmat_chain_cost(const struct fmat_chain *chain);
+
+/*
+ * Multiply a chain with the planned shapes into dest, or into a new matrix if
+ * dest is NULL; dest must not be one of the matrices of the chain
+ */
+struct fmatrix *fmat_chain_mul(struct fmatrix *dest,
+			       struct fmat_chain *chain,
+			       const struct fmatrix *const *m);
+/* Plan, multiply and delete the plan in one go */
+struct fmatrix *fmat_mul_chain(struct fmatrix *dest, const struct fmatrix *const *m, size_t n);
+
+#endif /* FMATRIX_CHAIN_H */
@@ -0,0 +1,311 @@
+#ifndef FMATRIX_FIXED_H
+#define FMATRIX_FIXED_H
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "fmatrix.h"
+
+/*
+ * Fixed-size square matrices. The order is part of the type, so every loop
+ * below has a compile-time trip count and unrolls completely once inlined:
+ * a 4 x 4 product becomes 64 multiply-adds on registers, with no row table
+ * and no checks. Values are passed and returned by value.
+ *
+ * fmat2, fmat3 and fmat4 are defined here, with closed-form determinants and
+ * inverses. FMAT_FIXED_DEFINE(N) generates the family for any other small N,
+ * with an inverse by unrolled Gauss-Jordan elimination.
+ */
+
+/* Unroll the following loop completely; its trip count is at most 16 */
+#define FMAT_FIXED_UNROLL _Pragma("GCC unroll 16")
+
+#define FMAT_FIXED_DEFINE_OPS(N)                                                              \
+	struct fmat##N {                                                                      \
+		fval_t m[N][N];                                                               \
+	};                                                                                    \
+                                                                                              \
+	/* Identity matrix */                                                                 \
+	static inline struct fmat##N fmat##N##_identity(void)                                 \
+	{                                                                                     \
+		struct fmat##N d = { { { 0 } } };                                             \
+                                                                                              \
+		FMAT_FIXED_UNROLL for (int i = 0; i < N; i++) d.m[i][i] = 1.0;                \
+		return d;                                                                     \
+	}                                                                                     \
+                                                                                              \
+	/* a + b */                                                                           \
+	static inline struct fmat##N fmat##N##_add(struct fmat##N a, struct fmat##N b)        \
+	{                                                                                     \
+		FMAT_FIXED_UNROLL for (int i = 0; i < N; i++)                                 \
+			FMAT_FIXED_UNROLL for (int j = 0; j < N; j++) a.m[i][j] += b.m[i][j]; \
+		return a;                                                                     \
+	}                                                                                     \
+                                                                                              \
+	/* a - b */                                                                           \
+	static inline struct fmat##N fmat##N##_sub(struct fmat##N a, struct fmat##N b)        \
+	{                                                                                     \
+		FMAT_FIXED_UNROLL for (int i = 0; i < N; i++)                                 \
+			FMAT_FIXED_UNROLL for (int j = 0; j < N; j++) a.m[i][j] -= b.m[i][j]; \
+		return a;                                                                     \
+	}                                                                                     \
+                                                                                              \
+	/* s * a */                                                                           \
+	static inline struct fmat##N fmat##N##_scale(struct fmat##N a, fval_t s)              \
+	{                                                                                     \
+		FMAT_FIXED_UNROLL for (int i = 0; i < N; i++)                                 \
+			FMAT_FIXED_UNROLL for (int j = 0; j < N; j++) a.m[i][j] *= s;         \
+		return a;                                                                     \
+	}                                                                                     \
+                                                                                              \
+	/* a * b */                                                                           \
+	static inline struct fmat##N fmat##N##_mul(struct fmat##N a, struct fmat##N b)        \
+	{                                                                                     \
+		struct fmat##N d;                                                             \
+                                                                                              \
+		FMAT_FIXED_UNROLL for (int i = 0; i < N; i++) {                               \
+			FMAT_FIXED_UNROLL for (int j = 0; j < N; j++) {                       \
+				fval_t sum = 0.0;                                             \
+                                                                                              \
+				FMAT_FIXED_UNROLL for (int k = 0; k < N; k++)                 \
+					sum += a.m[i][k] * b.m[k][j];                         \
+				d.m[i][j] = sum;                                              \
+			}                                                                     \
+		}                                                                             \
+		return d;                                                                     \
+	}                                                                                     \
+                                                                                              \
+	/* a^T */                                                                             \
+	static inline struct fmat##N fmat##N##_trans(struct fmat##N a)                        \
+	{                                                                                     \
+		struct fmat##N d;                                                             \
+                                                                                              \
+		FMAT_FIXED_UNROLL for (int i = 0; i < N; i++)                                 \
+			FMAT_FIXED_UNROLL for (int j = 0; j < N; j++) d.m[j][i] = a.m[i][j];  \
+		return d;                                                                     \
+	}                                                                                     \
+                                                                                              \
+	/* Check whether two matrices hold the same values */                                 \
+	static inline bool fmat##N##_equal(struct fmat##N a, struct fmat##N b)                \
+	{                                                                                     \
+		FMAT_FIXED_UNROLL for (int i = 0; i < N; i++)                                 \
+			FMAT_FIXED_UNROLL for (int j = 0; j < N; j++)                         \
+				if (a.m[i][j] != b.m[i][j])                                   \
+					return false;                                         \
+		return true;                                                                  \
+	}                                                                                     \
+                                                                                              \
+	/* Copy an N x N floating-point matrix in; false if it has another shape */           \
+	static inline bool fmat##N##_load(struct fmat##N *d, const struct fmatrix *src)       \
+	{                                                                                     \
+		if (!d || !src || src->rows != N || src->cols != N) {                         \
+			errno = EINVAL;                                                       \
+			perror(__func__);                                                     \
+			return false;                                                         \
+		}                                                                             \
+		const bool trans = src->flags & FMAT_TRANSPOSED;                              \
+                                                                                              \
+		for (int i = 0; i < N; i++)                                                   \
+			for (int j = 0; j < N; j++)                                           \
+				d->m[i][j] = trans ? src->data[j][i] : src->data[i][j];       \
+		return true;                                                                  \
+	}                                                                                     \
+                                                                                              \
+	/* Copy out into an N x N floating-point matrix; NULL if it has another shape */      \
+	static inline struct fmatrix *fmat##N##_store(struct fmatrix *dest, struct fmat##N a) \
+	{                                                                                     \
+		if (!dest || dest->rows != N || dest->cols != N) {                            \
+			errno = EINVAL;                                                       \
+			perror(__func__);                                                     \
+			return NULL;                                                          \
+		}                                                                             \
+		const bool trans = dest->flags & FMAT_TRANSPOSED;                             \
+                                                                                              \
+		for (int i = 0; i < N; i++)                                                   \
+			for (int j = 0; j < N; j++) {                                         \
+				if (trans)                                                    \
+					dest->data[j][i] = a.m[i][j];                         \
+				else                                                          \
+					dest->data[i][j] = a.m[i][j];                         \
+			}                                                                     \
+		return dest;                                                                  \
+	}
+
+/* Inverse of order N by Gauss-Jordan elimination with partial pivoting */
+#define FMAT_FIXED_DEFINE_INV(N)                                                              \
+	/* Inverse into d; false, leaving d untouched, on a zero pivot */                     \
+	static inline bool fmat##N##_inv(struct fmat##N *d, struct fmat##N a)                 \
+	{                                                                                     \
+		struct fmat##N x = fmat##N##_identity();                                      \
+                                                                                              \
+		FMAT_FIXED_UNROLL for (int k = 0; k < N; k++) {                               \
+			int p = k;                                                            \
+                                                                                              \
+			FMAT_FIXED_UNROLL for (int i = k + 1; i < N; i++)                     \
+				if (fabs(a.m[i][k]) > fabs(a.m[p][k]))                        \
+					p = i;                                                \
+			if (a.m[p][k] == 0.0)                                                 \
+				return false;                                                 \
+                                                                                              \
+			if (p != k) {                                                         \
+				FMAT_FIXED_UNROLL for (int j = 0; j < N; j++) {               \
+					const fval_t t = a.m[k][j], u = x.m[k][j];            \
+                                                                                              \
+					a.m[k][j] = a.m[p][j];                                \
+					a.m[p][j] = t;                                        \
+					x.m[k][j] = x.m[p][j];                                \
+					x.m[p][j] = u;                                        \
+				}                                                             \
+			}                                                                     \
+                                                                                              \
+			const fval_t r = 1.0 / a.m[k][k];                                     \
+                                                                                              \
+			FMAT_FIXED_UNROLL for (int j = 0; j < N; j++) {                       \
+				a.m[k][j] *= r;                                               \
+				x.m[k][j] *= r;                                               \
+			}                                                                     \
+                                                                                              \
+			/* Clear column k from every other row */                             \
+			FMAT_FIXED_UNROLL for (int i = 0; i < N; i++) {                       \
+				const fval_t f = i == k ? 0.0 : a.m[i][k];                    \
+                                                                                              \
+				FMAT_FIXED_UNROLL for (int j = 0; j < N; j++) {               \
+					a.m[i][j] -= f * a.m[k][j];                           \
+					x.m[i][j] -= f * x.m[k][j];                           \
+				}                                                             \
+			}                                                                     \
+		}                                                                             \
+		*d = x;                                                                       \
+		return true;                                                                  \
+	}
+
+/* The whole family of order N, for orders without closed forms */
+#define FMAT_FIXED_DEFINE(N) FMAT_FIXED_DEFINE_OPS(N) FMAT_FIXED_DEFINE_INV(N)
+
+FMAT_FIXED_DEFINE_OPS(2)
+FMAT_FIXED_DEFINE_OPS(3)
+FMAT_FIXED_DEFINE_OPS(4)
+
+/* Determinant of a 2 x 2 matrix */
+static inline fval_t fmat2_det(struct fmat2 a)
+{
+	return a.m[0][0] * a.m[1][1] - a.m[0][1] * a.m[1][0];
+}
+
+/* Inverse of a 2 x 2 matrix into d; false, leaving d untouched, if a is singular */
+static inline bool fmat2_inv(struct fmat2 *d, struct fmat2 a)
+{
+	const fval_t det = fmat2_det(a);
+
+	if (det == 0.0)
+		return false;
+
+	const fval_t r = 1.0 / det;
+
+	d->m[0][0] = a.m[1][1] * r;
+	d->m[0][1] = -a.m[0][1] * r;
+	d->m[1][0] = -a.m[1][0] * r;
+	d->m[1][1] = a.m[0][0] * r;
+
+	return true;
+}
+
+/* Cofactor (i, j) of a 3 x 3 matrix; cyclic indices give it its sign */
+#define FMAT3_COF(a, i, j)                                                          \
+	((a).m[((i) + 1) % 3][((j) + 1) % 3] * (a).m[((i) + 2) % 3][((j) + 2) % 3] - \
+	 (a).m[((i) + 1) % 3][((j) + 2) % 3] * (a).m[((i) + 2) % 3][((j) + 1) % 3])
+
+/* Determinant of a 3 x 3 matrix */
+static inline fval_t fmat3_det(struct fmat3 a)
+{
+	return a.m[0][0] * FMAT3_COF(a, 0, 0) + a.m[0][1] * FMAT3_COF(a, 0, 1) + a.m[0][2] * FMAT3_COF(a, 0, 2);
+}
+
+/* Inverse of a 3 x 3 matrix into d; false, leaving d untouched, if a is singular */
+static inline bool fmat3_inv(struct fmat3 *d, struct fmat3 a)
+{
+	const fval_t det = fmat3_det(a);
+
+	if (det == 0.0)
+		return false;
+
+	const fval_t r = 1.0 / det;
+
+	/* The transposed cofactor matrix over the determinant */
+	FMAT_FIXED_UNROLL for (int i = 0; i < 3; i++)
+		FMAT_FIXED_UNROLL for (int j = 0; j < 3; j++) d->m[j][i] = FMAT3_COF(a, i, j) * r;
+
+	return true;
+}
+
+/*
+ * 2 x 2 minors of rows 0 and 1 (s) and of rows 2 and 3 (c) of a 4 x 4 matrix,
+ * over the column pairs (0, 1), (0, 2), (0, 3), (1, 2), (1, 3) and (2, 3)
+ */
+static inline void fmat4_minors(const struct fmat4 *a, fval_t *s, fval_t *c)
+{
+	s[0] = a->m[0][0] * a->m[1][1] - a->m[1][0] * a->m[0][1];
+	s[1] = a->m[0][0] * a->m[1][2] - a->m[1][0] * a->m[0][2];
+	s[2] = a->m[0][0] * a->m[1][3] - a->m[1][0] * a->m[0][3];
+	s[3] = a->m[0][1] * a->m[1][2] - a->m[1][1] * a->m[0][2];
+	s[4] = a->m[0][1] * a->m[1][3] - a->m[1][1] * a->m[0][3];
+	s[5] = a->m[0][2] * a->m[1][3] - a->m[1][2] * a->m[0][3];
+
+	c[0] = a->m[2][0] * a->m[3][1] - a->m[3][0] * a->m[2][1];
+	c[1] = a->m[2][0] * a->m[3][2] - a->m[3][0] * a->m[2][2];
+	c[2] = a->m[2][0] * a->m[3][3] - a->m[3][0] * a->m[2][3];
+	c[3] = a->m[2][1] * a->m[3][2] - a->m[3][1] * a->m[2][2];
+	c[4] = a->m[2][1] * a->m[3][3] - a->m[3][1] * a->m[2][3];
+	c[5] = a->m[2][2] * a->m[3][3] - a->m[3][2] * a->m[2][3];
+}
+
+/* Determinant of a 4 x 4 matrix, by Laplace expansion along rows 0 and 1 */
+static inline fval_t fmat4_det(struct fmat4 a)
+{
+	fval_t s[6], c[6];
+
+	fmat4_minors(&a, s, c);
+
+	return s[0] * c[5] - s[1] * c[4] + s[2] * c[3] + s[3] * c[2] - s[4] * c[1] + s[5] * c[0];
+}
+
+/* Inverse of a 4 x 4 matrix into d; false, leaving d untouched, if a is singular */
+static inline bool fmat4_inv(struct fmat4 *d, struct fmat4 a)
+{
+	fval_t s[6], c[6];
+
+	fmat4_minors(&a, s, c);
+
+	const fval_t det = s[0] * c[5] - s[1] * c[4] + s[2] * c[3] + s[3] * c[2] - s[4] * c[1] + s[5] * c[0];
+
+	if (det == 0.0)
+		return false;
+
+	const fval_t r = 1.0 / det;
+
+	d->m[0][0] = (a.m[1][1] * c[5] - a.m[1][2] * c[4] + a.m[1][3] * c[3]) * r;
+	d->m[0][1] = (-a.m[0][1] * c[5] + a.m[0][2] * c[4] - a.m[0][3] * c[3]) * r;
+	d->m[0][2] = (a.m[3][1] * s[5] - a.m[3][2] * s[4] + a.m[3][3] * s[3]) * r;
+	d->m[0][3] = (-a.m[2][1] * s[5] + a.m[2][2] * s[4] - a.m[2][3] * s[3]) * r;
+
+	d->m[1][0] = (-a.m[1][0] * c[5] + a.m[1][2] * c[2] - a.m[1][3] * c[1]) * r;
+	d->m[1][1] = (a.m[0][0] * c[5] - a.m[0][2] * c[2] + a.m[0][3] * c[1]) * r;
+	d->m[1][2] = (-a.m[3][0] * s[5] + a.m[3][2] * s[2] - a.m[3][3] * s[1]) * r;
+	d->m[1][3] = (a.m[2][0] * s[5] - a.m[2][2] * s[2] + a.m[2][3] * s[1]) * r;
+
+	d->m[2][0] = (a.m[1][0] * c[4] - a.m[1][1] * c[2] + a.m[1][3] * c[0]) * r;
+	d->m[2][1] = (-a.m[0][0] * c[4] + a.m[0][1] * c[2] - a.m[0][3] * c[0]) * r;
+	d->m[2][2] = (a.m[3][0] * s[4] - a.m[3][1] * s[2] + a.m[3][3] * s[0]) * r;
+	d->m[2][3] = (-a.m[2][0] * s[4] + a.m[2][1] * s[2] - a.m[2][3] * s[0]) * r;
+
+	d->m[3][0] = (-a.m[1][0] * c[3] + a.m[1][1] * c[1] - a.m[1][2] * c[0]) * r;
+	d->m[3][1] = (a.m[0][0] * c[3] - a.m[0][1] * c[1] + a.m[0][2] * c[0]) * r;
+	d->m[3][2] = (-a.m[3][0] * s[3] + a.m[3][1] * s[1] - a.m[3][2] * s[0]) * r;
+	d->m[3][3] = (a.m[2][0] * s[3] - a.m[2][1] * s[1] + a.m[2][2] * s[0]) * r;
+
+	return true;
+}
+
+#endif /* FMATRIX_FIXED_H */
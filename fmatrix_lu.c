@@ -0,0 +1,436 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fgemm.h"
+#include "fkernels.h"
+#include "fmatrix_lu.h"
+#include "fmatrix_workspace.h"
+
+/*
+ * Panel width of the blocked factorization and triangular solves. Everything
+ * outside the panels is updated through the GEMM engine.
+ */
+#define FMAT_LU_NB 64
+
+static size_t min_size(size_t a, size_t b)
+{
+	return a < b ? a : b;
+}
+
+/*
+ * Factor the nb columns starting at k0, from row k0 down, with partial
+ * pivoting. Row swaps apply to the whole matrix, as they exchange row
+ * pointers, but only the panel itself is updated.
+ */
+static void fmat_lu_panel(struct fmat_lu *lu, size_t k0, size_t nb)
+{
+	const size_t n = lu->lu->rows;
+	fval_t **m = lu->lu->data;
+
+	for (size_t k = k0; k < k0 + nb; k++) {
+		/* Pivot search */
+		size_t p = k;
+
+		for (size_t i = k + 1; i < n; i++)
+			if (fabs(m[i][k]) > fabs(m[p][k]))
+				p = i;
+
+		/* Exchange row pointers only; the slab is put back in order at the end */
+		if (p != k) {
+			fval_t *row = m[k];
+
+			m[k] = m[p];
+			m[p] = row;
+
+			const size_t tmp = lu->perm[k];
+
+			lu->perm[k] = lu->perm[p];
+			lu->perm[p] = tmp;
+			lu->sign = -lu->sign;
+		}
+
+		const fval_t pivot = m[k][k];
+
+		if (fabs(pivot) < FMAT_LU_TINY) {
+			lu->singular = true;
+			continue;
+		}
+
+		/* Store the multipliers in place of the eliminated column */
+		for (size_t i = k + 1; i < n; i++) {
+			const fval_t l = m[i][k] / pivot;
+
+			m[i][k] = l;
+			fkernels->axpy(m[i] + k + 1, -l, m[k] + k + 1, k0 + nb - k - 1);
+		}
+	}
+}
+
+/*
+ * Move every row of m to its slot in the slab after pivoting has permuted
+ * the row pointers, following each cycle of the permutation with one row
+ * of scratch, so that data and buf agree again.
+ */
+static void fmat_lu_materialize(struct fmatrix *m, fval_t *tmp)
+{
+	const size_t bytes = m->cols * sizeof(fval_t);
+
+	for (size_t i = 0; i < m->rows; i++) {
+		fval_t *slot = m->buf + i * m->stride;
+
+		if (m->data[i] == slot)
+			continue;
+
+		/* Whichever row lives in slot i moves last, once its own slot is free */
+		memcpy(tmp, slot, bytes);
+
+		size_t j = i;
+
+		for (;;) {
+			const size_t src = (size_t)(m->data[j] - m->buf) / m->stride;
+
+			if (src == i)
+				break;
+
+			memcpy(m->buf + j * m->stride, m->data[j], bytes);
+			m->data[j] = m->buf + j * m->stride;
+			j = src;
+		}
+
+		memcpy(m->buf + j * m->stride, tmp, bytes);
+		m->data[j] = m->buf + j * m->stride;
+	}
+}
+
+/* Factor lu->lu, which holds a copy of the matrix, in place; tmp holds one row */
+static void fmat_lu_factor(struct fmat_lu *lu, fval_t *tmp)
+{
+	const size_t n = lu->lu->rows;
+	fval_t **m = lu->lu->data;
+
+	lu->sign = 1;
+	lu->singular = false;
+
+	for (size_t i = 0; i < n; i++)
+		lu->perm[i] = i;
+
+	/* Right-looking: factor a panel, then update everything right of and below it */
+	for (size_t k0 = 0; k0 < n; k0 += FMAT_LU_NB) {
+		const size_t nb = min_size(FMAT_LU_NB, n - k0);
+		const size_t k1 = k0 + nb;
+
+		fmat_lu_panel(lu, k0, nb);
+
+		if (k1 == n)
+			break;
+
+		/* U12 = L11^-1 * A12 */
+		for (size_t i = k0 + 1; i < k1; i++)
+			for (size_t j = k0; j < i; j++)
+				fkernels->axpy(m[i] + k1, -m[i][j], m[j] + k1, n - k1);
+
+		/* A22 -= L21 * U12 */
+		const struct fgemm_operand l21 = { m, k1, k0, false };
+		const struct fgemm_operand u12 = { m, k0, k1, false };
+		const struct fgemm_operand a22 = { m, k1, k1, false };
+
+		fgemm_general(n - k1, n - k1, nb, -1.0, l21, u12, 1.0, a22);
+	}
+
+	fmat_lu_materialize(lu->lu, tmp);
+}
+
+struct fmat_lu *fmat_lu_new(const struct fmatrix *a)
+{
+	if (!a || a->rows != a->cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	const size_t n = a->rows;
+
+	struct fmat_lu *lu = malloc(sizeof(struct fmat_lu));
+	if (!lu) {
+		perror(__func__);
+		return NULL;
+	}
+
+	lu->perm = malloc(n * sizeof(size_t));
+	if (!lu->perm) {
+		perror(__func__);
+		goto error_perm;
+	}
+
+	lu->lu = fmat_copy(NULL, a);
+	if (!lu->lu)
+		goto error_lu;
+
+	fval_t *tmp = malloc(n * sizeof(fval_t));
+	if (!tmp) {
+		perror(__func__);
+		goto error_tmp;
+	}
+
+	fmat_lu_factor(lu, tmp);
+	free(tmp);
+
+	return lu;
+
+error_tmp:
+	fmat_free(lu->lu);
+error_lu:
+	free(lu->perm);
+error_perm:
+	free(lu);
+	return NULL;
+}
+
+/* Round a size up to the granularity of workspace allocations */
+static size_t fmat_lu_round(size_t bytes)
+{
+	return (bytes + FMATRIX_ALIGN - 1) / FMATRIX_ALIGN * FMATRIX_ALIGN;
+}
+
+size_t fmat_lu_workspace_size(size_t n)
+{
+	return fmat_lu_round(sizeof(struct fmat_lu)) + fmat_lu_round(n * sizeof(size_t)) +
+	       fmat_lu_round(n * sizeof(fval_t)) + fmat_workspace_matrix_size(n, n);
+}
+
+struct fmat_lu *fmat_lu_new_ws(const struct fmatrix *a, struct fmat_workspace *ws)
+{
+	if (!a || a->rows != a->cols || !ws) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	const size_t n = a->rows;
+	const size_t mark = fmat_workspace_mark(ws);
+
+	struct fmat_lu *lu = fmat_workspace_alloc(ws, sizeof(struct fmat_lu));
+	if (!lu)
+		goto error;
+
+	lu->perm = fmat_workspace_alloc(ws, n * sizeof(size_t));
+	if (!lu->perm)
+		goto error;
+
+	lu->lu = fmat_workspace_matrix(ws, n, n);
+	if (!lu->lu)
+		goto error;
+
+	/* The row of scratch is only needed while factoring */
+	const size_t tmp_mark = fmat_workspace_mark(ws);
+	fval_t *tmp = fmat_workspace_alloc(ws, n * sizeof(fval_t));
+	if (!tmp)
+		goto error;
+
+	fmat_copy(lu->lu, a);
+	fmat_lu_factor(lu, tmp);
+	fmat_workspace_release(ws, tmp_mark);
+
+	return lu;
+
+error:
+	fmat_workspace_release(ws, mark);
+	return NULL;
+}
+
+void fmat_lu_free(struct fmat_lu *lu)
+{
+	if (!lu)
+		return;
+
+	fmat_free(lu->lu);
+	free(lu->perm);
+	free(lu);
+}
+
+fval_t *fmat_lu_solve(fval_t *x, const struct fmat_lu *lu, const fval_t *b)
+{
+	if (!lu || !b || x == b) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	if (lu->singular) {
+		fprintf(stderr, "%s: matrix is singular\n", __func__);
+		return NULL;
+	}
+
+	const size_t n = lu->lu->rows;
+	fval_t *const *m = lu->lu->data;
+
+	if (!x) {
+		x = malloc(n * sizeof(fval_t));
+		if (!x) {
+			perror(__func__);
+			return NULL;
+		}
+	}
+
+	/* Forward substitution with the unit lower triangle, applying P on the way */
+	for (size_t i = 0; i < n; i++) {
+		fval_t sum = b[lu->perm[i]];
+
+		for (size_t j = 0; j < i; j++)
+			sum -= m[i][j] * x[j];
+
+		x[i] = sum;
+	}
+
+	/* Back substitution with the upper triangle */
+	for (size_t i = n; i-- > 0;) {
+		fval_t sum = x[i];
+
+		for (size_t j = i + 1; j < n; j++)
+			sum -= m[i][j] * x[j];
+
+		x[i] = sum / m[i][i];
+	}
+
+	return x;
+}
+
+/*
+ * Overwrite the rows of x, already permuted by P, with the solution of
+ * L * U * x = x. Both triangular solves go a block of rows at a time: the
+ * contribution of all previously solved rows is subtracted with one GEMM,
+ * leaving only a small triangle to solve row by row.
+ */
+static void fmat_lu_substitute(const struct fmat_lu *lu, struct fmatrix *x)
+{
+	const size_t n = lu->lu->rows;
+	fval_t *const *m = lu->lu->data;
+	const size_t nblocks = (n + FMAT_LU_NB - 1) / FMAT_LU_NB;
+
+	for (size_t blk = 0; blk < nblocks; blk++) {
+		const size_t i0 = blk * FMAT_LU_NB;
+		const size_t i1 = min_size(i0 + FMAT_LU_NB, n);
+		const struct fgemm_operand l = { m, i0, 0, false };
+		const struct fgemm_operand solved = { x->data, 0, 0, false };
+		const struct fgemm_operand xi = { x->data, i0, 0, false };
+
+		fgemm_general(i1 - i0, x->cols, i0, -1.0, l, solved, 1.0, xi);
+
+		for (size_t i = i0 + 1; i < i1; i++)
+			for (size_t j = i0; j < i; j++)
+				fkernels->axpy(x->data[i], -m[i][j], x->data[j], x->cols);
+	}
+
+	for (size_t blk = nblocks; blk-- > 0;) {
+		const size_t i0 = blk * FMAT_LU_NB;
+		const size_t i1 = min_size(i0 + FMAT_LU_NB, n);
+		const struct fgemm_operand u = { m, i0, i1, false };
+		const struct fgemm_operand solved = { x->data, i1, 0, false };
+		const struct fgemm_operand xi = { x->data, i0, 0, false };
+
+		fgemm_general(i1 - i0, x->cols, n - i1, -1.0, u, solved, 1.0, xi);
+
+		for (size_t i = i1; i-- > i0;) {
+			for (size_t j = i + 1; j < i1; j++)
+				fkernels->axpy(x->data[i], -m[i][j], x->data[j], x->cols);
+
+			const fval_t scale = 1.0 / m[i][i];
+
+			for (size_t c = 0; c < x->cols; c++)
+				x->data[i][c] *= scale;
+		}
+	}
+}
+
+struct fmatrix *fmat_lu_solve_many(struct fmatrix *dest,
+				   const struct fmat_lu *lu,
+				   const struct fmatrix *b)
+{
+	if (!lu || !b || b->rows != lu->lu->rows || dest == b || b->flags & FMAT_TRANSPOSED) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	if (lu->singular) {
+		fprintf(stderr, "%s: matrix is singular\n", __func__);
+		return NULL;
+	}
+
+	if (dest) {
+		if (dest->rows != b->rows || dest->cols != b->cols || dest->flags & FMAT_TRANSPOSED) {
+			errno = EINVAL;
+			perror(__func__);
+			return NULL;
+		}
+	} else {
+		dest = fmat_alloc(b->rows, b->cols);
+		if (!dest)
+			return NULL;
+	}
+
+	for (size_t i = 0; i < dest->rows; i++)
+		memcpy(dest->data[i], b->data[lu->perm[i]], b->cols * sizeof(fval_t));
+
+	fmat_lu_substitute(lu, dest);
+
+	return dest;
+}
+
+fval_t fmat_lu_det(const struct fmat_lu *lu)
+{
+	if (!lu) {
+		errno = EINVAL;
+		perror(__func__);
+		return 0.0;
+	}
+
+	if (lu->singular)
+		return 0.0;
+
+	fval_t det = lu->sign;
+
+	for (size_t i = 0; i < lu->lu->rows; i++)
+		det *= lu->lu->data[i][i];
+
+	return det;
+}
+
+struct fmatrix *fmat_lu_inv(struct fmatrix *dest, const struct fmat_lu *lu)
+{
+	if (!lu) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	if (lu->singular) {
+		fprintf(stderr, "%s: matrix is singular\n", __func__);
+		return NULL;
+	}
+
+	const size_t n = lu->lu->rows;
+
+	if (dest) {
+		if (dest->rows != n || dest->cols != n || dest->flags & FMAT_TRANSPOSED) {
+			errno = EINVAL;
+			perror(__func__);
+			return NULL;
+		}
+	} else {
+		dest = fmat_alloc(n, n);
+		if (!dest)
+			return NULL;
+	}
+
+	/* Solve against P * I */
+	fmat_reset(dest);
+	for (size_t i = 0; i < n; i++)
+		dest->data[i][lu->perm[i]] = 1.0;
+
+	fmat_lu_substitute(lu, dest);
+
+	return dest;
+}
@@ -0,0 +1,52 @@
+#ifndef FMATRIX_LU_H
+#define FMATRIX_LU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "fmatrix.h"
+#include "fmatrix_workspace.h"
+
+/* Pivots smaller than this in magnitude are treated as zero, by every LU factorization */
+#define FMAT_LU_TINY 1e-12
+
+/*
+ * LU factorization with partial pivoting, P * A = L * U. Factor once, then
+ * solve against the same matrix as often as needed at O(n^2) per solve.
+ */
+struct fmat_lu {
+	/* L below the diagonal (its unit diagonal is implied), U on and above it */
+	struct fmatrix *lu;
+	/* Row i of lu comes from row perm[i] of the factored matrix */
+	size_t *perm;
+	/* Sign of the permutation, +1 or -1 */
+	int sign;
+	/* Set when a pivot vanished; det is then 0 and solving fails */
+	bool singular;
+};
+
+/* Factor a square floating-point matrix */
+struct fmat_lu *fmat_lu_new(const struct fmatrix *a);
+/* Delete an LU factorization */
+void fmat_lu_free(struct fmat_lu *lu);
+
+/*
+ * Factor a square floating-point matrix into space carved from ws. The result
+ * lives until ws is released past it and must not be passed to fmat_lu_free.
+ */
+struct fmat_lu *fmat_lu_new_ws(const struct fmatrix *a, struct fmat_workspace *ws);
+/* Bytes of workspace fmat_lu_new_ws and fmat_inv_ws need for an n x n matrix */
+size_t fmat_lu_workspace_size(size_t n);
+
+/* Solve a * x = b for one right-hand side of n elements; x and b must not overlap */
+fval_t *fmat_lu_solve(fval_t *x, const struct fmat_lu *lu, const fval_t *b);
+/* Solve a * X = B for every column of B; dest must not be b, neither may be a transposed view */
+struct fmatrix *fmat_lu_solve_many(struct fmatrix *dest,
+				   const struct fmat_lu *lu,
+				   const struct fmatrix *b);
+/* Compute the determinant of the factored matrix */
+fval_t fmat_lu_det(const struct fmat_lu *lu);
+/* Compute the inverse of the factored matrix; dest may not be a transposed view */
+struct fmatrix *fmat_lu_inv(struct fmatrix *dest, const struct fmat_lu *lu);
+
+#endif /* FMATRIX_LU_H */
@@ -0,0 +1,843 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fgemm.h"
+#include "fkernels.h"
+#include "fmatrix_lu.h"
+#include "fmatrix_tiled.h"
+#include "layout.h"
+
+#define FMAT_TILED_MAGIC "MATTILE\n"
+#define FMAT_TILED_BYTE_ORDER 0x01020304u
+
+/* Index of an empty cache slot */
+#define FMAT_TILE_NONE SIZE_MAX
+
+/* Header at the start of the file; the tiles follow it in row-major tile order */
+struct fmat_tiled_header {
+	char magic[8];
+	uint32_t byte_order;
+	uint32_t reserved0;
+	uint64_t rows, cols, tile;
+	uint64_t reserved[3];
+};
+
+/* A cached tile; slots holding a tile are kept on the LRU list */
+struct fmat_tile_slot {
+	struct fmatrix *tile;
+	/* Tile index ti * tile_cols + tj, or FMAT_TILE_NONE */
+	size_t index;
+	unsigned pins;
+	bool dirty;
+	struct fmat_tile_slot *prev, *next;
+};
+
+struct fmat_tile_cache {
+	size_t capacity, used;
+	struct fmat_tile_slot *slots;
+	/* Slot caching each tile of the matrix, NULL if it is not cached */
+	struct fmat_tile_slot **resident;
+	/* LRU list, most recently used first */
+	struct fmat_tile_slot *head, *tail;
+};
+
+static size_t min_size(size_t a, size_t b)
+{
+	return a < b ? a : b;
+}
+
+/* Rows or columns of the matrix in tile t, out of n in all */
+static size_t fmat_tiled_extent(size_t n, size_t tile, size_t t)
+{
+	return min_size(tile, n - t * tile);
+}
+
+/* Step of a pass over n tiles, running backwards on odd passes */
+static size_t fmat_tiled_snake(size_t n, size_t step, size_t pass)
+{
+	return pass & 1 ? n - 1 - step : step;
+}
+
+static size_t fmat_tiled_bytes(const struct fmat_tiled *m)
+{
+	return m->tile * m->tile * sizeof(fval_t);
+}
+
+static off_t fmat_tiled_offset(const struct fmat_tiled *m, size_t index)
+{
+	return (off_t)(sizeof(struct fmat_tiled_header) + index * fmat_tiled_bytes(m));
+}
+
+/* Read or write len bytes at off of fd in full */
+static bool fmat_tiled_io(int fd, void *buf, size_t len, off_t off, bool write)
+{
+	unsigned char *p = buf;
+
+	while (len) {
+		const ssize_t n = write ? pwrite(fd, p, len, off) : pread(fd, p, len, off);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			if (!n)
+				errno = EIO;
+			return false;
+		}
+
+		p += n;
+		off += n;
+		len -= (size_t)n;
+	}
+
+	return true;
+}
+
+static void fmat_tile_unlink(struct fmat_tile_cache *c, struct fmat_tile_slot *s)
+{
+	if (s->prev)
+		s->prev->next = s->next;
+	else
+		c->head = s->next;
+
+	if (s->next)
+		s->next->prev = s->prev;
+	else
+		c->tail = s->prev;
+
+	s->prev = s->next = NULL;
+}
+
+static void fmat_tile_push_front(struct fmat_tile_cache *c, struct fmat_tile_slot *s)
+{
+	s->prev = NULL;
+	s->next = c->head;
+	if (c->head)
+		c->head->prev = s;
+	else
+		c->tail = s;
+	c->head = s;
+}
+
+static void fmat_tile_push_back(struct fmat_tile_cache *c, struct fmat_tile_slot *s)
+{
+	s->next = NULL;
+	s->prev = c->tail;
+	if (c->tail)
+		c->tail->next = s;
+	else
+		c->head = s;
+	c->tail = s;
+}
+
+/* Write a modified tile back to the file */
+static bool fmat_tile_write_back(struct fmat_tiled *m, struct fmat_tile_slot *s)
+{
+	if (!s->dirty)
+		return true;
+
+	if (!fmat_tiled_io(m->fd, s->tile->buf, fmat_tiled_bytes(m), fmat_tiled_offset(m, s->index), true))
+		return false;
+
+	s->dirty = false;
+	m->writes++;
+
+	return true;
+}
+
+/*
+ * Slot for a tile about to be cached, off the LRU list: a new one while the
+ * cache has room, else the least recently used unpinned one, written back
+ */
+static struct fmat_tile_slot *fmat_tile_slot_get(struct fmat_tiled *m)
+{
+	struct fmat_tile_cache *c = m->cache;
+	struct fmat_tile_slot *s;
+
+	if (c->used < c->capacity) {
+		s = &c->slots[c->used];
+		s->tile = fmat_alloc(m->tile, m->tile);
+		if (!s->tile)
+			return NULL;
+
+		s->index = FMAT_TILE_NONE;
+		c->used++;
+		return s;
+	}
+
+	for (s = c->tail; s && s->pins; s = s->prev)
+		;
+
+	if (!s) {
+		errno = EBUSY;
+		return NULL;
+	}
+
+	if (s->index != FMAT_TILE_NONE) {
+		if (!fmat_tile_write_back(m, s))
+			return NULL;
+		c->resident[s->index] = NULL;
+	}
+
+	fmat_tile_unlink(c, s);
+	s->index = FMAT_TILE_NONE;
+
+	return s;
+}
+
+/* Set up the in-memory side of a matrix stored in fd; the matrix takes fd over */
+static struct fmat_tiled *fmat_tiled_setup(int fd, size_t rows, size_t cols, size_t tile, size_t cache_bytes)
+{
+	const size_t tile_rows = (rows + tile - 1) / tile;
+	const size_t tile_cols = (cols + tile - 1) / tile;
+	const size_t tiles = tile_rows * tile_cols;
+	size_t capacity = cache_bytes / (tile * tile * sizeof(fval_t));
+
+	if (capacity < FMAT_TILED_MIN_CACHE)
+		capacity = FMAT_TILED_MIN_CACHE;
+	capacity = min_size(capacity, tiles);
+
+	struct fmat_tiled *m = malloc(sizeof(*m));
+	struct fmat_tile_cache *c = malloc(sizeof(*c));
+	struct fmat_tile_slot *slots = calloc(capacity, sizeof(*slots));
+	struct fmat_tile_slot **resident = calloc(tiles, sizeof(*resident));
+
+	if (!m || !c || !slots || !resident) {
+		free(m);
+		free(c);
+		free(slots);
+		free(resident);
+		close(fd);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	*c = (struct fmat_tile_cache){ .capacity = capacity, .slots = slots, .resident = resident };
+
+	/* Copy over a temporary matrix that holds the const dimensions */
+	struct fmat_tiled m_temp = {
+		.rows = rows,
+		.cols = cols,
+		.tile = tile,
+		.tile_rows = tile_rows,
+		.tile_cols = tile_cols,
+		.fd = fd,
+		.cache = c,
+	};
+	memcpy(m, &m_temp, sizeof(struct fmat_tiled));
+
+	return m;
+}
+
+/* Unlinked temporary file in TMPDIR */
+static int fmat_tiled_tmpfile(void)
+{
+	const char *dir = getenv("TMPDIR");
+	if (!dir || !*dir)
+		dir = "/tmp";
+
+	const size_t len = strlen(dir) + sizeof("/fmat_tiled_XXXXXX");
+	char *path = malloc(len);
+	if (!path)
+		return -1;
+
+	snprintf(path, len, "%s/fmat_tiled_XXXXXX", dir);
+
+	const int fd = mkstemp(path);
+	if (fd >= 0)
+		unlink(path);
+
+	free(path);
+
+	return fd;
+}
+
+struct fmat_tiled *fmat_tiled_create(const char *path, size_t rows, size_t cols, size_t tile, size_t cache_bytes)
+{
+	if (!rows || !cols || !tile) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	/* A tile row as long as its stride, so a cached tile is one run the file reads straight into */
+	tile = tile <= SIZE_MAX / 4 ? fmat_stride(tile) : 0;
+
+	const uint64_t limit = INT64_MAX - sizeof(struct fmat_tiled_header);
+	const uint64_t tile_rows = (rows + tile - 1) / tile;
+	const uint64_t tile_cols = (cols + tile - 1) / tile;
+
+	if (!tile || tile > limit / sizeof(fval_t) / tile || tile_rows > limit / tile_cols ||
+	    tile_rows * tile_cols > limit / sizeof(fval_t) / tile / tile) {
+		errno = ENOMEM;
+		perror(__func__);
+		return NULL;
+	}
+
+	const int fd = path ? open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666) : fmat_tiled_tmpfile();
+	if (fd < 0) {
+		perror(__func__);
+		return NULL;
+	}
+
+	struct fmat_tiled_header hdr = {
+		.byte_order = FMAT_TILED_BYTE_ORDER,
+		.rows = rows,
+		.cols = cols,
+		.tile = tile,
+	};
+	memcpy(hdr.magic, FMAT_TILED_MAGIC, sizeof(hdr.magic));
+
+	/* The tiles start out as a hole in the file, which reads back as zeros */
+	const off_t size = (off_t)(sizeof(hdr) + tile_rows * tile_cols * tile * tile * sizeof(fval_t));
+
+	if (!fmat_tiled_io(fd, &hdr, sizeof(hdr), 0, true) || ftruncate(fd, size)) {
+		perror(__func__);
+		close(fd);
+		return NULL;
+	}
+
+	struct fmat_tiled *m = fmat_tiled_setup(fd, rows, cols, tile, cache_bytes);
+	if (!m)
+		perror(__func__);
+
+	return m;
+}
+
+struct fmat_tiled *fmat_tiled_open(const char *path, size_t cache_bytes)
+{
+	if (!path) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	const int fd = open(path, O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		perror(__func__);
+		return NULL;
+	}
+
+	struct fmat_tiled_header hdr;
+	struct stat st;
+
+	if (!fmat_tiled_io(fd, &hdr, sizeof(hdr), 0, false) || fstat(fd, &st)) {
+		perror(__func__);
+		close(fd);
+		return NULL;
+	}
+
+	const bool valid = !memcmp(hdr.magic, FMAT_TILED_MAGIC, sizeof(hdr.magic)) &&
+			   hdr.byte_order == FMAT_TILED_BYTE_ORDER && hdr.rows && hdr.cols && hdr.tile &&
+			   hdr.tile <= SIZE_MAX / 4 && fmat_stride(hdr.tile) == hdr.tile && hdr.rows <= SIZE_MAX && hdr.cols <= SIZE_MAX &&
+			   hdr.tile <= (uint64_t)st.st_size / sizeof(fval_t) / hdr.tile;
+
+	const uint64_t tile_rows = valid ? (hdr.rows + hdr.tile - 1) / hdr.tile : 0;
+	const uint64_t tile_cols = valid ? (hdr.cols + hdr.tile - 1) / hdr.tile : 0;
+	const uint64_t tile_bytes = hdr.tile * hdr.tile * sizeof(fval_t);
+
+	/* The file must hold every tile */
+	if (!valid || tile_rows > (uint64_t)st.st_size / tile_bytes / tile_cols ||
+	    sizeof(hdr) + tile_rows * tile_cols * tile_bytes > (uint64_t)st.st_size) {
+		errno = EINVAL;
+		perror(__func__);
+		close(fd);
+		return NULL;
+	}
+
+	struct fmat_tiled *m = fmat_tiled_setup(fd, hdr.rows, hdr.cols, hdr.tile, cache_bytes);
+	if (!m)
+		perror(__func__);
+
+	return m;
+}
+
+bool fmat_tiled_flush(struct fmat_tiled *m)
+{
+	if (!m) {
+		errno = EINVAL;
+		perror(__func__);
+		return false;
+	}
+
+	for (struct fmat_tile_slot *s = m->cache->head; s; s = s->next) {
+		if (s->index != FMAT_TILE_NONE && !fmat_tile_write_back(m, s)) {
+			perror(__func__);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool fmat_tiled_free(struct fmat_tiled *m)
+{
+	if (!m)
+		return true;
+
+	bool ok = fmat_tiled_flush(m);
+	struct fmat_tile_cache *c = m->cache;
+
+	for (size_t i = 0; i < c->used; i++)
+		fmat_free(c->slots[i].tile);
+
+	if (close(m->fd)) {
+		perror(__func__);
+		ok = false;
+	}
+
+	free(c->slots);
+	free(c->resident);
+	free(c);
+	free(m);
+
+	return ok;
+}
+
+struct fmatrix *fmat_tiled_pin(struct fmat_tiled *m, size_t ti, size_t tj, unsigned mode)
+{
+	if (!m || ti >= m->tile_rows || tj >= m->tile_cols || mode > FMAT_TILE_OVERWRITE) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct fmat_tile_cache *c = m->cache;
+	const size_t index = ti * m->tile_cols + tj;
+	struct fmat_tile_slot *s = c->resident[index];
+
+	if (s) {
+		fmat_tile_unlink(c, s);
+		fmat_tile_push_front(c, s);
+		s->pins++;
+		s->dirty |= mode != FMAT_TILE_READ;
+		return s->tile;
+	}
+
+	s = fmat_tile_slot_get(m);
+	if (!s) {
+		perror(__func__);
+		return NULL;
+	}
+
+	if (mode == FMAT_TILE_OVERWRITE) {
+		memset(s->tile->buf, 0, fmat_tiled_bytes(m));
+	} else if (fmat_tiled_io(m->fd, s->tile->buf, fmat_tiled_bytes(m), fmat_tiled_offset(m, index), false)) {
+		m->reads++;
+	} else {
+		/* The empty slot goes last, to be taken first */
+		perror(__func__);
+		fmat_tile_push_back(c, s);
+		return NULL;
+	}
+
+	s->index = index;
+	s->pins = 1;
+	s->dirty = mode != FMAT_TILE_READ;
+	c->resident[index] = s;
+	fmat_tile_push_front(c, s);
+
+	return s->tile;
+}
+
+void fmat_tiled_unpin(struct fmat_tiled *m, size_t ti, size_t tj)
+{
+	struct fmat_tile_slot *s = m && ti < m->tile_rows && tj < m->tile_cols ?
+					   m->cache->resident[ti * m->tile_cols + tj] :
+					   NULL;
+
+	if (!s || !s->pins) {
+		errno = EINVAL;
+		perror(__func__);
+		return;
+	}
+
+	s->pins--;
+}
+
+void fmat_tiled_set(struct fmat_tiled *m, size_t row, size_t col, fval_t val)
+{
+	if (!m || row >= m->rows || col >= m->cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return;
+	}
+
+	struct fmatrix *t = fmat_tiled_pin(m, row / m->tile, col / m->tile, FMAT_TILE_WRITE);
+	if (!t)
+		return;
+
+	t->data[row % m->tile][col % m->tile] = val;
+	fmat_tiled_unpin(m, row / m->tile, col / m->tile);
+}
+
+fval_t fmat_tiled_get(struct fmat_tiled *m, size_t row, size_t col)
+{
+	if (!m || row >= m->rows || col >= m->cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return 0;
+	}
+
+	struct fmatrix *t = fmat_tiled_pin(m, row / m->tile, col / m->tile, FMAT_TILE_READ);
+	if (!t)
+		return 0;
+
+	const fval_t val = t->data[row % m->tile][col % m->tile];
+
+	fmat_tiled_unpin(m, row / m->tile, col / m->tile);
+
+	return val;
+}
+
+struct fmat_tiled *fmat_tiled_load(struct fmat_tiled *dest, const struct fmatrix *src)
+{
+	if (!dest || !src || dest->rows != src->rows || dest->cols != src->cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	const bool trans = src->flags & FMAT_TRANSPOSED;
+
+	for (size_t ti = 0; ti < dest->tile_rows; ti++) {
+		for (size_t tj = 0; tj < dest->tile_cols; tj++) {
+			struct fmatrix *t = fmat_tiled_pin(dest, ti, tj, FMAT_TILE_OVERWRITE);
+			if (!t)
+				return NULL;
+
+			const size_t r0 = ti * dest->tile, c0 = tj * dest->tile;
+			const size_t rows = fmat_tiled_extent(dest->rows, dest->tile, ti);
+			const size_t cols = fmat_tiled_extent(dest->cols, dest->tile, tj);
+
+			for (size_t r = 0; r < rows; r++) {
+				if (!trans) {
+					memcpy(t->data[r], src->data[r0 + r] + c0, cols * sizeof(fval_t));
+					continue;
+				}
+				for (size_t c = 0; c < cols; c++)
+					t->data[r][c] = src->data[c0 + c][r0 + r];
+			}
+
+			fmat_tiled_unpin(dest, ti, tj);
+		}
+	}
+
+	return dest;
+}
+
+struct fmatrix *fmat_tiled_store(struct fmatrix *dest, struct fmat_tiled *m)
+{
+	if (!m || (dest && (dest->rows != m->rows || dest->cols != m->cols || (dest->flags & FMAT_TRANSPOSED)))) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct fmatrix *out = dest ? dest : fmat_alloc(m->rows, m->cols);
+	if (!out)
+		return NULL;
+
+	for (size_t ti = 0; ti < m->tile_rows; ti++) {
+		for (size_t tj = 0; tj < m->tile_cols; tj++) {
+			struct fmatrix *t = fmat_tiled_pin(m, ti, tj, FMAT_TILE_READ);
+			if (!t) {
+				if (!dest)
+					fmat_free(out);
+				return NULL;
+			}
+
+			const size_t rows = fmat_tiled_extent(m->rows, m->tile, ti);
+			const size_t cols = fmat_tiled_extent(m->cols, m->tile, tj);
+
+			for (size_t r = 0; r < rows; r++)
+				memcpy(out->data[ti * m->tile + r] + tj * m->tile, t->data[r], cols * sizeof(fval_t));
+
+			fmat_tiled_unpin(m, ti, tj);
+		}
+	}
+
+	return out;
+}
+
+/*
+ * Destination of an operation on a: dest if it is rows x cols with the tiles
+ * of a, or a new matrix in a temporary file if dest is NULL
+ */
+static struct fmat_tiled *fmat_tiled_dest(struct fmat_tiled *dest, size_t rows, size_t cols, const struct fmat_tiled *a)
+{
+	if (dest) {
+		if (dest->rows != rows || dest->cols != cols || dest->tile != a->tile) {
+			errno = EINVAL;
+			return NULL;
+		}
+		return dest;
+	}
+
+	return fmat_tiled_create(NULL, rows, cols, a->tile, a->cache->capacity * fmat_tiled_bytes(a));
+}
+
+struct fmat_tiled *fmat_tiled_add(struct fmat_tiled *dest, struct fmat_tiled *a, struct fmat_tiled *b)
+{
+	if (!a || !b || a->rows != b->rows || a->cols != b->cols || a->tile != b->tile) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct fmat_tiled *out = fmat_tiled_dest(dest, a->rows, a->cols, a);
+	if (!out) {
+		perror(__func__);
+		return NULL;
+	}
+
+	const size_t elems = a->tile * a->tile;
+
+	/* Sources are pinned before dest, so a dest that is also a source is not cleared */
+	for (size_t ti = 0; ti < a->tile_rows; ti++) {
+		for (size_t tj = 0; tj < a->tile_cols; tj++) {
+			struct fmatrix *ta = fmat_tiled_pin(a, ti, tj, FMAT_TILE_READ);
+			struct fmatrix *tb = ta ? fmat_tiled_pin(b, ti, tj, FMAT_TILE_READ) : NULL;
+			struct fmatrix *td = tb ? fmat_tiled_pin(out, ti, tj, FMAT_TILE_OVERWRITE) : NULL;
+
+			if (td)
+				fkernels->add(td->buf, ta->buf, tb->buf, elems);
+
+			if (ta)
+				fmat_tiled_unpin(a, ti, tj);
+			if (tb)
+				fmat_tiled_unpin(b, ti, tj);
+			if (!td)
+				goto error;
+			fmat_tiled_unpin(out, ti, tj);
+		}
+	}
+
+	return out;
+
+error:
+	if (!dest)
+		fmat_tiled_free(out);
+	return NULL;
+}
+
+struct fmat_tiled *fmat_tiled_mul(struct fmat_tiled *dest, struct fmat_tiled *a, struct fmat_tiled *b)
+{
+	if (!a || !b || a->cols != b->rows || a->tile != b->tile || (dest && (dest == a || dest == b))) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct fmat_tiled *out = fmat_tiled_dest(dest, a->rows, b->cols, a);
+	if (!out) {
+		perror(__func__);
+		return NULL;
+	}
+
+	/*
+	 * Each tile of out is summed in the cache and written once. Successive
+	 * tiles along a tile row sweep k in opposite directions, and successive
+	 * tile rows sweep the tile columns in opposite directions, so each sweep
+	 * starts on the tiles of a and b the last one ended on.
+	 */
+	size_t pass = 0;
+
+	for (size_t ti = 0; ti < out->tile_rows; ti++) {
+		for (size_t jj = 0; jj < out->tile_cols; jj++, pass++) {
+			const size_t tj = fmat_tiled_snake(out->tile_cols, jj, ti);
+			struct fmatrix *tc = fmat_tiled_pin(out, ti, tj, FMAT_TILE_OVERWRITE);
+			if (!tc)
+				goto error;
+
+			for (size_t kk = 0; kk < a->tile_cols; kk++) {
+				const size_t tk = fmat_tiled_snake(a->tile_cols, kk, pass);
+				struct fmatrix *ta = fmat_tiled_pin(a, ti, tk, FMAT_TILE_READ);
+				struct fmatrix *tb = ta ? fmat_tiled_pin(b, tk, tj, FMAT_TILE_READ) : NULL;
+
+				if (tb)
+					fgemm(1, ta, tb, kk ? 1 : 0, tc);
+
+				if (ta)
+					fmat_tiled_unpin(a, ti, tk);
+				if (tb)
+					fmat_tiled_unpin(b, tk, tj);
+				if (!tb) {
+					fmat_tiled_unpin(out, ti, tj);
+					goto error;
+				}
+			}
+
+			fmat_tiled_unpin(out, ti, tj);
+		}
+	}
+
+	return out;
+
+error:
+	if (!dest)
+		fmat_tiled_free(out);
+	return NULL;
+}
+
+struct fmat_tiled *fmat_tiled_trans(struct fmat_tiled *dest, struct fmat_tiled *a)
+{
+	if (!a || (dest && dest == a)) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct fmat_tiled *out = fmat_tiled_dest(dest, a->cols, a->rows, a);
+	if (!out) {
+		perror(__func__);
+		return NULL;
+	}
+
+	/* Tile (ti, tj) of out is the transpose of tile (tj, ti) of a */
+	for (size_t ti = 0; ti < out->tile_rows; ti++) {
+		for (size_t tj = 0; tj < out->tile_cols; tj++) {
+			struct fmatrix *ta = fmat_tiled_pin(a, tj, ti, FMAT_TILE_READ);
+			struct fmatrix *td = ta ? fmat_tiled_pin(out, ti, tj, FMAT_TILE_OVERWRITE) : NULL;
+
+			if (td)
+				fmat_trans(td, ta);
+
+			if (ta)
+				fmat_tiled_unpin(a, tj, ti);
+			if (!td)
+				goto error;
+			fmat_tiled_unpin(out, ti, tj);
+		}
+	}
+
+	return out;
+
+error:
+	if (!dest)
+		fmat_tiled_free(out);
+	return NULL;
+}
+
+/* Factor the leading n x n block of a diagonal tile in place; false on a pivot below FMAT_LU_TINY */
+static bool fmat_tiled_lu_diag(struct fmatrix *d, size_t n)
+{
+	for (size_t c = 0; c < n; c++) {
+		const fval_t pivot = d->data[c][c];
+
+		if (fabs(pivot) < FMAT_LU_TINY)
+			return false;
+
+		for (size_t r = c + 1; r < n; r++) {
+			const fval_t l = d->data[r][c] /= pivot;
+
+			fkernels->axpy(d->data[r] + c + 1, -l, d->data[c] + c + 1, n - c - 1);
+		}
+	}
+
+	return true;
+}
+
+/* u = L^-1 * u for the unit lower triangle L of the leading n x n block of d */
+static void fmat_tiled_lu_row(const struct fmatrix *d, struct fmatrix *u, size_t n)
+{
+	for (size_t r = 1; r < n; r++)
+		for (size_t q = 0; q < r; q++)
+			fkernels->axpy(u->data[r], -d->data[r][q], u->data[q], u->cols);
+}
+
+/* l = l * U^-1 for the upper triangle U of the leading n x n block of d */
+static void fmat_tiled_lu_col(const struct fmatrix *d, struct fmatrix *l, size_t n)
+{
+	for (size_t r = 0; r < l->rows; r++) {
+		fval_t *x = l->data[r];
+
+		for (size_t c = 0; c < n; c++) {
+			x[c] /= d->data[c][c];
+			fkernels->axpy(x + c + 1, -x[c], d->data[c] + c + 1, n - c - 1);
+		}
+	}
+}
+
+struct fmat_tiled *fmat_tiled_lu(struct fmat_tiled *m)
+{
+	if (!m || m->rows != m->cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	const size_t nt = m->tile_rows;
+
+	for (size_t k = 0; k < nt; k++) {
+		const size_t n = fmat_tiled_extent(m->rows, m->tile, k);
+		struct fmatrix *d = fmat_tiled_pin(m, k, k, FMAT_TILE_WRITE);
+		if (!d)
+			return NULL;
+
+		if (!fmat_tiled_lu_diag(d, n)) {
+			fmat_tiled_unpin(m, k, k);
+			errno = EDOM;
+			perror(__func__);
+			return NULL;
+		}
+
+		/* The column of L below the diagonal tile */
+		for (size_t i = k + 1; i < nt; i++) {
+			struct fmatrix *l = fmat_tiled_pin(m, i, k, FMAT_TILE_WRITE);
+			if (!l) {
+				fmat_tiled_unpin(m, k, k);
+				return NULL;
+			}
+
+			fmat_tiled_lu_col(d, l, n);
+			fmat_tiled_unpin(m, i, k);
+		}
+
+		/*
+		 * Each tile of the row of U is solved and then, still pinned,
+		 * updates its tile column of the trailing matrix. The column
+		 * sweeps alternate direction so each starts on the tiles of L the
+		 * last one ended on.
+		 */
+		for (size_t j = k + 1; j < nt; j++) {
+			struct fmatrix *u = fmat_tiled_pin(m, k, j, FMAT_TILE_WRITE);
+			if (!u) {
+				fmat_tiled_unpin(m, k, k);
+				return NULL;
+			}
+
+			fmat_tiled_lu_row(d, u, n);
+
+			for (size_t ii = 0; ii < nt - k - 1; ii++) {
+				const size_t i = k + 1 + fmat_tiled_snake(nt - k - 1, ii, j);
+				struct fmatrix *l = fmat_tiled_pin(m, i, k, FMAT_TILE_READ);
+				struct fmatrix *t = l ? fmat_tiled_pin(m, i, j, FMAT_TILE_WRITE) : NULL;
+
+				if (t)
+					fgemm(-1, l, u, 1, t);
+
+				if (l)
+					fmat_tiled_unpin(m, i, k);
+				if (!t) {
+					fmat_tiled_unpin(m, k, j);
+					fmat_tiled_unpin(m, k, k);
+					return NULL;
+				}
+				fmat_tiled_unpin(m, i, j);
+			}
+
+			fmat_tiled_unpin(m, k, j);
+		}
+
+		fmat_tiled_unpin(m, k, k);
+	}
+
+	return m;
+}
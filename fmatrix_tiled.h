@@ -0,0 +1,95 @@
+#ifndef FMATRIX_TILED_H
+#define FMATRIX_TILED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "fmatrix.h"
+
+/*
+ * Out-of-core floating-point matrix, kept in a file as square tiles of
+ * tile x tile elements stored one after another, and brought into memory a
+ * tile at a time through an LRU cache of a fixed number of tiles. Tiles on
+ * the right and bottom edges are stored whole with zeros past the matrix, so
+ * every tile can be handed to the in-memory routines as a full fmatrix.
+ * The file is in the machine's byte order.
+ */
+struct fmat_tiled {
+	const size_t rows, cols;
+	/* Order of the tiles and the number of tile rows and columns */
+	const size_t tile, tile_rows, tile_cols;
+	/* Tiles read from and written back to the file so far */
+	size_t reads, writes;
+	int fd;
+	struct fmat_tile_cache *cache;
+};
+
+/* Tile modes of fmat_tiled_pin */
+/* The tile is only read */
+#define FMAT_TILE_READ 0
+/* The tile is read and modified */
+#define FMAT_TILE_WRITE 1
+/* The tile is replaced: it starts zeroed instead of being read */
+#define FMAT_TILE_OVERWRITE 2
+
+/* Fewest tiles a cache holds, enough for the tiles fmat_tiled_lu pins at once */
+#define FMAT_TILED_MIN_CACHE 4
+
+/*
+ * Create a zeroed rows x cols matrix in a new file at path, or in an unlinked
+ * temporary file if path is NULL. tile is rounded up to the row stride
+ * fmat_alloc gives tile columns; the cache holds cache_bytes of tiles, and at
+ * least FMAT_TILED_MIN_CACHE.
+ */
+struct fmat_tiled *fmat_tiled_create(const char *path, size_t rows, size_t cols, size_t tile, size_t cache_bytes);
+/* Open a matrix created by fmat_tiled_create, caching cache_bytes of tiles */
+struct fmat_tiled *fmat_tiled_open(const char *path, size_t cache_bytes);
+/* Write back the modified tiles and delete the in-memory matrix; false if writing failed */
+bool fmat_tiled_free(struct fmat_tiled *m);
+/* Write back every modified tile in the cache */
+bool fmat_tiled_flush(struct fmat_tiled *m);
+
+/*
+ * Tile (ti, tj) in the cache, read from the file unless mode is
+ * FMAT_TILE_OVERWRITE. It stays in the cache until unpinned as often as it
+ * was pinned; NULL if every cached tile is pinned or I/O fails.
+ */
+struct fmatrix *fmat_tiled_pin(struct fmat_tiled *m, size_t ti, size_t tj, unsigned mode);
+/* Release a tile pinned by fmat_tiled_pin */
+void fmat_tiled_unpin(struct fmat_tiled *m, size_t ti, size_t tj);
+
+/* Set a single field of a tiled matrix */
+void fmat_tiled_set(struct fmat_tiled *m, size_t row, size_t col, fval_t val);
+/* Get a single field of a tiled matrix */
+fval_t fmat_tiled_get(struct fmat_tiled *m, size_t row, size_t col);
+/* Copy the in-memory matrix src into dest, which has its shape */
+struct fmat_tiled *fmat_tiled_load(struct fmat_tiled *dest, const struct fmatrix *src);
+/* Copy m into dest, or into a new in-memory matrix if dest is NULL */
+struct fmatrix *fmat_tiled_store(struct fmatrix *dest, struct fmat_tiled *m);
+
+/*
+ * Operations run tile by tile and write into dest, or into a new matrix in a
+ * temporary file with the tile and cache sizes of a if dest is NULL. All
+ * operands share their tile size. dest must not be an operand of mul or trans.
+ * Tiles are visited in serpentine order, so the tiles last used at the end
+ * of one row or column of tiles are still cached at the start of the next.
+ */
+
+/* dest = a + b, reading every tile of a and b once and never reading dest */
+struct fmat_tiled *fmat_tiled_add(struct fmat_tiled *dest, struct fmat_tiled *a, struct fmat_tiled *b);
+/* dest = a * b, each tile of dest computed in the cache and written once */
+struct fmat_tiled *fmat_tiled_mul(struct fmat_tiled *dest, struct fmat_tiled *a, struct fmat_tiled *b);
+/* dest = a^T, reading every tile of a once */
+struct fmat_tiled *fmat_tiled_trans(struct fmat_tiled *dest, struct fmat_tiled *a);
+/*
+ * Factor a square matrix in place into L below the diagonal (unit diagonal
+ * implied) and U on and above it, a = L * U, by right-looking tile
+ * elimination. There is no pivoting, since rows cannot be swapped across
+ * tiles without reading them all: this suits the symmetric positive definite
+ * and diagonally dominant matrices, such as covariances, that it is stable
+ * for. NULL if a pivot is below FMAT_LU_TINY in magnitude, as fmat_lu_new
+ * would find the matrix singular.
+ */
+struct fmat_tiled *fmat_tiled_lu(struct fmat_tiled *m);
+
+#endif /* FMATRIX_TILED_H */
@@ -0,0 +1,121 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fmatrix_workspace.h"
+#include "layout.h"
+
+/* Round a size up to a multiple of FMATRIX_ALIGN */
+static size_t fmat_workspace_round(size_t bytes)
+{
+	return (bytes + FMATRIX_ALIGN - 1) / FMATRIX_ALIGN * FMATRIX_ALIGN;
+}
+
+struct fmat_workspace *fmat_workspace_new(size_t bytes)
+{
+	if (bytes > SIZE_MAX - FMATRIX_ALIGN) {
+		errno = ENOMEM;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct fmat_workspace *ws = malloc(sizeof(struct fmat_workspace));
+	if (!ws) {
+		perror(__func__);
+		return NULL;
+	}
+
+	ws->size = fmat_workspace_round(bytes);
+	ws->used = 0;
+	ws->base = aligned_alloc(FMATRIX_ALIGN, ws->size ? ws->size : FMATRIX_ALIGN);
+	if (!ws->base) {
+		perror(__func__);
+		free(ws);
+		return NULL;
+	}
+
+	return ws;
+}
+
+void fmat_workspace_free(struct fmat_workspace *ws)
+{
+	if (!ws)
+		return;
+
+	free(ws->base);
+	free(ws);
+}
+
+void *fmat_workspace_alloc(struct fmat_workspace *ws, size_t bytes)
+{
+	if (!ws) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	if (bytes > ws->size - ws->used) {
+		errno = ENOMEM;
+		perror(__func__);
+		return NULL;
+	}
+
+	bytes = fmat_workspace_round(bytes);
+	if (bytes > ws->size - ws->used) {
+		errno = ENOMEM;
+		perror(__func__);
+		return NULL;
+	}
+
+	void *p = ws->base + ws->used;
+
+	ws->used += bytes;
+
+	return p;
+}
+
+size_t fmat_workspace_matrix_size(size_t rows, size_t cols)
+{
+	return fmat_workspace_round(fmat_block_size(rows, fmat_stride(cols)));
+}
+
+struct fmatrix *fmat_workspace_matrix(struct fmat_workspace *ws, size_t rows, size_t cols)
+{
+	if (!ws || !rows || !cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	const size_t stride = fmat_stride(cols);
+
+	if (rows > SIZE_MAX / 2 / sizeof(fval_t) / stride) {
+		errno = ENOMEM;
+		perror(__func__);
+		return NULL;
+	}
+
+	/* One aligned block laid out as fmat_alloc lays out its own */
+	unsigned char *block = fmat_workspace_alloc(ws, fmat_block_size(rows, stride));
+	if (!block)
+		return NULL;
+
+	return fmat_layout(block, rows, cols, NULL);
+}
+
+size_t fmat_workspace_mark(const struct fmat_workspace *ws)
+{
+	return ws ? ws->used : 0;
+}
+
+void fmat_workspace_release(struct fmat_workspace *ws, size_t mark)
+{
+	if (!ws || mark > ws->used) {
+		errno = EINVAL;
+		perror(__func__);
+		return;
+	}
+
+	ws->used = mark;
+}
@@ -0,0 +1,37 @@
+#ifndef FMATRIX_WORKSPACE_H
+#define FMATRIX_WORKSPACE_H
+
+#include <stddef.h>
+
+#include "fmatrix.h"
+
+/*
+ * Caller-owned scratch arena. Routines that take a workspace carve their
+ * temporaries out of it instead of the heap and give the space back before
+ * returning, so a workspace sized once serves any number of calls without
+ * further allocation.
+ */
+struct fmat_workspace {
+	unsigned char *base;
+	size_t size;
+	size_t used;
+};
+
+/* Allocate a workspace of the given size in bytes */
+struct fmat_workspace *fmat_workspace_new(size_t bytes);
+/* Delete a workspace */
+void fmat_workspace_free(struct fmat_workspace *ws);
+
+/* Carve bytes aligned to FMATRIX_ALIGN, or return NULL if the workspace is too small */
+void *fmat_workspace_alloc(struct fmat_workspace *ws, size_t bytes);
+/* Carve a zeroed matrix; it must not be passed to fmat_free */
+struct fmatrix *fmat_workspace_matrix(struct fmat_workspace *ws, size_t rows, size_t cols);
+/* Bytes fmat_workspace_matrix takes for a rows x cols matrix */
+size_t fmat_workspace_matrix_size(size_t rows, size_t cols);
+
+/* Current fill level, to hand to fmat_workspace_release */
+size_t fmat_workspace_mark(const struct fmat_workspace *ws);
+/* Give back everything carved since mark was taken */
+void fmat_workspace_release(struct fmat_workspace *ws, size_t mark);
+
+#endif /* FMATRIX_WORKSPACE_H */
@@ -0,0 +1,277 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fkernels.h"
+#include "fvector.h"
+#include "threadpool.h"
+
+/* Elements of a matrix below which products stay on the calling thread */
+#define FVEC_PARALLEL_MIN (256 * 1024)
+
+/* Bytes of a panel of matrix rows applied to every vector of a batch while cached */
+#define FVEC_PANEL_BYTES (128 * 1024)
+
+/* Offset of the elements in the block holding a vector, after the struct */
+static size_t fvec_data_offset(void)
+{
+	return (sizeof(struct fvector) + FMATRIX_ALIGN - 1) / FMATRIX_ALIGN * FMATRIX_ALIGN;
+}
+
+/* Lay out a zeroed vector of len elements in block, which holds its struct and elements */
+static struct fvector *fvec_layout(unsigned char *block, size_t len, const struct mat_allocator *alloc)
+{
+	struct fvector *v = (struct fvector *)block;
+	fval_t *data = (fval_t *)(block + fvec_data_offset());
+
+	/* Copy over a temporary vector that holds the const length */
+	struct fvector v_temp = { .len = len, .data = data, .alloc = alloc };
+	memcpy(v, &v_temp, sizeof(struct fvector));
+
+	memset(data, 0, len * sizeof(fval_t));
+
+	return v;
+}
+
+struct fvector *fvec_alloc(size_t len)
+{
+	if (!len) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	if (len > (SIZE_MAX / 2 - fvec_data_offset()) / sizeof(fval_t)) {
+		errno = ENOMEM;
+		perror(__func__);
+		return NULL;
+	}
+
+	/* The struct and the aligned elements share one block */
+	const struct mat_allocator *alloc = mat_allocator_get();
+	unsigned char *block =
+		alloc->alloc(alloc->ctx, fvec_data_offset() + len * sizeof(fval_t), FMATRIX_ALIGN);
+	if (!block) {
+		errno = ENOMEM;
+		perror(__func__);
+		return NULL;
+	}
+
+	return fvec_layout(block, len, alloc);
+}
+
+void fvec_free(struct fvector *v)
+{
+	if (!v || !v->alloc)
+		return;
+
+	v->alloc->free(v->alloc->ctx, v, fvec_data_offset() + v->len * sizeof(fval_t));
+}
+
+struct fvector *fvec_inline(void *storage, size_t bytes, size_t len)
+{
+	if (!storage || !len) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	/* The first bound keeps the block size from overflowing */
+	const bool fits = (uintptr_t)storage % FMATRIX_ALIGN == 0 && len <= bytes / sizeof(fval_t) &&
+			  fvec_data_offset() + len * sizeof(fval_t) <= bytes;
+
+	if (fits)
+		return fvec_layout(storage, len, NULL);
+
+	/* Too large for the inline buffer: take the storage from the spill pool instead */
+	const struct mat_allocator *prev = mat_allocator_set(mat_spill_allocator());
+	struct fvector *v = fvec_alloc(len);
+
+	mat_allocator_set(prev);
+
+	return v;
+}
+
+void fvec_scope_free(struct fvector **v)
+{
+	fvec_free(*v);
+}
+
+/*
+ * Both products come down to one of two loops over the stored rows of a
+ * matrix s: dot products of its rows with x (y = s * x), or sums of its rows
+ * scaled by the elements of x (y = x^T * s). Transposing the matrix swaps one
+ * loop for the other.
+ */
+struct fvec_job {
+	/* Stored orientation of the matrix */
+	struct fmatrix s;
+	fval_t alpha, beta;
+	const struct fvector *const *x;
+	struct fvector *const *y;
+	size_t count;
+	size_t ntasks;
+};
+
+/* Rows of s in a panel spanning cols columns */
+static size_t fvec_panel_rows(size_t cols)
+{
+	const size_t rows = FVEC_PANEL_BYTES / (cols * sizeof(fval_t));
+
+	return rows ? rows : 1;
+}
+
+/* y = alpha * s * x + beta * y for one band of rows of s */
+static void fvec_dot_task(void *arg, size_t task)
+{
+	const struct fvec_job *job = arg;
+	const struct fmatrix *s = &job->s;
+	const size_t r0 = s->rows * task / job->ntasks;
+	const size_t r1 = s->rows * (task + 1) / job->ntasks;
+	const size_t panel = fvec_panel_rows(s->cols);
+
+	for (size_t p0 = r0; p0 < r1; p0 += panel) {
+		const size_t p1 = p0 + panel < r1 ? p0 + panel : r1;
+
+		for (size_t v = 0; v < job->count; v++) {
+			const fval_t *x = job->x[v]->data;
+			fval_t *y = job->y[v]->data;
+
+			for (size_t r = p0; r < p1; r++) {
+				const fval_t dot = job->alpha * fkernels->dot(s->data[r], x, s->cols);
+
+				y[r] = job->beta == 0.0 ? dot : dot + job->beta * y[r];
+			}
+		}
+	}
+}
+
+/* y = alpha * x^T * s + beta * y for one band of columns of s */
+static void fvec_axpy_task(void *arg, size_t task)
+{
+	const struct fvec_job *job = arg;
+	const struct fmatrix *s = &job->s;
+	const size_t c0 = s->cols * task / job->ntasks;
+	const size_t c1 = s->cols * (task + 1) / job->ntasks;
+	const size_t panel = fvec_panel_rows(c1 - c0);
+
+	if (c0 == c1)
+		return;
+
+	for (size_t v = 0; v < job->count; v++) {
+		fval_t *y = job->y[v]->data + c0;
+
+		if (job->beta == 0.0)
+			memset(y, 0, (c1 - c0) * sizeof(fval_t));
+		else if (job->beta != 1.0)
+			fkernels->scale(y, job->beta, y, c1 - c0);
+	}
+
+	for (size_t p0 = 0; p0 < s->rows; p0 += panel) {
+		const size_t p1 = p0 + panel < s->rows ? p0 + panel : s->rows;
+
+		for (size_t v = 0; v < job->count; v++) {
+			const fval_t *x = job->x[v]->data;
+			fval_t *y = job->y[v]->data + c0;
+
+			for (size_t r = p0; r < p1; r++)
+				fkernels->axpy(y, job->alpha * x[r], s->data[r] + c0, c1 - c0);
+		}
+	}
+}
+
+/* Run y = alpha * op(a) * x + beta * y, where op transposes a if trans is set */
+static void fvec_run(fval_t alpha,
+		     const struct fmatrix *a,
+		     bool trans,
+		     const struct fvector *const *x,
+		     fval_t beta,
+		     struct fvector *const *y,
+		     size_t count)
+{
+	/* The stored matrix and whether the product reads it by rows */
+	const bool stored_trans = a->flags & FMAT_TRANSPOSED;
+	const bool by_rows = trans == stored_trans;
+	struct fvec_job job = {
+		.s = { .cols = stored_trans ? a->rows : a->cols,
+		       .rows = stored_trans ? a->cols : a->rows,
+		       .data = a->data },
+		.alpha = alpha,
+		.beta = beta,
+		.x = x,
+		.y = y,
+		.count = count,
+		.ntasks = 1,
+	};
+	const size_t split = by_rows ? job.s.rows : job.s.cols;
+
+	if (job.s.rows * job.s.cols >= FVEC_PARALLEL_MIN) {
+		job.ntasks = threadpool_get_threads();
+		if (job.ntasks > split)
+			job.ntasks = split;
+	}
+
+	threadpool_run(job.ntasks, by_rows ? fvec_dot_task : fvec_axpy_task, &job);
+}
+
+struct fvector *fmat_gemv(fval_t alpha,
+			  const struct fmatrix *a,
+			  const struct fvector *x,
+			  fval_t beta,
+			  struct fvector *y)
+{
+	if (!a || !x || !y || x == y || x->len != a->cols || y->len != a->rows) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	fvec_run(alpha, a, false, &x, beta, &y, 1);
+
+	return y;
+}
+
+struct fvector *fmat_gevm(fval_t alpha,
+			  const struct fvector *x,
+			  const struct fmatrix *a,
+			  fval_t beta,
+			  struct fvector *y)
+{
+	if (!a || !x || !y || x == y || x->len != a->rows || y->len != a->cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	fvec_run(alpha, a, true, &x, beta, &y, 1);
+
+	return y;
+}
+
+bool fmat_gemv_batch(fval_t alpha,
+		     const struct fmatrix *a,
+		     const struct fvector *const *x,
+		     fval_t beta,
+		     struct fvector *const *y,
+		     size_t count)
+{
+	if (!a || !x || !y) {
+		errno = EINVAL;
+		perror(__func__);
+		return false;
+	}
+
+	for (size_t v = 0; v < count; v++) {
+		if (!x[v] || !y[v] || x[v] == y[v] || x[v]->len != a->cols || y[v]->len != a->rows) {
+			errno = EINVAL;
+			perror(__func__);
+			return false;
+		}
+	}
+
+	if (count)
+		fvec_run(alpha, a, false, x, beta, y, count);
+
+	return true;
+}
@@ -0,0 +1,72 @@
+#ifndef FVECTOR_H
+#define FVECTOR_H
+
+#include <stddef.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "fmatrix.h"
+
+/* Dense floating-point vector; its elements are one aligned run of memory */
+struct fvector {
+	const size_t len;
+	fval_t *data;
+	/* Allocator owning the storage, NULL if the vector does not own it */
+	const struct mat_allocator *alloc;
+};
+
+/* Bytes of inline storage of a scoped vector, including its struct */
+#ifndef FVECTOR_INLINE_BYTES
+#define FVECTOR_INLINE_BYTES 4096
+#endif
+
+/* Set up a vector of len elements in storage, or in the spill pool if it does not fit; see FVECTOR */
+struct fvector *fvec_inline(void *storage, size_t bytes, size_t len);
+/* Release a scoped vector; the cleanup handler of FVECTOR */
+void fvec_scope_free(struct fvector **v);
+
+/*
+ * Scoped vector, zeroed and released when name goes out of scope. Like
+ * FMATRIX it lives in an inline buffer of FVECTOR_INLINE_BYTES on the stack
+ * when it fits and spills to the thread's spill pool when it does not. name
+ * is NULL if spilling fails.
+ */
+#define FVECTOR(name, N)                                                           \
+	_Alignas(FMATRIX_ALIGN) unsigned char name##_inline[FVECTOR_INLINE_BYTES]; \
+	__attribute__((cleanup(fvec_scope_free))) struct fvector *name =           \
+		fvec_inline(name##_inline, sizeof(name##_inline), (N))
+
+/* Allocate a zeroed floating-point vector */
+struct fvector *fvec_alloc(size_t len);
+/* Delete a floating-point vector */
+void fvec_free(struct fvector *v);
+
+/*
+ * Matrix-vector product y = alpha * a * x + beta * y, streaming the rows of a
+ * against x. With beta 0 the old contents of y are never read. x and y must
+ * not overlap; a may be a transposed or block view.
+ */
+struct fvector *fmat_gemv(fval_t alpha,
+			  const struct fmatrix *a,
+			  const struct fvector *x,
+			  fval_t beta,
+			  struct fvector *y);
+/* Vector-matrix product y = alpha * x^T * a + beta * y, as fmat_gemv */
+struct fvector *fmat_gevm(fval_t alpha,
+			  const struct fvector *x,
+			  const struct fmatrix *a,
+			  fval_t beta,
+			  struct fvector *y);
+/*
+ * y[i] = alpha * a * x[i] + beta * y[i] for count vectors at once. a is
+ * read from memory once: each panel of its rows is applied to every vector
+ * while it is still in cache, so no y[i] may overlap any x[j].
+ */
+bool fmat_gemv_batch(fval_t alpha,
+		     const struct fmatrix *a,
+		     const struct fvector *const *x,
+		     fval_t beta,
+		     struct fvector *const *y,
+		     size_t count);
+
+#endif /* FVECTOR_H */
@@ -0,0 +1,869 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gf2matrix.h"
+
+/* Rows of b combined into one M4RM lookup table */
+#define GF2_M4RM_BITS 8
+
+/* Words of each row of b covered by one table, so that the table stays in L2 */
+#define GF2_M4RM_BLOCK 64
+
+static size_t min_size(size_t a, size_t b)
+{
+	return a < b ? a : b;
+}
+
+/* Element (r, c) of an integer matrix or view */
+static inline val_t *gf2_mat_at(const struct matrix *m, size_t r, size_t c)
+{
+	return m->flags & MAT_TRANSPOSED ? &m->data[c][r] : &m->data[r][c];
+}
+
+/* Number of words holding cols packed elements */
+static size_t gf2_words(size_t cols)
+{
+	return (cols + GF2_WORD_BITS - 1) / GF2_WORD_BITS;
+}
+
+struct gf2matrix *gf2mat_alloc(const size_t rows, const size_t cols)
+{
+	if (!rows || !cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	const size_t stride = gf2_words(cols);
+
+	if (rows > (SIZE_MAX - GF2MATRIX_ALIGN) / sizeof(gf2word_t) / stride) {
+		errno = ENOMEM;
+		perror(__func__);
+		return NULL;
+	}
+
+	const size_t bytes = (rows * stride * sizeof(gf2word_t) + GF2MATRIX_ALIGN - 1) /
+			     GF2MATRIX_ALIGN * GF2MATRIX_ALIGN;
+
+	/* Allocate the struct */
+	struct gf2matrix *m = malloc(sizeof(struct gf2matrix));
+	if (!m) {
+		perror(__func__);
+		goto error;
+	}
+
+	/* Copy over a temporary matrix that holds the const rows and columns */
+	struct gf2matrix m_temp = { .cols = cols, .rows = rows, .data = NULL, .buf = NULL, .stride = stride };
+	memcpy(m, &m_temp, sizeof(struct gf2matrix));
+
+	/* Allocate the row-pointer table */
+	m->data = malloc(rows * sizeof(gf2word_t *));
+	if (!m->data) {
+		perror(__func__);
+		goto error_rows;
+	}
+
+	/* Allocate all words as one aligned slab */
+	m->buf = aligned_alloc(GF2MATRIX_ALIGN, bytes);
+	if (!m->buf) {
+		perror(__func__);
+		goto error_buf;
+	}
+
+	memset(m->buf, 0, bytes);
+
+	for (size_t row = 0; row < rows; row++)
+		m->data[row] = m->buf + row * stride;
+
+	return m;
+
+error_buf:
+	free(m->data);
+error_rows:
+	free(m);
+error:
+	return NULL;
+}
+
+void gf2mat_free(struct gf2matrix *m)
+{
+	if (!m)
+		return;
+
+	free(m->buf);
+	free(m->data);
+	free(m);
+}
+
+void gf2mat_set_identity(struct gf2matrix *m)
+{
+	if (!m) {
+		errno = EINVAL;
+		perror(__func__);
+		return;
+	}
+
+	if (m->rows != m->cols) {
+		errno = EINVAL;
+		perror(__func__);
+		printf("rows: %zu, cols: %zu\nOnly an  m x m matrix can become an identity matrix\n",
+		       m->rows,
+		       m->cols);
+		return;
+	}
+
+	for (size_t row = 0; row < m->rows; row++)
+		m->data[row][row / GF2_WORD_BITS] |= (gf2word_t)1 << (row % GF2_WORD_BITS);
+}
+
+struct gf2matrix *gf2mat_identity_new(const size_t dims)
+{
+	if (!dims) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct gf2matrix *m = gf2mat_alloc(dims, dims);
+	gf2mat_set_identity(m);
+
+	return m;
+}
+
+void gf2mat_set(struct gf2matrix *m, size_t row, size_t col, bool val)
+{
+	if (!m || row >= m->rows || col >= m->cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return;
+	}
+
+	const gf2word_t bit = (gf2word_t)1 << (col % GF2_WORD_BITS);
+
+	if (val)
+		m->data[row][col / GF2_WORD_BITS] |= bit;
+	else
+		m->data[row][col / GF2_WORD_BITS] &= ~bit;
+}
+
+bool gf2mat_get(const struct gf2matrix *m, size_t row, size_t col)
+{
+	if (!m || row >= m->rows || col >= m->cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return false;
+	}
+
+	return (m->data[row][col / GF2_WORD_BITS] >> (col % GF2_WORD_BITS)) & 0x1;
+}
+
+void gf2mat_reset(struct gf2matrix *m)
+{
+	if (!m) {
+		errno = EINVAL;
+		perror(__func__);
+		return;
+	}
+
+	for (size_t row = 0; row < m->rows; row++)
+		memset(m->data[row], 0, m->stride * sizeof(gf2word_t));
+}
+
+void gf2mat_set_row(struct gf2matrix *m, size_t row, unsigned long long bits)
+{
+	if (!m || row >= m->rows) {
+		errno = EINVAL;
+		perror(__func__);
+		return;
+	}
+
+	memset(m->data[row], 0, m->stride * sizeof(gf2word_t));
+
+	for (size_t col = 0; col < m->cols; col++) {
+		const size_t shift = (m->cols - 1) - col;
+
+		if (shift < 64 && (bits >> shift & 0x1))
+			m->data[row][col / GF2_WORD_BITS] |= (gf2word_t)1 << (col % GF2_WORD_BITS);
+	}
+}
+
+void gf2mat_print(const struct gf2matrix *m)
+{
+	if (!m) {
+		errno = EINVAL;
+		perror(__func__);
+		return;
+	}
+
+	for (size_t row = 0; row < m->rows; row++) {
+		for (size_t col = 0; col < m->cols; col++)
+			printf("%d  ", (int)((m->data[row][col / GF2_WORD_BITS] >> (col % GF2_WORD_BITS)) & 0x1));
+
+		printf("\n");
+	}
+	printf("\n");
+}
+
+/* ---------------- Operations ---------------- */
+
+struct gf2matrix *gf2mat_copy(struct gf2matrix *dest, const struct gf2matrix *src)
+{
+	if (!src) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	if (dest) {
+		if (dest->rows != src->rows || dest->cols != src->cols) {
+			errno = EINVAL;
+			perror(__func__);
+			return NULL;
+		}
+	} else {
+		dest = gf2mat_alloc(src->rows, src->cols);
+		if (!dest)
+			return NULL;
+	}
+
+	if (dest == src)
+		return dest;
+
+	for (size_t r = 0; r < src->rows; r++)
+		memcpy(dest->data[r], src->data[r], src->stride * sizeof(gf2word_t));
+
+	return dest;
+}
+
+bool gf2mat_equal(const struct gf2matrix *a, const struct gf2matrix *b)
+{
+	if (!a || !b || a->rows != b->rows || a->cols != b->cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return false;
+	}
+
+	for (size_t r = 0; r < a->rows; r++)
+		if (memcmp(a->data[r], b->data[r], a->stride * sizeof(gf2word_t)))
+			return false;
+
+	return true;
+}
+
+struct gf2matrix *gf2mat_add(struct gf2matrix *dest,
+			     const struct gf2matrix *a,
+			     const struct gf2matrix *b)
+{
+	if (!a || !b || a->rows != b->rows || a->cols != b->cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	if (dest) {
+		if (dest->rows != a->rows || dest->cols != a->cols) {
+			errno = EINVAL;
+			perror(__func__);
+			return NULL;
+		}
+	} else {
+		dest = gf2mat_alloc(a->rows, a->cols);
+		if (!dest)
+			return NULL;
+	}
+
+	for (size_t r = 0; r < a->rows; r++) {
+		gf2word_t *d = dest->data[r];
+		const gf2word_t *x = a->data[r];
+		const gf2word_t *y = b->data[r];
+
+		for (size_t w = 0; w < a->stride; w++)
+			d[w] = x[w] ^ y[w];
+	}
+
+	return dest;
+}
+
+struct gf2matrix *gf2mat_mul(struct gf2matrix *dest,
+			     const struct gf2matrix *a,
+			     const struct gf2matrix *b)
+{
+	if (!a || !b || a->cols != b->rows || dest == a || dest == b) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct gf2matrix *res = dest;
+
+	if (res) {
+		if (res->rows != a->rows || res->cols != b->cols) {
+			errno = EINVAL;
+			perror(__func__);
+			return NULL;
+		}
+	} else {
+		res = gf2mat_alloc(a->rows, b->cols);
+		if (!res)
+			return NULL;
+	}
+
+	const size_t width_max = min_size(GF2_M4RM_BLOCK, res->stride);
+	const size_t table_bytes = ((size_t)1 << GF2_M4RM_BITS) * width_max * sizeof(gf2word_t);
+	gf2word_t *table = aligned_alloc(GF2MATRIX_ALIGN, table_bytes);
+
+	if (!table) {
+		perror(__func__);
+		if (!dest)
+			gf2mat_free(res);
+		return NULL;
+	}
+
+	gf2mat_reset(res);
+
+	for (size_t w0 = 0; w0 < res->stride; w0 += GF2_M4RM_BLOCK) {
+		const size_t width = min_size(GF2_M4RM_BLOCK, res->stride - w0);
+
+		for (size_t k0 = 0; k0 < a->cols; k0 += GF2_M4RM_BITS) {
+			const size_t entries = (size_t)1 << min_size(GF2_M4RM_BITS, a->cols - k0);
+
+			/*
+			 * Entry x holds the sum of the rows of b selected by the bits of x.
+			 * Each entry is the one with its lowest bit cleared plus one row.
+			 */
+			memset(table, 0, width * sizeof(gf2word_t));
+			for (size_t x = 1; x < entries; x++) {
+				const gf2word_t *prev = table + (x & (x - 1)) * width;
+				const gf2word_t *brow = b->data[k0 + __builtin_ctzll(x)] + w0;
+				gf2word_t *entry = table + x * width;
+
+				for (size_t w = 0; w < width; w++)
+					entry[w] = prev[w] ^ brow[w];
+			}
+
+			/* One table lookup replaces GF2_M4RM_BITS row additions */
+			for (size_t i = 0; i < a->rows; i++) {
+				const size_t x = (a->data[i][k0 / GF2_WORD_BITS] >> (k0 % GF2_WORD_BITS)) &
+						 (entries - 1);
+
+				if (!x)
+					continue;
+
+				const gf2word_t *entry = table + x * width;
+				gf2word_t *d = res->data[i] + w0;
+
+				for (size_t w = 0; w < width; w++)
+					d[w] ^= entry[w];
+			}
+		}
+	}
+
+	free(table);
+
+	return res;
+}
+
+/* Transpose a 64 x 64 bit block in place by swapping ever smaller off-diagonal blocks */
+static void gf2_transpose_block(gf2word_t blk[GF2_WORD_BITS])
+{
+	gf2word_t mask = 0x00000000ffffffffULL;
+
+	for (unsigned j = 32; j; j >>= 1, mask ^= mask << j) {
+		for (unsigned k = 0; k < GF2_WORD_BITS; k = ((k | j) + 1) & ~j) {
+			const gf2word_t t = ((blk[k] >> j) ^ blk[k | j]) & mask;
+
+			blk[k] ^= t << j;
+			blk[k | j] ^= t;
+		}
+	}
+}
+
+struct gf2matrix *gf2mat_trans(struct gf2matrix *dest, const struct gf2matrix *src)
+{
+	if (!src || dest == src) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	if (dest) {
+		if (dest->rows != src->cols || dest->cols != src->rows) {
+			errno = EINVAL;
+			perror(__func__);
+			return NULL;
+		}
+	} else {
+		dest = gf2mat_alloc(src->cols, src->rows);
+		if (!dest)
+			return NULL;
+	}
+
+	gf2word_t blk[GF2_WORD_BITS];
+
+	for (size_t r0 = 0; r0 < src->rows; r0 += GF2_WORD_BITS) {
+		const size_t nrows = min_size(GF2_WORD_BITS, src->rows - r0);
+
+		for (size_t w = 0; w < src->stride; w++) {
+			const size_t ncols = min_size(GF2_WORD_BITS, src->cols - w * GF2_WORD_BITS);
+
+			for (size_t i = 0; i < GF2_WORD_BITS; i++)
+				blk[i] = i < nrows ? src->data[r0 + i][w] : 0;
+
+			gf2_transpose_block(blk);
+
+			/* Word i now holds column w * 64 + i of the source block */
+			for (size_t i = 0; i < ncols; i++)
+				dest->data[w * GF2_WORD_BITS + i][r0 / GF2_WORD_BITS] = blk[i];
+		}
+	}
+
+	return dest;
+}
+
+/* ---------------- Elimination ---------------- */
+
+/*
+ * Allocate a scratch matrix holding a followed by extra_cols free columns.
+ * The extra columns start on a word boundary, so one loop over the words of
+ * a row applies each row operation to both parts.
+ */
+static struct gf2matrix *gf2_augment(const struct gf2matrix *a, size_t extra_cols)
+{
+	struct gf2matrix *m = gf2mat_alloc(a->rows, a->stride * GF2_WORD_BITS + extra_cols);
+	if (!m)
+		return NULL;
+
+	for (size_t r = 0; r < a->rows; r++)
+		memcpy(m->data[r], a->data[r], a->stride * sizeof(gf2word_t));
+
+	return m;
+}
+
+/* Swap two rows of a scratch matrix by exchanging their pointers */
+static void gf2_swap_rows(struct gf2matrix *m, size_t a, size_t b)
+{
+	gf2word_t *tmp = m->data[a];
+
+	m->data[a] = m->data[b];
+	m->data[b] = tmp;
+}
+
+/* row ^= src over words w0 to the end of the row */
+static void gf2_xor_row(gf2word_t *row, const gf2word_t *src, size_t w0, size_t stride)
+{
+	for (size_t w = w0; w < stride; w++)
+		row[w] ^= src[w];
+}
+
+/*
+ * Reduce m to reduced row echelon form, choosing pivots among its first ncols
+ * columns, and return the rank, or (size_t)-1 if scratch space is exhausted.
+ * If pivots is not NULL it receives the pivot column of each of the first
+ * rank rows. Rows are swapped by exchanging their pointers, so m->data no
+ * longer follows m->buf afterwards.
+ *
+ * Columns are processed in blocks of up to GF2_M4RM_BITS (Method of Four
+ * Russians Inversion): the block's pivot rows are found and reduced against
+ * each other, a table of all their sums is built, and every other row is then
+ * cleared in the whole block with a single table lookup and row XOR.
+ */
+static size_t gf2_rref(struct gf2matrix *m, size_t ncols, size_t *pivots)
+{
+	const size_t table_entries = (size_t)1 << GF2_M4RM_BITS;
+	gf2word_t *table = aligned_alloc(GF2MATRIX_ALIGN, table_entries * m->stride * sizeof(gf2word_t));
+	uint8_t *index = malloc(table_entries);
+
+	if (!table || !index) {
+		perror(__func__);
+		free(table);
+		free(index);
+		return (size_t)-1;
+	}
+
+	size_t rank = 0;
+	size_t col = 0;
+
+	while (rank < m->rows && col < ncols) {
+		const size_t w = col / GF2_WORD_BITS;
+		const size_t shift = col % GF2_WORD_BITS;
+		const size_t width =
+			min_size(min_size(GF2_M4RM_BITS, GF2_WORD_BITS - shift), ncols - col);
+		const unsigned block_mask = (1u << width) - 1;
+
+		/* Pivot offsets within the block and the block bits of each pivot row */
+		unsigned pcols[GF2_M4RM_BITS];
+		unsigned pbits[GF2_M4RM_BITS];
+		size_t found = 0;
+
+		for (size_t r = rank; r < m->rows && found < width; r++) {
+			unsigned bits = (m->data[r][w] >> shift) & block_mask;
+
+			/* Reduce the block bits by the pivots found so far */
+			for (size_t i = 0; i < found; i++)
+				if (bits >> pcols[i] & 0x1)
+					bits ^= pbits[i];
+
+			if (!bits)
+				continue;
+
+			/* New pivot: apply the same reduction to the whole row */
+			gf2word_t *row = m->data[r];
+
+			for (size_t i = 0; i < found; i++)
+				if (row[w] >> (shift + pcols[i]) & 0x1)
+					gf2_xor_row(row, m->data[rank + i], w, m->stride);
+
+			const unsigned pc = __builtin_ctz(bits);
+
+			/* Keep the pivot rows reduced against each other */
+			for (size_t i = 0; i < found; i++) {
+				if (pbits[i] >> pc & 0x1) {
+					gf2_xor_row(m->data[rank + i], row, w, m->stride);
+					pbits[i] ^= bits;
+				}
+			}
+
+			pcols[found] = pc;
+			pbits[found] = bits;
+			gf2_swap_rows(m, r, rank + found);
+			found++;
+		}
+
+		if (!found) {
+			col += width;
+			continue;
+		}
+
+		/* Order the pivot rows by column */
+		for (size_t i = 1; i < found; i++) {
+			for (size_t j = i; j > 0 && pcols[j - 1] > pcols[j]; j--) {
+				const unsigned pc = pcols[j];
+				const unsigned pb = pbits[j];
+
+				pcols[j] = pcols[j - 1];
+				pbits[j] = pbits[j - 1];
+				pcols[j - 1] = pc;
+				pbits[j - 1] = pb;
+				gf2_swap_rows(m, rank + j, rank + j - 1);
+			}
+		}
+
+		/* Entry x is the sum of the pivot rows selected by the bits of x */
+		const size_t entries = (size_t)1 << found;
+		const size_t len = m->stride - w;
+
+		memset(table, 0, len * sizeof(gf2word_t));
+		for (size_t x = 1; x < entries; x++) {
+			const gf2word_t *prev = table + (x & (x - 1)) * len;
+			const gf2word_t *prow = m->data[rank + __builtin_ctzll(x)] + w;
+			gf2word_t *entry = table + x * len;
+
+			for (size_t i = 0; i < len; i++)
+				entry[i] = prev[i] ^ prow[i];
+		}
+
+		/* Map the block bits of a row to the table entry that clears its pivot columns */
+		for (unsigned bits = 0; bits <= block_mask; bits++) {
+			unsigned x = 0;
+
+			for (size_t i = 0; i < found; i++)
+				x |= (bits >> pcols[i] & 0x1) << i;
+
+			index[bits] = x;
+		}
+
+		for (size_t r = 0; r < m->rows; r++) {
+			if (r == rank)
+				r += found;
+			if (r >= m->rows)
+				break;
+
+			gf2word_t *row = m->data[r] + w;
+			const unsigned x = index[(row[0] >> shift) & block_mask];
+
+			if (!x)
+				continue;
+
+			const gf2word_t *entry = table + x * len;
+
+			for (size_t i = 0; i < len; i++)
+				row[i] ^= entry[i];
+		}
+
+		for (size_t i = 0; i < found; i++)
+			if (pivots)
+				pivots[rank + i] = col + pcols[i];
+
+		rank += found;
+		col += width;
+	}
+
+	free(table);
+	free(index);
+
+	return rank;
+}
+
+size_t gf2mat_rank(const struct gf2matrix *m)
+{
+	if (!m) {
+		errno = EINVAL;
+		perror(__func__);
+		return 0;
+	}
+
+	struct gf2matrix *tmp_mat = gf2_augment(m, 0);
+	if (!tmp_mat)
+		return 0;
+
+	const size_t rank = gf2_rref(tmp_mat, m->cols, NULL);
+
+	gf2mat_free(tmp_mat);
+
+	return rank == (size_t)-1 ? 0 : rank;
+}
+
+struct gf2matrix *gf2mat_inv(struct gf2matrix *dest, const struct gf2matrix *src)
+{
+	if (!src || src->rows != src->cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct gf2matrix *res = dest;
+
+	if (res) {
+		if (res->rows != src->rows || res->cols != src->cols) {
+			errno = EINVAL;
+			perror(__func__);
+			return NULL;
+		}
+	} else {
+		res = gf2mat_alloc(src->rows, src->cols);
+		if (!res)
+			return NULL;
+	}
+
+	/* Eliminate on [src | I] */
+	struct gf2matrix *tmp_mat = gf2_augment(src, src->cols);
+	if (!tmp_mat)
+		goto error;
+
+	const size_t n = src->rows;
+
+	for (size_t r = 0; r < n; r++)
+		tmp_mat->data[r][src->stride + r / GF2_WORD_BITS] |= (gf2word_t)1
+								      << (r % GF2_WORD_BITS);
+
+	const size_t rank = gf2_rref(tmp_mat, n, NULL);
+
+	if (rank != n) {
+		if (rank != (size_t)-1)
+			fprintf(stderr, "%s: matrix is singular\n", __func__);
+		gf2mat_free(tmp_mat);
+		goto error;
+	}
+
+	for (size_t r = 0; r < n; r++)
+		memcpy(res->data[r], tmp_mat->data[r] + src->stride, res->stride * sizeof(gf2word_t));
+
+	gf2mat_free(tmp_mat);
+
+	return res;
+
+error:
+	if (!dest)
+		gf2mat_free(res);
+	return NULL;
+}
+
+size_t gf2mat_nullspace(struct gf2matrix **basis, const struct gf2matrix *m)
+{
+	if (!basis || !m) {
+		errno = EINVAL;
+		perror(__func__);
+		return (size_t)-1;
+	}
+
+	*basis = NULL;
+
+	struct gf2matrix *tmp_mat = gf2_augment(m, 0);
+	size_t *pivots = malloc(m->rows * sizeof(size_t));
+	bool *is_pivot = calloc(m->cols, sizeof(bool));
+	size_t dims = (size_t)-1;
+
+	if (!tmp_mat || !pivots || !is_pivot) {
+		perror(__func__);
+		goto out;
+	}
+
+	const size_t rank = gf2_rref(tmp_mat, m->cols, pivots);
+
+	if (rank == (size_t)-1)
+		goto out;
+
+	dims = m->cols - rank;
+	if (!dims)
+		goto out;
+
+	*basis = gf2mat_alloc(m->cols, dims);
+	if (!*basis) {
+		dims = (size_t)-1;
+		goto out;
+	}
+
+	for (size_t i = 0; i < rank; i++)
+		is_pivot[pivots[i]] = true;
+
+	/* Each free column f gives the vector with x_f = 1 and the pivot variables it forces */
+	for (size_t f = 0, j = 0; f < m->cols; f++) {
+		if (is_pivot[f])
+			continue;
+
+		const gf2word_t bit = (gf2word_t)1 << (j % GF2_WORD_BITS);
+
+		(*basis)->data[f][j / GF2_WORD_BITS] |= bit;
+
+		for (size_t i = 0; i < rank; i++)
+			if ((tmp_mat->data[i][f / GF2_WORD_BITS] >> (f % GF2_WORD_BITS)) & 0x1)
+				(*basis)->data[pivots[i]][j / GF2_WORD_BITS] |= bit;
+
+		j++;
+	}
+
+out:
+	gf2mat_free(tmp_mat);
+	free(pivots);
+	free(is_pivot);
+
+	return dims;
+}
+
+struct gf2matrix *gf2mat_solve(struct gf2matrix *dest,
+			       const struct gf2matrix *a,
+			       const struct gf2matrix *b)
+{
+	if (!a || !b || a->rows != b->rows) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct gf2matrix *res = dest;
+
+	if (res) {
+		if (res->rows != a->cols || res->cols != b->cols) {
+			errno = EINVAL;
+			perror(__func__);
+			return NULL;
+		}
+	} else {
+		res = gf2mat_alloc(a->cols, b->cols);
+		if (!res)
+			return NULL;
+	}
+
+	/* Eliminate on [a | b] */
+	struct gf2matrix *tmp_mat = gf2_augment(a, b->cols);
+	size_t *pivots = malloc(a->rows * sizeof(size_t));
+
+	if (!tmp_mat || !pivots) {
+		perror(__func__);
+		goto error;
+	}
+
+	for (size_t r = 0; r < a->rows; r++)
+		memcpy(tmp_mat->data[r] + a->stride, b->data[r], b->stride * sizeof(gf2word_t));
+
+	const size_t rank = gf2_rref(tmp_mat, a->cols, pivots);
+
+	if (rank == (size_t)-1)
+		goto error;
+
+	/* Rows reduced to zero on the left must be zero on the right as well */
+	for (size_t r = rank; r < a->rows; r++) {
+		for (size_t w = a->stride; w < tmp_mat->stride; w++) {
+			if (tmp_mat->data[r][w]) {
+				fprintf(stderr, "%s: system has no solution\n", __func__);
+				goto error;
+			}
+		}
+	}
+
+	gf2mat_reset(res);
+
+	for (size_t i = 0; i < rank; i++)
+		memcpy(res->data[pivots[i]], tmp_mat->data[i] + a->stride, res->stride * sizeof(gf2word_t));
+
+	gf2mat_free(tmp_mat);
+	free(pivots);
+
+	return res;
+
+error:
+	gf2mat_free(tmp_mat);
+	free(pivots);
+	if (!dest)
+		gf2mat_free(res);
+	return NULL;
+}
+
+struct gf2matrix *gf2mat_from_mat(struct gf2matrix *dest, const struct matrix *src)
+{
+	if (!src) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	if (dest) {
+		if (dest->rows != src->rows || dest->cols != src->cols) {
+			errno = EINVAL;
+			perror(__func__);
+			return NULL;
+		}
+	} else {
+		dest = gf2mat_alloc(src->rows, src->cols);
+		if (!dest)
+			return NULL;
+	}
+
+	for (size_t r = 0; r < src->rows; r++) {
+		gf2word_t *d = dest->data[r];
+
+		memset(d, 0, dest->stride * sizeof(gf2word_t));
+		for (size_t c = 0; c < src->cols; c++)
+			d[c / GF2_WORD_BITS] |= (gf2word_t)(*gf2_mat_at(src, r, c) & 0x1) << (c % GF2_WORD_BITS);
+	}
+
+	return dest;
+}
+
+struct matrix *gf2mat_to_mat(struct matrix *dest, const struct gf2matrix *src)
+{
+	if (!src) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	if (dest) {
+		if (dest->rows != src->rows || dest->cols != src->cols) {
+			errno = EINVAL;
+			perror(__func__);
+			return NULL;
+		}
+	} else {
+		dest = mat_alloc(src->rows, src->cols);
+		if (!dest)
+			return NULL;
+	}
+
+	for (size_t r = 0; r < src->rows; r++)
+		for (size_t c = 0; c < src->cols; c++)
+			*gf2_mat_at(dest, r, c) = (src->data[r][c / GF2_WORD_BITS] >> (c % GF2_WORD_BITS)) & 0x1;
+
+	return dest;
+}
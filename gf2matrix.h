@@ -0,0 +1,88 @@
+#ifndef GF2MATRIX_H
+#define GF2MATRIX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "matrix.h"
+
+/* Word holding 64 packed GF(2) elements */
+typedef uint64_t gf2word_t;
+
+#define GF2_WORD_BITS 64
+
+/* Alignment in bytes of the word slab */
+#define GF2MATRIX_ALIGN 64
+
+/*
+ * Bit-packed matrix over GF(2). Column c of row r is bit c % 64 of word
+ * c / 64 of data[r]; bits past the last column are kept zero. Rows are
+ * stride words apart in buf, and data is a row-pointer view onto buf.
+ */
+struct gf2matrix {
+	const size_t cols, rows;
+	gf2word_t **data;
+	gf2word_t *buf;
+	size_t stride;
+};
+
+/* Allocate an empty GF(2) matrix */
+struct gf2matrix *gf2mat_alloc(const size_t rows, const size_t cols);
+/* Delete a GF(2) matrix */
+void gf2mat_free(struct gf2matrix *m);
+
+/* Set the GF(2) matrix to an identity matrix */
+void gf2mat_set_identity(struct gf2matrix *m);
+/* Allocate a new identity GF(2) matrix */
+struct gf2matrix *gf2mat_identity_new(const size_t dims);
+
+/* Set a single field of a GF(2) matrix */
+void gf2mat_set(struct gf2matrix *m, size_t row, size_t col, bool val);
+/* Get a single field of a GF(2) matrix */
+bool gf2mat_get(const struct gf2matrix *m, size_t row, size_t col);
+/* Reset all fields of a GF(2) matrix */
+void gf2mat_reset(struct gf2matrix *m);
+/* Set a row to the bits of an integer, most significant bit in the first column */
+void gf2mat_set_row(struct gf2matrix *m, size_t row, unsigned long long bits);
+
+/* Print a GF(2) matrix */
+void gf2mat_print(const struct gf2matrix *m);
+
+/* Add two GF(2) matrices (XOR); subtraction is the same operation */
+struct gf2matrix *gf2mat_add(struct gf2matrix *dest,
+			     const struct gf2matrix *a,
+			     const struct gf2matrix *b);
+/* Multiply two GF(2) matrices with the Method of Four Russians */
+struct gf2matrix *gf2mat_mul(struct gf2matrix *dest,
+			     const struct gf2matrix *a,
+			     const struct gf2matrix *b);
+/* Transpose a GF(2) matrix */
+struct gf2matrix *gf2mat_trans(struct gf2matrix *dest, const struct gf2matrix *src);
+/* Copy a GF(2) matrix */
+struct gf2matrix *gf2mat_copy(struct gf2matrix *dest, const struct gf2matrix *src);
+
+/* Compute the rank of a GF(2) matrix */
+size_t gf2mat_rank(const struct gf2matrix *m);
+/* Compute the inverse of a GF(2) matrix */
+struct gf2matrix *gf2mat_inv(struct gf2matrix *dest, const struct gf2matrix *src);
+/*
+ * Compute a basis of the nullspace of a GF(2) matrix. On success *basis is a
+ * new cols x k matrix whose columns span the nullspace, or NULL if k is 0.
+ * Returns k, or (size_t)-1 on error.
+ */
+size_t gf2mat_nullspace(struct gf2matrix **basis, const struct gf2matrix *m);
+/* Solve a * x = b over GF(2); free variables of an underdetermined system are zero */
+struct gf2matrix *gf2mat_solve(struct gf2matrix *dest,
+			       const struct gf2matrix *a,
+			       const struct gf2matrix *b);
+
+/* Compare two GF(2) matrices */
+bool gf2mat_equal(const struct gf2matrix *a, const struct gf2matrix *b);
+
+/* Convert an integer matrix to GF(2), keeping the lowest bit of every element */
+struct gf2matrix *gf2mat_from_mat(struct gf2matrix *dest, const struct matrix *src);
+/* Convert a GF(2) matrix to an integer matrix of zeros and ones */
+struct matrix *gf2mat_to_mat(struct matrix *dest, const struct gf2matrix *src);
+
+#endif /* GF2MATRIX_H */
@@ -0,0 +1,30 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stddef.h>
+
+#include "allocator.h"
+#include "fmatrix.h"
+#include "matrix.h"
+
+/*
+ * Storage layout of integer and floating-point matrices, for the modules that
+ * place matrices in memory or on disk themselves, so every matrix is laid out
+ * as mat_alloc and fmat_alloc would. Not part of the public API.
+ */
+
+/* Row stride for cols columns, rounded up so every row starts on a MATRIX_ALIGN boundary */
+size_t mat_stride(size_t cols);
+/* Bytes of the block holding a matrix: the struct, its row table and the aligned slab */
+size_t mat_block_size(size_t rows, size_t stride);
+/* Lay out a zeroed rows x cols matrix in block, which is aligned and holds mat_block_size bytes */
+struct matrix *mat_layout(unsigned char *block, size_t rows, size_t cols, const struct mat_allocator *alloc);
+
+/* Row stride for cols columns, rounded up so every row starts on a FMATRIX_ALIGN boundary */
+size_t fmat_stride(size_t cols);
+/* Bytes of the block holding a floating-point matrix: the struct, its row table and the aligned slab */
+size_t fmat_block_size(size_t rows, size_t stride);
+/* Lay out a zeroed rows x cols floating-point matrix in block, which is aligned and holds fmat_block_size bytes */
+struct fmatrix *fmat_layout(unsigned char *block, size_t rows, size_t cols, const struct mat_allocator *alloc);
+
+#endif /* LAYOUT_H */
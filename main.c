@@ -1,4 +1,5 @@
 #include "fmatrix.h"
+#include "gf2matrix.h"
 #include "matrix.h"
 
 int main(void)
@@ -124,5 +125,39 @@ int main(void)
 	fmat_free(FIINV);
 	fmat_free(FINV);
 
+	/* ---------------- GF(2) matrices ---------------- */
+	struct gf2matrix *GA = gf2mat_alloc(3, 3);
+	struct gf2matrix *GB = gf2mat_identity_new(3);
+
+	/* Fill GA */
+	gf2mat_set_row(GA, 0, 0b110);
+	gf2mat_set_row(GA, 1, 0b011);
+	gf2mat_set_row(GA, 2, 0b101);
+
+	/* Perform addition, multiplication and transposition */
+	struct gf2matrix *GC = gf2mat_add(NULL, GA, GB);
+	struct gf2matrix *GM = gf2mat_mul(NULL, GA, GC);
+	struct gf2matrix *GT = gf2mat_trans(NULL, GM);
+
+	/* Convert to and from integer matrices */
+	struct matrix *GI = gf2mat_to_mat(NULL, GT);
+	struct gf2matrix *GD = gf2mat_from_mat(NULL, GI);
+
+	/* Eliminate: GA is singular, GC is a permutation */
+	struct gf2matrix *GN = NULL;
+	gf2mat_nullspace(&GN, GA);
+	struct gf2matrix *GCINV = gf2mat_inv(NULL, GC);
+
+	/* Free GF(2) matrices */
+	gf2mat_free(GA);
+	gf2mat_free(GB);
+	gf2mat_free(GC);
+	gf2mat_free(GM);
+	gf2mat_free(GT);
+	gf2mat_free(GD);
+	gf2mat_free(GN);
+	gf2mat_free(GCINV);
+	mat_free(GI);
+
 	return 0;
 }
@@ -0,0 +1,521 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "layout.h"
+#include "matfile.h"
+
+/* Elements are stored as 64-bit words, whichever the type */
+#define MATFILE_WORD sizeof(uint64_t)
+
+/* Multipliers of the checksum, from xxHash64 */
+#define MATFILE_P1 0x9E3779B185EBCA87ULL
+#define MATFILE_P2 0xC2B2AE3D27D4EB4FULL
+#define MATFILE_P3 0x165667B19E3779F9ULL
+
+_Static_assert(sizeof(val_t) == MATFILE_WORD && sizeof(fval_t) == MATFILE_WORD, "elements must be 64-bit");
+
+/*
+ * Checksum of a stream of 64-bit words. Four lanes take every fourth word each,
+ * so consecutive words hash in parallel and the checksum keeps up with reading
+ * the file; the lanes are mixed together at the end.
+ */
+struct matfile_hash {
+	uint64_t lane[4];
+	uint64_t words;
+};
+
+/* Record of a mapped file, freed with the matrix through its allocator */
+struct matfile_map {
+	struct mat_allocator alloc;
+	void *addr;
+	size_t len;
+};
+
+/* Row length in the file, the stride a matrix of type has in memory */
+static size_t matfile_stride(uint8_t type, size_t cols)
+{
+	return type == MATFILE_INT64 ? mat_stride(cols) : fmat_stride(cols);
+}
+
+/* Alignment of the rows of a matrix of type in memory */
+static size_t matfile_align(uint8_t type)
+{
+	return type == MATFILE_INT64 ? MATRIX_ALIGN : FMATRIX_ALIGN;
+}
+
+static uint64_t matfile_rotl(uint64_t x, int r)
+{
+	return x << r | x >> (64 - r);
+}
+
+static uint64_t matfile_round(uint64_t lane, uint64_t w)
+{
+	return matfile_rotl(lane + w * MATFILE_P2, 31) * MATFILE_P1;
+}
+
+/* Word at p, which holds it in the other byte order if swap is set */
+static uint64_t matfile_word(const unsigned char *p, bool swap)
+{
+	uint64_t w;
+
+	memcpy(&w, p, sizeof(w));
+
+	return swap ? __builtin_bswap64(w) : w;
+}
+
+static void matfile_hash_init(struct matfile_hash *h)
+{
+	*h = (struct matfile_hash){
+		.lane = { MATFILE_P1 + MATFILE_P2, MATFILE_P2, 0, -MATFILE_P1 },
+	};
+}
+
+/* Hash n words at p, stored in the other byte order if swap is set */
+static void matfile_hash_update(struct matfile_hash *h, const void *p, size_t n, bool swap)
+{
+	const unsigned char *q = p;
+	size_t i = 0;
+
+	/* Whole groups of four words while the lanes are in step */
+	if (!(h->words & 3)) {
+		uint64_t l0 = h->lane[0], l1 = h->lane[1], l2 = h->lane[2], l3 = h->lane[3];
+
+		for (; i + 4 <= n; i += 4, q += 4 * MATFILE_WORD) {
+			l0 = matfile_round(l0, matfile_word(q, swap));
+			l1 = matfile_round(l1, matfile_word(q + MATFILE_WORD, swap));
+			l2 = matfile_round(l2, matfile_word(q + 2 * MATFILE_WORD, swap));
+			l3 = matfile_round(l3, matfile_word(q + 3 * MATFILE_WORD, swap));
+		}
+
+		h->lane[0] = l0, h->lane[1] = l1, h->lane[2] = l2, h->lane[3] = l3;
+		h->words += i;
+	}
+
+	for (; i < n; i++, q += MATFILE_WORD, h->words++)
+		h->lane[h->words & 3] = matfile_round(h->lane[h->words & 3], matfile_word(q, swap));
+}
+
+static uint64_t matfile_hash_final(const struct matfile_hash *h)
+{
+	uint64_t x = matfile_rotl(h->lane[0], 1) + matfile_rotl(h->lane[1], 7) +
+		     matfile_rotl(h->lane[2], 12) + matfile_rotl(h->lane[3], 18) + h->words * MATFILE_WORD;
+
+	x ^= x >> 33;
+	x *= MATFILE_P2;
+	x ^= x >> 29;
+	x *= MATFILE_P3;
+	x ^= x >> 32;
+
+	return x;
+}
+
+/* Checksum of the header fields before header_checksum */
+static uint64_t matfile_header_checksum(const struct matfile_header *hdr, bool swap)
+{
+	struct matfile_hash h;
+
+	matfile_hash_init(&h);
+	matfile_hash_update(&h, hdr, offsetof(struct matfile_header, header_checksum) / MATFILE_WORD, swap);
+
+	return matfile_hash_final(&h);
+}
+
+/* Bring the fields of a header written in the other byte order into ours */
+static void matfile_header_swap(struct matfile_header *hdr)
+{
+	hdr->byte_order = __builtin_bswap32(hdr->byte_order);
+	hdr->version = __builtin_bswap16(hdr->version);
+	hdr->rows = __builtin_bswap64(hdr->rows);
+	hdr->cols = __builtin_bswap64(hdr->cols);
+	hdr->stride = __builtin_bswap64(hdr->stride);
+	hdr->align = __builtin_bswap64(hdr->align);
+	hdr->data_offset = __builtin_bswap64(hdr->data_offset);
+	hdr->checksum = __builtin_bswap64(hdr->checksum);
+	hdr->header_checksum = __builtin_bswap64(hdr->header_checksum);
+}
+
+/*
+ * Write a rows x cols matrix of type to path, element (r, c) of which is word
+ * c of data[r], or word r of data[c] if trans is set. The rows go to a
+ * temporary file beside path that replaces it once it is complete and synced.
+ */
+static bool matfile_save(const char *path, uint8_t type, size_t rows, size_t cols, const void *const *data, bool trans)
+{
+	const size_t stride = matfile_stride(type, cols);
+	const size_t align = matfile_align(type);
+	/* The rows start on the first align boundary past the header */
+	const size_t offset = (sizeof(struct matfile_header) + align - 1) & ~(align - 1);
+	const size_t tmp_len = strlen(path) + 32;
+	char *tmp = malloc(tmp_len);
+	uint64_t *row = calloc(stride, MATFILE_WORD);
+
+	if (!tmp || !row) {
+		free(tmp);
+		free(row);
+		return false;
+	}
+
+	snprintf(tmp, tmp_len, "%s.%ld.tmp", path, (long)getpid());
+
+	const int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	FILE *f = fd < 0 ? NULL : fdopen(fd, "wb");
+	if (!f) {
+		const int err = errno;
+
+		if (fd >= 0) {
+			close(fd);
+			unlink(tmp);
+		}
+		free(tmp);
+		free(row);
+		errno = err;
+		return false;
+	}
+
+	struct matfile_header hdr = {
+		.byte_order = MATFILE_BYTE_ORDER,
+		.version = MATFILE_VERSION,
+		.type = type,
+		.elem_size = MATFILE_WORD,
+		.rows = rows,
+		.cols = cols,
+		.stride = stride,
+		.align = align,
+		.data_offset = offset,
+	};
+	memcpy(hdr.magic, MATFILE_MAGIC, sizeof(hdr.magic));
+
+	/* The header goes in last, once the checksum of the rows is known */
+	struct matfile_hash h;
+	bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 && fseek(f, (long)offset, SEEK_SET) == 0;
+
+	matfile_hash_init(&h);
+
+	for (size_t r = 0; r < rows && ok; r++) {
+		if (trans) {
+			for (size_t c = 0; c < cols; c++)
+				memcpy(&row[c], (const unsigned char *)data[c] + r * MATFILE_WORD, MATFILE_WORD);
+		} else {
+			memcpy(row, data[r], cols * MATFILE_WORD);
+		}
+
+		matfile_hash_update(&h, row, stride, false);
+		ok = fwrite(row, MATFILE_WORD, stride, f) == stride;
+	}
+
+	hdr.checksum = matfile_hash_final(&h);
+	hdr.header_checksum = matfile_header_checksum(&hdr, false);
+
+	ok = ok && fseek(f, 0, SEEK_SET) == 0 && fwrite(&hdr, sizeof(hdr), 1, f) == 1 && fflush(f) == 0 &&
+	     fsync(fileno(f)) == 0;
+	ok = !fclose(f) && ok;
+	ok = ok && rename(tmp, path) == 0;
+
+	if (!ok) {
+		const int err = errno;
+
+		unlink(tmp);
+		errno = err;
+	}
+
+	free(tmp);
+	free(row);
+
+	return ok;
+}
+
+/* Check a header of a file of len bytes for elements of type, swapping it into our byte order */
+static bool matfile_check(struct matfile_header *hdr, size_t len, uint8_t type, bool *swap)
+{
+	if (memcmp(hdr->magic, MATFILE_MAGIC, sizeof(hdr->magic)))
+		return false;
+
+	*swap = hdr->byte_order == __builtin_bswap32(MATFILE_BYTE_ORDER);
+	if (!*swap && hdr->byte_order != MATFILE_BYTE_ORDER)
+		return false;
+
+	/* The checksum covers the header as written, so take it before swapping */
+	const uint64_t sum = matfile_header_checksum(hdr, *swap);
+
+	if (*swap)
+		matfile_header_swap(hdr);
+
+	if (sum != hdr->header_checksum || hdr->version != MATFILE_VERSION || hdr->type != type ||
+	    hdr->elem_size != MATFILE_WORD || !hdr->rows || !hdr->cols || hdr->stride < hdr->cols ||
+	    hdr->stride > SIZE_MAX / MATFILE_WORD || !hdr->align || hdr->align & (hdr->align - 1))
+		return false;
+
+	/*
+	 * The rows are used where they lie, so they must start on our alignment
+	 * whatever the writer's was; the file's own stride is taken as it is
+	 */
+	const size_t align = matfile_align(type);
+
+	return hdr->stride * MATFILE_WORD % hdr->align == 0 && hdr->data_offset % hdr->align == 0 &&
+	       hdr->stride * MATFILE_WORD % align == 0 && hdr->data_offset % align == 0 &&
+	       hdr->data_offset >= sizeof(*hdr) && hdr->data_offset <= len &&
+	       hdr->rows <= (len - hdr->data_offset) / MATFILE_WORD / hdr->stride;
+}
+
+/*
+ * Map the file at path and check that it holds a matrix of type. Pages are
+ * mapped copy-on-write, so they stay shared with every other process mapping
+ * the file until written. NULL with errno set on failure.
+ */
+static unsigned char *matfile_open(const char *path, uint8_t type, unsigned flags, struct matfile_header *hdr,
+				   size_t *len, bool *swap)
+{
+	const int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	struct stat st;
+	if (fstat(fd, &st)) {
+		const int err = errno;
+
+		close(fd);
+		errno = err;
+		return NULL;
+	}
+
+	if ((size_t)st.st_size < sizeof(*hdr)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	*len = (size_t)st.st_size;
+	unsigned char *addr = mmap(NULL, *len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	const int err = errno;
+
+	/* The mapping keeps the file open */
+	close(fd);
+
+	if (addr == MAP_FAILED) {
+		errno = err;
+		return NULL;
+	}
+
+	memcpy(hdr, addr, sizeof(*hdr));
+
+	bool ok = matfile_check(hdr, *len, type, swap);
+
+	if (ok && (flags & MAT_MAP_VERIFY)) {
+		struct matfile_hash h;
+
+		matfile_hash_init(&h);
+		matfile_hash_update(&h, addr + hdr->data_offset, hdr->rows * hdr->stride, *swap);
+		ok = matfile_hash_final(&h) == hdr->checksum;
+	}
+
+	if (!ok) {
+		munmap(addr, *len);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return addr;
+}
+
+/* Refuse allocations: a mapped matrix's allocator only ever frees */
+static void *matfile_no_alloc(void *ctx, size_t bytes, size_t align)
+{
+	(void)ctx;
+	(void)bytes;
+	(void)align;
+
+	return NULL;
+}
+
+/* Release a mapped matrix: unmap the file and free the block holding the record */
+static void matfile_unmap(void *ctx, void *p, size_t bytes)
+{
+	struct matfile_map *map = ctx;
+
+	(void)p;
+	(void)bytes;
+
+	munmap(map->addr, map->len);
+	free(map);
+}
+
+/* Set up the record of a mapping at the start of block, which the matrix follows */
+static const struct mat_allocator *matfile_map_init(unsigned char *block, void *addr, size_t len)
+{
+	struct matfile_map *map = (struct matfile_map *)block;
+
+	*map = (struct matfile_map){
+		.alloc = { .alloc = matfile_no_alloc, .free = matfile_unmap, .ctx = map },
+		.addr = addr,
+		.len = len,
+	};
+
+	return &map->alloc;
+}
+
+bool mat_save(const struct matrix *m, const char *path)
+{
+	if (!m || !path) {
+		errno = EINVAL;
+		perror(__func__);
+		return false;
+	}
+
+	if (!matfile_save(path, MATFILE_INT64, m->rows, m->cols, (const void *const *)m->data,
+			  m->flags & MAT_TRANSPOSED)) {
+		perror(__func__);
+		return false;
+	}
+
+	return true;
+}
+
+struct matrix *mat_map(const char *path, unsigned flags)
+{
+	if (!path) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct matfile_header hdr;
+	size_t len;
+	bool swap;
+	unsigned char *addr = matfile_open(path, MATFILE_INT64, flags, &hdr, &len, &swap);
+	if (!addr) {
+		perror(__func__);
+		return NULL;
+	}
+
+	const val_t *src = (const val_t *)(addr + hdr.data_offset);
+
+	/* Elements in the other byte order cannot be used in place */
+	if (swap) {
+		struct matrix *m = mat_alloc(hdr.rows, hdr.cols);
+
+		for (size_t r = 0; m && r < m->rows; r++)
+			for (size_t c = 0; c < m->cols; c++)
+				m->data[r][c] = (val_t)matfile_word((const unsigned char *)&src[r * hdr.stride + c], true);
+
+		munmap(addr, len);
+		return m;
+	}
+
+	/* The record of the mapping, the struct and the row table share one block */
+	unsigned char *block = malloc(sizeof(struct matfile_map) + sizeof(struct matrix) + hdr.rows * sizeof(val_t *));
+	if (!block) {
+		munmap(addr, len);
+		errno = ENOMEM;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct matrix *m = (struct matrix *)(block + sizeof(struct matfile_map));
+	val_t **data = (val_t **)(block + sizeof(struct matfile_map) + sizeof(struct matrix));
+	val_t *buf = (val_t *)src;
+
+	/* Copy over a temporary matrix that holds the const rows and columns */
+	struct matrix m_temp = {
+		.cols = hdr.cols,
+		.rows = hdr.rows,
+		.data = data,
+		.buf = buf,
+		.stride = hdr.stride,
+		.alloc = matfile_map_init(block, addr, len),
+	};
+	memcpy(m, &m_temp, sizeof(struct matrix));
+
+	for (size_t r = 0; r < m->rows; r++)
+		data[r] = buf + r * m->stride;
+
+	return m;
+}
+
+bool fmat_save(const struct fmatrix *m, const char *path)
+{
+	if (!m || !path) {
+		errno = EINVAL;
+		perror(__func__);
+		return false;
+	}
+
+	if (!matfile_save(path, MATFILE_FLOAT64, m->rows, m->cols, (const void *const *)m->data,
+			  m->flags & FMAT_TRANSPOSED)) {
+		perror(__func__);
+		return false;
+	}
+
+	return true;
+}
+
+struct fmatrix *fmat_map(const char *path, unsigned flags)
+{
+	if (!path) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct matfile_header hdr;
+	size_t len;
+	bool swap;
+	unsigned char *addr = matfile_open(path, MATFILE_FLOAT64, flags, &hdr, &len, &swap);
+	if (!addr) {
+		perror(__func__);
+		return NULL;
+	}
+
+	const fval_t *src = (const fval_t *)(addr + hdr.data_offset);
+
+	/* Elements in the other byte order cannot be used in place */
+	if (swap) {
+		struct fmatrix *m = fmat_alloc(hdr.rows, hdr.cols);
+
+		for (size_t r = 0; m && r < m->rows; r++) {
+			for (size_t c = 0; c < m->cols; c++) {
+				const uint64_t w = matfile_word((const unsigned char *)&src[r * hdr.stride + c], true);
+
+				memcpy(&m->data[r][c], &w, sizeof(w));
+			}
+		}
+
+		munmap(addr, len);
+		return m;
+	}
+
+	/* The record of the mapping, the struct and the row table share one block */
+	unsigned char *block = malloc(sizeof(struct matfile_map) + sizeof(struct fmatrix) + hdr.rows * sizeof(fval_t *));
+	if (!block) {
+		munmap(addr, len);
+		errno = ENOMEM;
+		perror(__func__);
+		return NULL;
+	}
+
+	struct fmatrix *m = (struct fmatrix *)(block + sizeof(struct matfile_map));
+	fval_t **data = (fval_t **)(block + sizeof(struct matfile_map) + sizeof(struct fmatrix));
+	fval_t *buf = (fval_t *)src;
+
+	/* Copy over a temporary matrix that holds the const rows and columns */
+	struct fmatrix m_temp = {
+		.cols = hdr.cols,
+		.rows = hdr.rows,
+		.data = data,
+		.buf = buf,
+		.stride = hdr.stride,
+		.alloc = matfile_map_init(block, addr, len),
+	};
+	memcpy(m, &m_temp, sizeof(struct fmatrix));
+
+	for (size_t r = 0; r < m->rows; r++)
+		data[r] = buf + r * m->stride;
+
+	return m;
+}
@@ -0,0 +1,68 @@
+#ifndef MATFILE_H
+#define MATFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fmatrix.h"
+#include "matrix.h"
+
+/*
+ * Binary matrix files. A 128-byte header is followed by the elements laid out
+ * exactly as in memory: rows of stride elements, each starting on an align
+ * boundary of the file. Any file whose rows start on MATRIX_ALIGN boundaries
+ * maps in place, whatever stride and alignment it was written with. Loading maps the file and points the
+ * matrix straight at it, so opening a matrix of any size costs one mmap and
+ * its row table, pages are read in on first touch and processes mapping the
+ * same file share them in the page cache.
+ */
+
+#define MATFILE_MAGIC "MATBIN\r\n"
+#define MATFILE_VERSION 2
+/* Written in the writer's byte order; reads back swapped on the other one */
+#define MATFILE_BYTE_ORDER 0x01020304u
+
+/* Element types */
+#define MATFILE_INT64 1
+#define MATFILE_FLOAT64 2
+
+struct matfile_header {
+	char magic[8];
+	uint32_t byte_order;
+	uint16_t version;
+	/* MATFILE_* element type and element size in bytes */
+	uint8_t type, elem_size;
+	uint64_t rows, cols, stride;
+	/* Alignment in bytes of the rows in the file, a power of two */
+	uint64_t align;
+	/* Offset of the first row from the start of the file, a multiple of align */
+	uint64_t data_offset;
+	uint64_t reserved[7];
+	/* Checksum of the rows * stride elements, padding included */
+	uint64_t checksum;
+	/* Checksum of the header up to this field */
+	uint64_t header_checksum;
+};
+
+/* Also check the element checksum on mapping, which reads the whole file */
+#define MAT_MAP_VERIFY 0x1
+
+/*
+ * Write m to path. The file is written next to path and renamed over it once
+ * complete, so processes that still map the old file keep a consistent copy.
+ */
+bool mat_save(const struct matrix *m, const char *path);
+/*
+ * Map a matrix saved by mat_save. The matrix reads the file's pages directly;
+ * writes to it are private to the process and never reach the file. A file
+ * written on a machine of the other byte order is copied into a new matrix
+ * instead. mat_free unmaps it.
+ */
+struct matrix *mat_map(const char *path, unsigned flags);
+
+/* Write a floating-point matrix to path, as mat_save */
+bool fmat_save(const struct fmatrix *m, const char *path);
+/* Map a floating-point matrix saved by fmat_save, as mat_map */
+struct fmatrix *fmat_map(const char *path, unsigned flags);
+
+#endif /* MATFILE_H */
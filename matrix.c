@@ -1,8 +1,94 @@
-#include <ctype.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+#include "fkernels.h"
+#include "layout.h"
 #include "matrix.h"
+#include "parse.h"
+#include "threadpool.h"
+
+size_t mat_stride(size_t cols)
+{
+	const size_t per_line = MATRIX_ALIGN / sizeof(val_t);
+
+	return (cols + per_line - 1) / per_line * per_line;
+}
+
+/* Number of slab elements spanned by a matrix, from its first to its last element */
+static size_t mat_span(const struct matrix *m)
+{
+	return (m->rows - 1) * m->stride + m->cols;
+}
+
+/* True if both matrices keep their elements in slabs with the same row stride */
+static bool mat_same_layout(const struct matrix *a, const struct matrix *b)
+{
+	return a->buf && b->buf && a->stride == b->stride;
+}
+
+/* Element (r, c) of a matrix or view */
+static inline val_t *mat_at(const struct matrix *m, size_t r, size_t c)
+{
+	return m->flags & MAT_TRANSPOSED ? &m->data[c][r] : &m->data[r][c];
+}
+
+/* The matrix a view reads, in its stored orientation */
+static struct matrix mat_storage(const struct matrix *m)
+{
+	if (!(m->flags & MAT_TRANSPOSED))
+		return *m;
+
+	return (struct matrix){
+		.cols = m->rows, .rows = m->cols, .data = m->data, .buf = m->buf, .stride = m->stride
+	};
+}
+
+/* True if both matrices are read in the same orientation */
+static bool mat_same_orientation(const struct matrix *a, const struct matrix *b)
+{
+	return !((a->flags ^ b->flags) & MAT_TRANSPOSED);
+}
+
+/* Offset of the slab in the block holding a matrix, after the struct and row table */
+static size_t mat_buf_offset(size_t rows)
+{
+	const size_t head = sizeof(struct matrix) + rows * sizeof(val_t *);
+
+	return (head + MATRIX_ALIGN - 1) / MATRIX_ALIGN * MATRIX_ALIGN;
+}
+
+/* Bytes of the block holding a view over rows stored rows: the struct and its row table */
+static size_t mat_view_size(size_t rows)
+{
+	return sizeof(struct matrix) + rows * sizeof(val_t *);
+}
+
+size_t mat_block_size(size_t rows, size_t stride)
+{
+	return mat_buf_offset(rows) + rows * stride * sizeof(val_t);
+}
+
+struct matrix *mat_layout(unsigned char *block, size_t rows, size_t cols, const struct mat_allocator *alloc)
+{
+	const size_t stride = mat_stride(cols);
+	struct matrix *m = (struct matrix *)block;
+	val_t **data = (val_t **)(block + sizeof(struct matrix));
+	val_t *buf = (val_t *)(block + mat_buf_offset(rows));
+
+	/* Copy over a temporary matrix that holds the const rows and columns */
+	struct matrix m_temp = {
+		.cols = cols, .rows = rows, .data = data, .buf = buf, .stride = stride, .alloc = alloc
+	};
+	memcpy(m, &m_temp, sizeof(struct matrix));
+
+	memset(buf, 0, rows * stride * sizeof(val_t));
+
+	for (size_t row = 0; row < rows; row++)
+		data[row] = buf + row * stride;
+
+	return m;
+}
 
 struct matrix *mat_alloc(const size_t rows, const size_t cols)
 {
@@ -12,63 +98,116 @@ struct matrix *mat_alloc(const size_t rows, const size_t cols)
 		return NULL;
 	}
 
-	size_t row;
+	const size_t stride = mat_stride(cols);
 
-	/* Allocate the struct */
-	struct matrix *m = malloc(sizeof(struct matrix));
-	if (!m) {
+	if (rows > SIZE_MAX / 2 / sizeof(val_t) / stride) {
+		errno = ENOMEM;
 		perror(__func__);
-		goto error;
+		return NULL;
 	}
 
-	/* Copy over a temporary matrix that holds the const rows and columns */
-	struct matrix m_temp = { .cols = cols, .rows = rows, .data = NULL };
-	memcpy(m, &m_temp, sizeof(struct matrix));
-
-	/* Allocate the rows */
-	m->data = calloc(rows, sizeof(val_t *));
-	if (!m->data) {
+	/* The struct, the row-pointer table and the aligned slab share one block */
+	const struct mat_allocator *alloc = mat_allocator_get();
+	unsigned char *block = alloc->alloc(alloc->ctx, mat_block_size(rows, stride), MATRIX_ALIGN);
+	if (!block) {
+		errno = ENOMEM;
 		perror(__func__);
-		goto error_rows;
+		return NULL;
 	}
 
-	/* Allocate the columns */
-	for (row = 0; row < rows; row++) {
-		m->data[row] = calloc(cols, sizeof(val_t));
-		if (!m->data[row]) {
-			perror(__func__);
-			goto error_columns;
-		}
+	return mat_layout(block, rows, cols, alloc);
+}
+
+void mat_free(struct matrix *m)
+{
+	if (!m || !m->alloc)
+		return;
+
+	if (m->flags & MAT_VIEW) {
+		m->alloc->free(m->alloc->ctx, m, mat_view_size(mat_storage(m).rows));
+		return;
 	}
 
-	return m;
+	m->alloc->free(m->alloc->ctx, m, mat_block_size(m->rows, m->stride));
+}
 
-error_columns:
-	while (row > 0) {
-		row--;
-		free(m->data[row]);
+struct matrix *mat_inline(void *storage, size_t bytes, size_t rows, size_t cols)
+{
+	if (!storage || !rows || !cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
 	}
 
-	free(m->data);
-error_rows:
-	free(m);
-error:
-	return NULL;
+	const size_t stride = mat_stride(cols);
+
+	/* The first two bounds keep the block size from overflowing */
+	const bool fits = (uintptr_t)storage % MATRIX_ALIGN == 0 && rows <= bytes / sizeof(val_t *) &&
+			  stride <= bytes / sizeof(val_t) / rows && mat_block_size(rows, stride) <= bytes;
+
+	if (fits)
+		return mat_layout(storage, rows, cols, NULL);
+
+	/* Too large for the inline buffer: take the storage from the spill pool instead */
+	const struct mat_allocator *prev = mat_allocator_set(mat_spill_allocator());
+	struct matrix *m = mat_alloc(rows, cols);
+
+	mat_allocator_set(prev);
+
+	return m;
 }
 
-void mat_free(struct matrix *m)
+void mat_scope_free(struct matrix **m)
 {
-	if (!m)
-		return;
+	mat_free(*m);
+}
 
-	for (size_t row = 0; row < m->rows; row++)
-		if (m->data[row])
-			free(m->data[row]);
+struct matrix *mat_block_view(const struct matrix *m, size_t row, size_t col, size_t rows, size_t cols)
+{
+	if (!m || !rows || !cols || row > m->rows || rows > m->rows - row || col > m->cols ||
+	    cols > m->cols - col) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	/* Carve the block out of the storage; a transposed parent gives a transposed view */
+	const bool trans = m->flags & MAT_TRANSPOSED;
+	const struct matrix storage = mat_storage(m);
+	const size_t srow = trans ? col : row;
+	const size_t scol = trans ? row : col;
+	const size_t srows = trans ? cols : rows;
+	const size_t scols = trans ? rows : cols;
+
+	const struct mat_allocator *alloc = mat_allocator_get();
+	unsigned char *block = alloc->alloc(alloc->ctx, mat_view_size(srows), MATRIX_ALIGN);
+	if (!block) {
+		errno = ENOMEM;
+		perror(__func__);
+		return NULL;
+	}
 
-	if (m->data)
-		free(m->data);
+	struct matrix *v = (struct matrix *)block;
+	val_t **data = (val_t **)(block + sizeof(struct matrix));
+	/* A block of whole rows is still one run of the parent's slab */
+	val_t *buf = storage.buf && !scol && scols == storage.cols ? storage.buf + srow * storage.stride : NULL;
 
-	free(m);
+	/* Copy over a temporary matrix that holds the const rows and columns */
+	struct matrix v_temp = {
+		.cols = cols,
+		.rows = rows,
+		.data = data,
+		.buf = buf,
+		.stride = storage.stride,
+		.alloc = alloc,
+		.flags = MAT_VIEW | (m->flags & MAT_TRANSPOSED),
+	};
+	memcpy(v, &v_temp, sizeof(struct matrix));
+
+	for (size_t r = 0; r < srows; r++)
+		data[r] = storage.data[srow + r] + scol;
+
+	return v;
 }
 
 void mat_set_identity(struct matrix *m)
@@ -118,7 +257,7 @@ void mat_print(struct matrix *m)
 
 	for (size_t row = 0; row < m->rows; row++) {
 		for (size_t col = 0; col < m->cols; col++)
-			printf("%lld  ", m->data[row][col]);
+			printf("%lld  ", *mat_at(m, row, col));
 
 		printf("\n");
 	}
@@ -135,6 +274,13 @@ void mat_shift_east(struct matrix *m, size_t nshifts)
 		return;
 	}
 
+	if (m->flags & MAT_TRANSPOSED) {
+		struct matrix storage = mat_storage(m);
+
+		mat_shift_south(&storage, nshifts);
+		return;
+	}
+
 	for (size_t r = 0; r < m->rows; r++) {
 		for (ssize_t c = m->cols - 1; c >= 0; c--) {
 			ssize_t src = c - nshifts;
@@ -151,6 +297,13 @@ void mat_shift_west(struct matrix *m, size_t nshifts)
 		return;
 	}
 
+	if (m->flags & MAT_TRANSPOSED) {
+		struct matrix storage = mat_storage(m);
+
+		mat_shift_north(&storage, nshifts);
+		return;
+	}
+
 	for (size_t r = 0; r < m->rows; r++) {
 		for (size_t c = 0; c < m->cols; c++) {
 			size_t src = c + nshifts;
@@ -167,6 +320,13 @@ void mat_shift_north(struct matrix *m, size_t nshifts)
 		return;
 	}
 
+	if (m->flags & MAT_TRANSPOSED) {
+		struct matrix storage = mat_storage(m);
+
+		mat_shift_west(&storage, nshifts);
+		return;
+	}
+
 	for (size_t r = 0; r < m->rows; r++) {
 		size_t src = r + nshifts;
 		for (size_t c = 0; c < m->cols; c++) {
@@ -183,6 +343,13 @@ void mat_shift_south(struct matrix *m, size_t nshifts)
 		return;
 	}
 
+	if (m->flags & MAT_TRANSPOSED) {
+		struct matrix storage = mat_storage(m);
+
+		mat_shift_east(&storage, nshifts);
+		return;
+	}
+
 	for (ssize_t r = m->rows - 1; r >= 0; r--) {
 		ssize_t src = r - nshifts;
 		for (size_t c = 0; c < m->cols; c++) {
@@ -199,7 +366,7 @@ void mat_set(struct matrix *m, size_t row, size_t col, val_t val)
 		return;
 	}
 
-	m->data[row][col] = val;
+	*mat_at(m, row, col) = val;
 }
 
 void mat_reset(struct matrix *m)
@@ -210,9 +377,15 @@ void mat_reset(struct matrix *m)
 		return;
 	}
 
-	for (size_t row = 0; row < m->rows; row++)
-		for (size_t col = 0; col < m->cols; col++)
-			m->data[row][col] = 0;
+	const struct matrix storage = mat_storage(m);
+
+	if (storage.buf) {
+		memset(storage.buf, 0, mat_span(&storage) * sizeof(val_t));
+		return;
+	}
+
+	for (size_t row = 0; row < storage.rows; row++)
+		memset(storage.data[row], 0, storage.cols * sizeof(val_t));
 }
 
 void mat_set_row_gf2(struct matrix *m, size_t row, unsigned long long bits)
@@ -227,8 +400,154 @@ void mat_set_row_gf2(struct matrix *m, size_t row, unsigned long long bits)
 		mat_set(m, row, col, (bits >> ((m->cols - 1) - col) & 0x1));
 }
 
+/* ---------------- Row kernels ---------------- */
+
+static void mat_row_add(val_t *d, const val_t *a, const val_t *b, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		d[i] = a[i] + b[i];
+}
+
+static void mat_row_sub(val_t *d, const val_t *a, const val_t *b, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		d[i] = a[i] - b[i];
+}
+
+/* d += s * x */
+static void mat_row_axpy(val_t *restrict d, val_t s, const val_t *restrict x, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		d[i] += s * x[i];
+}
+
+/* Transposition */
+
+/* Edge of the blocks the transpose works through; a source and destination block fit in L1 */
+#define MAT_TRANS_BLOCK 32
+
+/* Transpose the kernel tile at (r, c) of src into (c, r) of dest */
+static void mat_trans_tile(struct matrix *dest, const struct matrix *src, size_t r, size_t c)
+{
+	const void *s[FKERNELS_TRANS_TILE];
+	void *d[FKERNELS_TRANS_TILE];
+
+	for (size_t i = 0; i < FKERNELS_TRANS_TILE; i++) {
+		s[i] = src->data[r + i] + c;
+		d[i] = dest->data[c + i] + r;
+	}
+
+	fkernels->trans4(d, s);
+}
+
+/* Exchange the kernel tiles at (r, c) and (c, r) of a square matrix, transposing both */
+static void mat_trans_swap_tiles(struct matrix *m, size_t r, size_t c)
+{
+	val_t tmp[FKERNELS_TRANS_TILE][FKERNELS_TRANS_TILE];
+	const void *a[FKERNELS_TRANS_TILE];
+	const void *b[FKERNELS_TRANS_TILE];
+	void *ad[FKERNELS_TRANS_TILE];
+	void *t[FKERNELS_TRANS_TILE];
+
+	for (size_t i = 0; i < FKERNELS_TRANS_TILE; i++) {
+		a[i] = m->data[r + i] + c;
+		b[i] = m->data[c + i] + r;
+		ad[i] = m->data[r + i] + c;
+		t[i] = tmp[i];
+	}
+
+	fkernels->trans4(t, a);
+	if (r != c)
+		fkernels->trans4(ad, b);
+
+	for (size_t i = 0; i < FKERNELS_TRANS_TILE; i++)
+		memcpy(m->data[c + i] + r, tmp[i], sizeof(tmp[i]));
+}
+
+/* Out-of-place transpose, block by block so that the strided side stays in cache */
+static void mat_trans_tiled(struct matrix *dest, const struct matrix *src)
+{
+	const size_t tile = FKERNELS_TRANS_TILE;
+
+	for (size_t r0 = 0; r0 < src->rows; r0 += MAT_TRANS_BLOCK) {
+		const size_t r1 = r0 + MAT_TRANS_BLOCK < src->rows ? r0 + MAT_TRANS_BLOCK : src->rows;
+
+		for (size_t c0 = 0; c0 < src->cols; c0 += MAT_TRANS_BLOCK) {
+			const size_t c1 = c0 + MAT_TRANS_BLOCK < src->cols ? c0 + MAT_TRANS_BLOCK : src->cols;
+			size_t r = r0;
+
+			for (; r + tile <= r1; r += tile) {
+				size_t c = c0;
+
+				for (; c + tile <= c1; c += tile)
+					mat_trans_tile(dest, src, r, c);
+				for (; c < c1; c++)
+					for (size_t i = r; i < r + tile; i++)
+						dest->data[c][i] = src->data[i][c];
+			}
+
+			for (; r < r1; r++)
+				for (size_t c = c0; c < c1; c++)
+					dest->data[c][r] = src->data[r][c];
+		}
+	}
+}
+
+/* In-place transpose of a square matrix, exchanging tiles across the diagonal */
+static void mat_trans_square(struct matrix *m)
+{
+	const size_t tile = FKERNELS_TRANS_TILE;
+	const size_t n = m->rows;
+
+	for (size_t r0 = 0; r0 < n; r0 += MAT_TRANS_BLOCK) {
+		const size_t r1 = r0 + MAT_TRANS_BLOCK < n ? r0 + MAT_TRANS_BLOCK : n;
+
+		for (size_t c0 = r0; c0 < n; c0 += MAT_TRANS_BLOCK) {
+			const size_t c1 = c0 + MAT_TRANS_BLOCK < n ? c0 + MAT_TRANS_BLOCK : n;
+
+			for (size_t r = r0; r < r1; r += tile) {
+				for (size_t c = c0 == r0 ? r : c0; c < c1; c += tile) {
+					if (r + tile <= n && c + tile <= n) {
+						mat_trans_swap_tiles(m, r, c);
+						continue;
+					}
+
+					/* Partial tile on the last rows or columns */
+					const size_t ie = r + tile < n ? r + tile : n;
+					const size_t je = c + tile < n ? c + tile : n;
+
+					for (size_t i = r; i < ie; i++) {
+						for (size_t j = r == c ? i + 1 : c; j < je; j++) {
+							const val_t tmp = m->data[i][j];
+
+							m->data[i][j] = m->data[j][i];
+							m->data[j][i] = tmp;
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
 /* ---------------- Operations ---------------- */
 
+struct matrix mat_trans_view(const struct matrix *m)
+{
+	if (!m) {
+		errno = EINVAL;
+		perror(__func__);
+		return (struct matrix){ .data = NULL };
+	}
+
+	return (struct matrix){
+		.cols = m->rows,
+		.rows = m->cols,
+		.data = m->data,
+		.flags = m->flags ^ MAT_TRANSPOSED,
+	};
+}
+
 struct matrix *mat_copy(struct matrix *dest, const struct matrix *src)
 {
 	if (!src) {
@@ -249,9 +568,28 @@ struct matrix *mat_copy(struct matrix *dest, const struct matrix *src)
 			return NULL;
 	}
 
-	for (size_t r = 0; r < src->rows; r++)
-		for (size_t c = 0; c < src->cols; c++)
-			dest->data[r][c] = src->data[r][c];
+	struct matrix d = mat_storage(dest);
+	const struct matrix s = mat_storage(src);
+
+	/* Copying between orientations transposes the storage */
+	if (!mat_same_orientation(dest, src)) {
+		if (d.data == s.data)
+			mat_trans_square(&d);
+		else
+			mat_trans_tiled(&d, &s);
+		return dest;
+	}
+
+	if (d.data == s.data)
+		return dest;
+
+	if (mat_same_layout(&d, &s)) {
+		memcpy(d.buf, s.buf, mat_span(&s) * sizeof(val_t));
+		return dest;
+	}
+
+	for (size_t r = 0; r < s.rows; r++)
+		memcpy(d.data[r], s.data[r], s.cols * sizeof(val_t));
 
 	return dest;
 }
@@ -266,12 +604,36 @@ bool mat_equal(const struct matrix *a, const struct matrix *b)
 
 	for (size_t r = 0; r < a->rows; r++)
 		for (size_t c = 0; c < a->cols; c++)
-			if (a->data[r][c] != b->data[r][c])
+			if (*mat_at(a, r, c) != *mat_at(b, r, c))
 				return false;
 
 	return true;
 }
 
+/*
+ * dest = a + b, or a - b, over operands that are not all read in the same
+ * orientation, block by block so that the operands walked across their
+ * stored rows stay in cache
+ */
+static void mat_add_mixed(struct matrix *dest,
+			   const struct matrix *a,
+			   const struct matrix *b,
+			   bool subtract)
+{
+	for (size_t r0 = 0; r0 < dest->rows; r0 += MAT_TRANS_BLOCK) {
+		const size_t r1 = r0 + MAT_TRANS_BLOCK < dest->rows ? r0 + MAT_TRANS_BLOCK : dest->rows;
+
+		for (size_t c0 = 0; c0 < dest->cols; c0 += MAT_TRANS_BLOCK) {
+			const size_t c1 = c0 + MAT_TRANS_BLOCK < dest->cols ? c0 + MAT_TRANS_BLOCK : dest->cols;
+
+			for (size_t r = r0; r < r1; r++)
+				for (size_t c = c0; c < c1; c++)
+					*mat_at(dest, r, c) = subtract ? *mat_at(a, r, c) - *mat_at(b, r, c)
+									: *mat_at(a, r, c) + *mat_at(b, r, c);
+		}
+	}
+}
+
 struct matrix *mat_add(struct matrix *dest, const struct matrix *a, const struct matrix *b)
 {
 	if (!a || !b || a->rows != b->rows || a->cols != b->cols) {
@@ -292,9 +654,23 @@ struct matrix *mat_add(struct matrix *dest, const struct matrix *a, const struct
 			return NULL;
 	}
 
-	for (size_t r = 0; r < a->rows; r++)
-		for (size_t c = 0; c < a->cols; c++)
-			dest->data[r][c] = a->data[r][c] + b->data[r][c];
+	if (!mat_same_orientation(dest, a) || !mat_same_orientation(dest, b)) {
+		mat_add_mixed(dest, a, b, false);
+		return dest;
+	}
+
+	const struct matrix d = mat_storage(dest);
+	const struct matrix sa = mat_storage(a);
+	const struct matrix sb = mat_storage(b);
+
+	/* Walk the slabs in one pass when all three share a layout */
+	if (mat_same_layout(&d, &sa) && mat_same_layout(&d, &sb)) {
+		mat_row_add(d.buf, sa.buf, sb.buf, mat_span(&sa));
+		return dest;
+	}
+
+	for (size_t r = 0; r < sa.rows; r++)
+		mat_row_add(d.data[r], sa.data[r], sb.data[r], sa.cols);
 
 	return dest;
 }
@@ -319,13 +695,75 @@ struct matrix *mat_sub(struct matrix *dest, const struct matrix *a, const struct
 			return NULL;
 	}
 
-	for (size_t r = 0; r < a->rows; r++)
-		for (size_t c = 0; c < a->cols; c++)
-			dest->data[r][c] = a->data[r][c] - b->data[r][c];
+	if (!mat_same_orientation(dest, a) || !mat_same_orientation(dest, b)) {
+		mat_add_mixed(dest, a, b, true);
+		return dest;
+	}
+
+	const struct matrix d = mat_storage(dest);
+	const struct matrix sa = mat_storage(a);
+	const struct matrix sb = mat_storage(b);
+
+	/* Walk the slabs in one pass when all three share a layout */
+	if (mat_same_layout(&d, &sa) && mat_same_layout(&d, &sb)) {
+		mat_row_sub(d.buf, sa.buf, sb.buf, mat_span(&sa));
+		return dest;
+	}
+
+	for (size_t r = 0; r < sa.rows; r++)
+		mat_row_sub(d.data[r], sa.data[r], sb.data[r], sa.cols);
 
 	return dest;
 }
 
+/* Multiply-adds below which mat_gemm stays on the calling thread */
+#define MAT_PARALLEL_MIN (64 * 64 * 64)
+
+struct mat_mul_job {
+	struct matrix *dest;
+	const struct matrix *a;
+	const struct matrix *b;
+	val_t alpha, beta;
+	size_t ntasks;
+};
+
+/* Compute one band of rows of dest = alpha * a * b + beta * dest */
+static void mat_mul_task(void *arg, size_t task)
+{
+	const struct mat_mul_job *job = arg;
+	const struct matrix *a = job->a;
+	const struct matrix *b = job->b;
+	const size_t r0 = a->rows * task / job->ntasks;
+	const size_t r1 = a->rows * (task + 1) / job->ntasks;
+
+	for (size_t i = r0; i < r1; i++) {
+		val_t *d = job->dest->data[i];
+
+		/* A transposed b keeps its columns in rows: take dot products along them */
+		if (b->flags & MAT_TRANSPOSED) {
+			for (size_t j = 0; j < b->cols; j++) {
+				const val_t *bcol = b->data[j];
+				val_t sum = 0;
+
+				for (size_t k = 0; k < a->cols; k++)
+					sum += *mat_at(a, i, k) * bcol[k];
+				d[j] = job->beta ? job->alpha * sum + job->beta * d[j] : job->alpha * sum;
+			}
+			continue;
+		}
+
+		if (!job->beta)
+			memset(d, 0, b->cols * sizeof(val_t));
+		else if (job->beta != 1)
+			for (size_t j = 0; j < b->cols; j++)
+				d[j] *= job->beta;
+
+		/* i-k-j order: stream rows of b into each row of dest instead of walking columns */
+		for (size_t k = 0; k < a->cols; k++)
+			mat_row_axpy(d, job->alpha * *mat_at(a, i, k), b->data[k], b->cols);
+	}
+}
+
 struct matrix *mat_mul(struct matrix *dest, const struct matrix *a, const struct matrix *b)
 {
 	if (!a || !b || a->cols != b->rows) {
@@ -346,16 +784,40 @@ struct matrix *mat_mul(struct matrix *dest, const struct matrix *a, const struct
 			return NULL;
 	}
 
-	for (size_t i = 0; i < a->rows; i++) {
-		for (size_t j = 0; j < b->cols; j++) {
-			val_t sum = 0;
-			for (size_t k = 0; k < a->cols; k++)
-				sum += a->data[i][k] * b->data[k][j];
-			dest->data[i][j] = sum;
-		}
+	return mat_gemm(1, a, b, 0, dest);
+}
+
+struct matrix *mat_gemm(val_t alpha, const struct matrix *a, const struct matrix *b, val_t beta, struct matrix *c)
+{
+	if (!a || !b || !c || a->cols != b->rows || c->rows != a->rows || c->cols != b->cols) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
 	}
 
-	return dest;
+	/* Into a transposed view, accumulate b^T * a^T into its storage instead */
+	struct matrix ct = mat_trans_view(c);
+	const struct matrix at = mat_trans_view(a);
+	const struct matrix bt = mat_trans_view(b);
+	const bool swap = c->flags & MAT_TRANSPOSED;
+	struct mat_mul_job job = {
+		.dest = swap ? &ct : c,
+		.a = swap ? &bt : a,
+		.b = swap ? &at : b,
+		.alpha = alpha,
+		.beta = beta,
+		.ntasks = 1,
+	};
+
+	if (a->rows * b->cols * a->cols >= MAT_PARALLEL_MIN) {
+		job.ntasks = threadpool_get_threads();
+		if (job.ntasks > job.dest->rows)
+			job.ntasks = job.dest->rows;
+	}
+
+	threadpool_run(job.ntasks, mat_mul_task, &job);
+
+	return c;
 }
 
 struct matrix *mat_trans(struct matrix *dest, const struct matrix *src)
@@ -378,11 +840,10 @@ struct matrix *mat_trans(struct matrix *dest, const struct matrix *src)
 			return NULL;
 	}
 
-	for (size_t r = 0; r < src->rows; r++)
-		for (size_t c = 0; c < src->cols; c++)
-			dest->data[c][r] = src->data[r][c];
+	/* The transpose of src is a copy of its transposed view */
+	const struct matrix view = mat_trans_view(src);
 
-	return dest;
+	return mat_copy(dest, &view);
 }
 
 struct matrix *mat_set_string(const char *str)
@@ -393,89 +854,100 @@ struct matrix *mat_set_string(const char *str)
 		return NULL;
 	}
 
-	/* Count rows and columns */
-
-	size_t current_cols = 0;
-	const char *p = str;
-	int in_number = 0;
-	size_t rows = 0;
-	size_t cols = 0;
-	size_t r = 0;
-	size_t c = 0;
-	char *endptr;
-
-	while (*p) {
-		if (isdigit(*p) || *p == '.' || *p == '-' || *p == '+') {
-			if (!in_number) {
-				in_number = 1;
-				current_cols++;
-			}
-		} else {
-			in_number = 0;
-			if (*p == ';') {
-				if (cols == 0)
-					cols = current_cols;
-				else if (current_cols != cols) {
-					fprintf(stderr,
-						"%s: Inconsistent number of columns\n",
-						__func__);
-					return NULL;
-				}
-				rows++;
-				current_cols = 0;
-			}
-		}
-		p++;
-	}
-	if (current_cols > 0) {
-		if (cols == 0)
-			cols = current_cols;
-		else if (current_cols != cols) {
-			fprintf(stderr, "%s: Inconsistent number of columns\n", __func__);
-			return NULL;
-		}
-		rows++;
-	}
+	return mat_set_stringn(str, strlen(str));
+}
 
-	struct matrix *m = mat_alloc(rows, cols);
-	if (!m) {
+struct matrix *mat_set_stringn(const char *str, size_t len)
+{
+	if (!str) {
+		errno = EINVAL;
 		perror(__func__);
 		return NULL;
 	}
 
-	p = str; /* Parse numbers into the matrix */
+	struct mat_parse ps;
+	struct matrix *m = NULL;
 
-	while (*p && r < rows) {
-		/* Skip non-numeric, non-minus/plus characters except row separator ; */
+	mat_parse_init(&ps, true, __func__);
+	mat_parse_feed(&ps, str, len, true);
 
-		while (*p && !isdigit(*p) && *p != '.' && *p != '-' && *p != '+' && *p != ';')
-			p++;
+	if (mat_parse_finish(&ps))
+		m = mat_alloc(ps.rows, ps.cols);
 
-		if (!*p)
-			break;
-		if (*p == ';') {
-			r++;
-			c = 0;
-			p++;
-			continue;
-		}
+	if (m)
+		for (size_t r = 0; r < ps.rows; r++)
+			for (size_t c = 0; c < ps.cols; c++)
+				m->data[r][c] = ps.vals[r * ps.cols + c].i;
 
-		val_t val = strtod(p, &endptr);
-		if (endptr == p) {
-			fprintf(stderr, "%s: Failed to parse number near '%s'\n", __func__, p);
-			mat_free(m);
-			return NULL;
-		}
+	mat_parse_release(&ps);
 
-		if (c >= cols) {
-			fprintf(stderr, "%s: Too many columns in row %zu\n", __func__, r);
-			mat_free(m);
-			return NULL;
-		}
+	return m;
+}
+
+/* Store row r of a streamed matrix straight into the destination */
+static bool mat_read_row(void *ctx, size_t r, const union mat_parse_val *vals, size_t cols)
+{
+	struct matrix *m = ctx;
+
+	if (r >= m->rows || cols != m->cols)
+		return false;
+
+	for (size_t c = 0; c < cols; c++)
+		*mat_at(m, r, c) = vals[c].i;
+
+	return true;
+}
+
+/* Read a matrix from f, or from fd if f is NULL */
+static struct matrix *mat_read_stream(struct matrix *dest, FILE *f, int fd, const char *func)
+{
+	struct mat_parse ps;
+	struct matrix *m = NULL;
 
-		m->data[r][c++] = val;
-		p = endptr;
+	mat_parse_init(&ps, true, func);
+	if (dest) {
+		ps.row = mat_read_row;
+		ps.ctx = dest;
+	}
+
+	if (mat_parse_stream(&ps, f, fd) && mat_parse_finish(&ps)) {
+		if (!dest) {
+			m = mat_alloc(ps.rows, ps.cols);
+			if (m)
+				for (size_t r = 0; r < ps.rows; r++)
+					for (size_t c = 0; c < ps.cols; c++)
+						m->data[r][c] = ps.vals[r * ps.cols + c].i;
+		} else if (ps.rows == dest->rows) {
+			m = dest;
+		} else {
+			fprintf(stderr, "%s: Shape does not match the destination\n", func);
+			errno = EINVAL;
+		}
 	}
 
+	mat_parse_release(&ps);
+
 	return m;
 }
+
+struct matrix *mat_read(struct matrix *dest, FILE *f)
+{
+	if (!f) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	return mat_read_stream(dest, f, -1, __func__);
+}
+
+struct matrix *mat_read_fd(struct matrix *dest, int fd)
+{
+	if (fd < 0) {
+		errno = EINVAL;
+		perror(__func__);
+		return NULL;
+	}
+
+	return mat_read_stream(dest, NULL, fd, __func__);
+}
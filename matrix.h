@@ -6,93 +6,108 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "allocator.h"
+
 /* Scalar type for matrix elements */
 typedef long long val_t;
 
+/* Alignment in bytes of the element slab and of every row within it */
+#define MATRIX_ALIGN 64
+
+/*
+ * Elements live in one contiguous slab: row r starts at buf + r * stride.
+ * The row-pointer table in data is a view onto the slab, so m->data[r][c]
+ * and m->buf[r * m->stride + c] address the same element.
+ */
 struct matrix {
 	const size_t cols, rows;
 	val_t **data;
+	val_t *buf;
+	size_t stride;
+	/* Allocator owning the storage, NULL if the matrix does not own it */
+	const struct mat_allocator *alloc;
+	/* MAT_* view flags */
+	unsigned flags;
 };
 
-/* Stack-allocated matrix */
-#define MATRIX(name, R, C)                                   \
-	val_t name##_buf[R][C];                              \
-	val_t *name##_rowptrs[R];                            \
-	for (size_t i = 0; i < (R); i++)                     \
-		name##_rowptrs[i] = name##_buf[i];           \
-	struct matrix name##_obj = { C, R, name##_rowptrs }; \
-	struct matrix *name = &name##_obj;                   \
-	memset(name##_buf, 0, sizeof(name##_buf))
-
-#define MAT_MUL(name, A, B)                                                               \
-	MATRIX(name, (A)->rows, (B)->cols);                                               \
-	do {                                                                              \
-		if ((A)->cols != (B)->rows) {                                             \
-			fprintf(stderr, "MAT_MUL: dimension mismatch\n");                 \
-		} else {                                                                  \
-			for (size_t i = 0; i < (A)->rows; i++) {                          \
-				for (size_t j = 0; j < (B)->cols; j++) {                  \
-					val_t sum = 0.0;                                  \
-					for (size_t k = 0; k < (A)->cols; k++)            \
-						sum += (A)->data[i][k] * (B)->data[k][j]; \
-					name->data[i][j] = sum;                           \
-				}                                                         \
-			}                                                                 \
-		}                                                                         \
+/* Element (r, c) is stored at data[c][r]; set on views from mat_trans_view */
+#define MAT_TRANSPOSED 0x1
+/* The elements belong to another matrix, mat_free only releases the view */
+#define MAT_VIEW 0x2
+
+/* Bytes of inline storage of a scoped matrix, including its struct and row table */
+#ifndef MATRIX_INLINE_BYTES
+#define MATRIX_INLINE_BYTES 4096
+#endif
+
+/* Set up a rows x cols matrix in storage, or in the spill pool if it does not fit; see MATRIX */
+struct matrix *mat_inline(void *storage, size_t bytes, size_t rows, size_t cols);
+/* Release a scoped matrix; the cleanup handler of MATRIX */
+void mat_scope_free(struct matrix **m);
+
+/*
+ * Scoped matrix, zeroed and released when name goes out of scope. It lives in
+ * an inline buffer of MATRIX_INLINE_BYTES on the stack when it fits and spills
+ * to the thread's spill pool when it does not, so runtime sizes cannot
+ * overflow small thread stacks. name is NULL if spilling fails.
+ */
+#define MATRIX(name, R, C)                                                       \
+	_Alignas(MATRIX_ALIGN) unsigned char name##_inline[MATRIX_INLINE_BYTES]; \
+	__attribute__((cleanup(mat_scope_free))) struct matrix *name =           \
+		mat_inline(name##_inline, sizeof(name##_inline), (R), (C))
+
+#define MAT_MUL(name, A, B)                                               \
+	MATRIX(name, (A)->rows, (B)->cols);                               \
+	do {                                                              \
+		if ((A)->cols != (B)->rows)                               \
+			fprintf(stderr, "MAT_MUL: dimension mismatch\n"); \
+		else if (name)                                            \
+			mat_mul(name, (A), (B));                          \
 	} while (0)
 
-#define MAT_ADD(name, A, B)                                                                   \
-	MATRIX(name, (A)->rows, (A)->cols);                                                   \
-	do {                                                                                  \
-		if ((A)->rows != (B)->rows || (A)->cols != (B)->cols) {                       \
-			fprintf(stderr, "MAT_ADD: dimension mismatch\n");                     \
-		} else {                                                                      \
-			for (size_t i = 0; i < (A)->rows; i++) {                              \
-				for (size_t j = 0; j < (A)->cols; j++) {                      \
-					name->data[i][j] = (A)->data[i][j] + (B)->data[i][j]; \
-				}                                                             \
-			}                                                                     \
-		}                                                                             \
+#define MAT_ADD(name, A, B)                                               \
+	MATRIX(name, (A)->rows, (A)->cols);                               \
+	do {                                                              \
+		if ((A)->rows != (B)->rows || (A)->cols != (B)->cols)     \
+			fprintf(stderr, "MAT_ADD: dimension mismatch\n"); \
+		else if (name)                                            \
+			mat_add(name, (A), (B));                          \
 	} while (0)
 
-#define MAT_SUB(name, A, B)                                                                   \
-	MATRIX(name, (A)->rows, (A)->cols);                                                   \
-	do {                                                                                  \
-		if ((A)->rows != (B)->rows || (A)->cols != (B)->cols) {                       \
-			fprintf(stderr, "MAT_SUB: dimension mismatch\n");                     \
-		} else {                                                                      \
-			for (size_t i = 0; i < (A)->rows; i++) {                              \
-				for (size_t j = 0; j < (A)->cols; j++) {                      \
-					name->data[i][j] = (A)->data[i][j] - (B)->data[i][j]; \
-				}                                                             \
-			}                                                                     \
-		}                                                                             \
+#define MAT_SUB(name, A, B)                                               \
+	MATRIX(name, (A)->rows, (A)->cols);                               \
+	do {                                                              \
+		if ((A)->rows != (B)->rows || (A)->cols != (B)->cols)     \
+			fprintf(stderr, "MAT_SUB: dimension mismatch\n"); \
+		else if (name)                                            \
+			mat_sub(name, (A), (B));                          \
 	} while (0)
 
-#define MAT_TRANS(name, A)                                          \
-	MATRIX(name, (A)->cols, (A)->rows);                         \
-	do {                                                        \
-		for (size_t i = 0; i < (A)->rows; i++) {            \
-			for (size_t j = 0; j < (A)->cols; j++) {    \
-				name->data[j][i] = (A)->data[i][j]; \
-			}                                           \
-		}                                                   \
+#define MAT_TRANS(name, A)                    \
+	MATRIX(name, (A)->cols, (A)->rows);   \
+	do {                                  \
+		if (name)                     \
+			mat_trans(name, (A)); \
 	} while (0)
 
-#define MAT_COPY(name, A)                                           \
-	MATRIX(name, (A)->rows, (A)->cols);                         \
-	do {                                                        \
-		for (size_t i = 0; i < (A)->rows; i++) {            \
-			for (size_t j = 0; j < (A)->cols; j++) {    \
-				name->data[i][j] = (A)->data[i][j]; \
-			}                                           \
-		}                                                   \
+#define MAT_COPY(name, A)                    \
+	MATRIX(name, (A)->rows, (A)->cols);  \
+	do {                                 \
+		if (name)                    \
+			mat_copy(name, (A)); \
 	} while (0)
 
 /* Allocate an empty matrix */
 struct matrix *mat_alloc(const size_t rows, const size_t cols);
 /* Delete a matrix */
 void mat_free(struct matrix *m);
+/*
+ * View of the rows x cols block of m at (row, col), aliasing the storage of
+ * m through its own row table. Every operation accepts the view, so a block
+ * is updated in place without copying it out; mat_free releases the view
+ * alone. It is valid as long as m is.
+ */
+struct matrix *mat_block_view(const struct matrix *m, size_t row, size_t col, size_t rows, size_t cols);
 
 /* Set the matrix to an idenitity matrix */
 void mat_set_identity(struct matrix *m);
@@ -100,6 +115,17 @@ void mat_set_identity(struct matrix *m);
 struct matrix *mat_identity_new(const size_t dims);
 /* Allocate a new matrix from string input */
 struct matrix *mat_set_string(const char *str);
+/* Allocate a new matrix from the first len bytes of str, which need not be NUL-terminated */
+struct matrix *mat_set_stringn(const char *str, size_t len);
+/*
+ * Read a matrix written as for mat_set_string from f up to its end, a
+ * fixed-size chunk at a time. With dest, which must have the shape read, each
+ * row goes straight into it and memory stays bounded by one row; with a NULL
+ * dest the values are buffered and a new matrix is returned.
+ */
+struct matrix *mat_read(struct matrix *dest, FILE *f);
+/* Read a matrix from the file descriptor fd, as mat_read */
+struct matrix *mat_read_fd(struct matrix *dest, int fd);
 
 /* Shift all fields of the matrix up */
 void mat_shift_north(struct matrix *m, size_t nshifts);
@@ -123,13 +149,25 @@ void mat_set_row_gf2(struct matrix *m, size_t row, unsigned long long bits);
 /* Print a matrix */
 void mat_print(struct matrix *m);
 
+/*
+ * Transposed view of a matrix, sharing its storage. Copy, comparison, add,
+ * sub, mul and trans read views in place and accept them as destinations,
+ * so a product like A^T * B never materializes A^T. A view owns nothing and
+ * is never freed; it is valid as long as the matrix it views. Other than a
+ * square copy or trans in place, an operation must not write to storage it
+ * also reads in the other orientation.
+ */
+struct matrix mat_trans_view(const struct matrix *m);
+
 /* Add two matrices */
 struct matrix *mat_add(struct matrix *dest, const struct matrix *a, const struct matrix *b);
 /* Subtract two matrices */
 struct matrix *mat_sub(struct matrix *dest, const struct matrix *a, const struct matrix *b);
 /* Multiply two matrices */
 struct matrix *mat_mul(struct matrix *dest, const struct matrix *a, const struct matrix *b);
-/* Transpose a matrix */
+/* Accumulate a product in place, c = alpha * a * b + beta * c; with beta 0 c is not read */
+struct matrix *mat_gemm(val_t alpha, const struct matrix *a, const struct matrix *b, val_t beta, struct matrix *c);
+/* Transpose a matrix; dest may be src if it is square */
 struct matrix *mat_trans(struct matrix *dest, const struct matrix *src);
 /* Copy a matrix */
 struct matrix *mat_copy(struct matrix *dest, const struct matrix *src);
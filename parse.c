@@ -0,0 +1,423 @@
+#include <errno.h>
+#include <limits.h>
+#include <locale.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "parse.h"
+
+/* Significant decimal digits that always fit the 64-bit mantissa */
+#define MAT_PARSE_DIGITS 19
+
+/* Longest number the strtod fallback copies to the stack; longer ones go to the heap */
+#define MAT_PARSE_TOKEN 128
+
+/* Bytes read from a stream at a time */
+#define MAT_PARSE_CHUNK (64 * 1024)
+
+/* Context shown after a number that fails to parse */
+#define MAT_PARSE_CONTEXT 20
+
+/* Powers of ten that are exact doubles */
+static const double mat_parse_pow10[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/* A scanned number: (-1)^neg * mant * 10^exp10 */
+struct mat_parse_num {
+	bool neg;
+	/* No fraction and no exponent */
+	bool integral;
+	/* Nonzero digits beyond the first MAT_PARSE_DIGITS were dropped */
+	bool inexact;
+	uint64_t mant;
+	unsigned digits;
+	long exp10;
+};
+
+static bool mat_parse_is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+/* Characters that may appear in a number */
+static bool mat_parse_is_num(char c)
+{
+	return mat_parse_is_digit(c) || c == '.' || c == '-' || c == '+' || c == 'e' || c == 'E';
+}
+
+/* Characters that may start a number */
+static bool mat_parse_is_start(char c)
+{
+	return mat_parse_is_digit(c) || c == '.' || c == '-' || c == '+';
+}
+
+/* Append a digit of the integer part, or of the fraction if frac is set */
+static void mat_parse_digit(struct mat_parse_num *n, unsigned d, bool frac)
+{
+	/* Leading zeros are not significant, but still shift the fraction */
+	if (!n->mant && !d) {
+		n->exp10 -= frac;
+		return;
+	}
+
+	if (n->digits < MAT_PARSE_DIGITS) {
+		n->mant = n->mant * 10 + d;
+		n->digits++;
+		n->exp10 -= frac;
+	} else {
+		n->exp10 += !frac;
+		n->inexact |= d != 0;
+	}
+}
+
+/*
+ * Scan the number [+-]digits[.digits][(e|E)[+-]digits] at p, which needs a
+ * digit before or after the point. Returns its end, or p if none starts there.
+ */
+static const char *mat_parse_scan(const char *p, const char *end, struct mat_parse_num *n)
+{
+	const char *q = p;
+	size_t ndigits = 0;
+
+	*n = (struct mat_parse_num){ .integral = true };
+
+	if (q < end && (*q == '+' || *q == '-'))
+		n->neg = *q++ == '-';
+
+	for (; q < end && mat_parse_is_digit(*q); q++, ndigits++)
+		mat_parse_digit(n, (unsigned)(*q - '0'), false);
+
+	if (q < end && *q == '.') {
+		n->integral = false;
+		for (q++; q < end && mat_parse_is_digit(*q); q++, ndigits++)
+			mat_parse_digit(n, (unsigned)(*q - '0'), true);
+	}
+
+	if (!ndigits)
+		return p;
+
+	/* An exponent only counts if digits follow, else the number ends before the e */
+	if (q < end && (*q == 'e' || *q == 'E')) {
+		const char *e = q + 1;
+		bool neg = false;
+		long x = 0;
+
+		if (e < end && (*e == '+' || *e == '-'))
+			neg = *e++ == '-';
+
+		if (e < end && mat_parse_is_digit(*e)) {
+			/* Clamped well past the range of a double */
+			for (; e < end && mat_parse_is_digit(*e); e++)
+				if (x < 100000)
+					x = x * 10 + (*e - '0');
+
+			n->exp10 += neg ? -x : x;
+			n->integral = false;
+			q = e;
+		}
+	}
+
+	return q;
+}
+
+/*
+ * Value of n when it is exact in a double and a single rounded multiply or
+ * divide by an exact power of ten gets it right; false otherwise.
+ */
+static bool mat_parse_fast(const struct mat_parse_num *n, double *v)
+{
+	if (n->inexact)
+		return false;
+
+	if (!n->mant) {
+		*v = n->neg ? -0.0 : 0.0;
+		return true;
+	}
+
+	if (n->mant > (uint64_t)1 << 53 || n->exp10 < -22 || n->exp10 > 22)
+		return false;
+
+	const double m = (double)n->mant;
+
+	*v = n->exp10 < 0 ? m / mat_parse_pow10[-n->exp10] : m * mat_parse_pow10[n->exp10];
+	if (n->neg)
+		*v = -*v;
+
+	return true;
+}
+
+static locale_t mat_parse_c_locale;
+static pthread_once_t mat_parse_once = PTHREAD_ONCE_INIT;
+
+static void mat_parse_locale_init(void)
+{
+	mat_parse_c_locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+}
+
+/*
+ * Correctly rounded value of the len characters at p by strtod, for the rare
+ * numbers the fast path cannot do exactly. strtod runs in the C locale, so the
+ * decimal point is '.' whatever locale the program has set.
+ */
+static bool mat_parse_slow(const char *p, size_t len, double *v)
+{
+	char stack[MAT_PARSE_TOKEN];
+	char *token = len < sizeof(stack) ? stack : malloc(len + 1);
+	if (!token)
+		return false;
+
+	memcpy(token, p, len);
+	token[len] = '\0';
+
+	pthread_once(&mat_parse_once, mat_parse_locale_init);
+
+	const locale_t prev = mat_parse_c_locale ? uselocale(mat_parse_c_locale) : (locale_t)0;
+
+	*v = strtod(token, NULL);
+
+	if (mat_parse_c_locale)
+		uselocale(prev);
+
+	if (token != stack)
+		free(token);
+
+	return true;
+}
+
+/* Report a malformed number at p and stop parsing */
+static void mat_parse_error(struct mat_parse *ps, const char *p, const char *end, const char *what)
+{
+	const int context = end - p < MAT_PARSE_CONTEXT ? (int)(end - p) : MAT_PARSE_CONTEXT;
+
+	fprintf(stderr, "%s: %s near '%.*s'\n", ps->func, what, context, p);
+	errno = EINVAL;
+	ps->failed = true;
+}
+
+/* Close the current row; empty rows are skipped */
+static void mat_parse_row(struct mat_parse *ps)
+{
+	if (!ps->row_cols)
+		return;
+
+	if (!ps->cols) {
+		ps->cols = ps->row_cols;
+	} else if (ps->row_cols != ps->cols) {
+		fprintf(stderr, "%s: Inconsistent number of columns\n", ps->func);
+		errno = EINVAL;
+		ps->failed = true;
+		return;
+	}
+
+	/* Hand a complete row over, keeping only the next one in the buffer */
+	if (ps->row) {
+		if (!ps->row(ps->ctx, ps->rows, ps->vals, ps->cols)) {
+			fprintf(stderr, "%s: Shape does not match the destination\n", ps->func);
+			errno = EINVAL;
+			ps->failed = true;
+			return;
+		}
+		ps->count = 0;
+	}
+
+	ps->rows++;
+	ps->row_cols = 0;
+}
+
+/* Append a value to the current row */
+static bool mat_parse_push(struct mat_parse *ps, union mat_parse_val v)
+{
+	if (ps->count == ps->cap) {
+		const size_t cap = ps->cap ? 2 * ps->cap : 64;
+		union mat_parse_val *vals = cap <= SIZE_MAX / sizeof(union mat_parse_val) ?
+						    realloc(ps->vals, cap * sizeof(union mat_parse_val)) :
+						    NULL;
+		if (!vals) {
+			perror(ps->func);
+			ps->failed = true;
+			return false;
+		}
+
+		ps->vals = vals;
+		ps->cap = cap;
+	}
+
+	ps->vals[ps->count++] = v;
+	ps->row_cols++;
+
+	return true;
+}
+
+/* Convert the number scanned into n from p..q and append it */
+static void mat_parse_value(struct mat_parse *ps, const struct mat_parse_num *n, const char *p, const char *q, const char *end)
+{
+	union mat_parse_val v;
+	double f;
+
+	/* Integers are exact up to the full 64 bits, never rounded through a double */
+	if (ps->integer && n->integral) {
+		const uint64_t limit = n->neg ? (uint64_t)LLONG_MAX + 1 : (uint64_t)LLONG_MAX;
+
+		if (n->mant && (n->exp10 > 0 || n->mant > limit)) {
+			mat_parse_error(ps, p, end, "Integer out of range");
+			return;
+		}
+
+		v.i = n->neg && n->mant ? -(val_t)(n->mant - 1) - 1 : (val_t)n->mant;
+		mat_parse_push(ps, v);
+		return;
+	}
+
+	if (!mat_parse_fast(n, &f) && !mat_parse_slow(p, (size_t)(q - p), &f)) {
+		perror(ps->func);
+		ps->failed = true;
+		return;
+	}
+
+	if (!ps->integer) {
+		v.f = f;
+	} else if (f >= -9223372036854775808.0 && f < 9223372036854775808.0) {
+		/* Truncated toward zero, as a cast from strtod always did */
+		v.i = (val_t)f;
+	} else {
+		mat_parse_error(ps, p, end, "Integer out of range");
+		return;
+	}
+
+	mat_parse_push(ps, v);
+}
+
+void mat_parse_init(struct mat_parse *ps, bool integer, const char *func)
+{
+	*ps = (struct mat_parse){ .integer = integer, .func = func };
+}
+
+void mat_parse_release(struct mat_parse *ps)
+{
+	free(ps->vals);
+	ps->vals = NULL;
+	ps->count = ps->cap = 0;
+}
+
+size_t mat_parse_feed(struct mat_parse *ps, const char *p, size_t len, bool final)
+{
+	const char *s = p;
+	const char *end = p + len;
+
+	while (s < end && !ps->failed) {
+		if (*s == ';') {
+			mat_parse_row(ps);
+			s++;
+			continue;
+		}
+
+		if (!mat_parse_is_start(*s)) {
+			s++;
+			continue;
+		}
+
+		struct mat_parse_num n;
+		const char *q = mat_parse_scan(s, end, &n);
+
+		/* A number running up to the end may continue in the next chunk */
+		if (!final) {
+			const char *t = q;
+
+			while (t < end && mat_parse_is_num(*t))
+				t++;
+			if (t == end)
+				break;
+		}
+
+		if (q == s) {
+			mat_parse_error(ps, s, end, "Failed to parse number");
+			break;
+		}
+
+		mat_parse_value(ps, &n, s, q, end);
+		s = q;
+	}
+
+	return (size_t)(s - p);
+}
+
+bool mat_parse_finish(struct mat_parse *ps)
+{
+	if (!ps->failed)
+		mat_parse_row(ps);
+
+	if (ps->failed)
+		return false;
+
+	if (!ps->rows) {
+		errno = EINVAL;
+		perror(ps->func);
+		return false;
+	}
+
+	return true;
+}
+
+/* Read up to len bytes from f, or from fd if f is NULL; 0 at the end, -1 on error */
+static ssize_t mat_parse_read(FILE *f, int fd, char *buf, size_t len)
+{
+	if (f) {
+		const size_t n = fread(buf, 1, len, f);
+
+		return n || !ferror(f) ? (ssize_t)n : -1;
+	}
+
+	for (;;) {
+		const ssize_t n = read(fd, buf, len);
+
+		if (n >= 0 || errno != EINTR)
+			return n;
+	}
+}
+
+bool mat_parse_stream(struct mat_parse *ps, FILE *f, int fd)
+{
+	char *buf = malloc(MAT_PARSE_CHUNK);
+	if (!buf) {
+		perror(ps->func);
+		return false;
+	}
+
+	/* Bytes at the start of buf left over from the previous chunk */
+	size_t carry = 0;
+	bool ok = true;
+
+	while (!ps->failed) {
+		const ssize_t n = mat_parse_read(f, fd, buf + carry, MAT_PARSE_CHUNK - carry);
+
+		if (n < 0) {
+			perror(ps->func);
+			ok = false;
+			break;
+		}
+
+		const size_t len = carry + (size_t)n;
+		const size_t used = mat_parse_feed(ps, buf, len, n == 0);
+
+		if (n == 0)
+			break;
+
+		/* Only an unfinished number is left over; one filling the whole chunk is too long */
+		carry = len - used;
+		if (carry == MAT_PARSE_CHUNK) {
+			mat_parse_error(ps, buf, buf + len, "Number too long");
+			break;
+		}
+		memmove(buf, buf + used, carry);
+	}
+
+	free(buf);
+
+	return ok && !ps->failed;
+}
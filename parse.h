@@ -0,0 +1,62 @@
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "fmatrix.h"
+#include "matrix.h"
+
+/*
+ * Single-pass parser for matrix literals such as "[1 2; 3 4]", shared by the
+ * integer and floating-point matrices. Numbers are separated by anything that
+ * cannot continue them, rows by ';'. Values go into one growable buffer while
+ * the shape is worked out on the way; the caller then copies them into a
+ * matrix of that shape. Not part of the public API.
+ */
+
+union mat_parse_val {
+	val_t i;
+	fval_t f;
+};
+
+struct mat_parse {
+	/* Parse integers exactly into i, else floating-point values into f */
+	bool integer;
+	/* Name reported in error messages */
+	const char *func;
+	union mat_parse_val *vals;
+	size_t count, cap;
+	/* Complete rows so far, their width and the values of the current row */
+	size_t rows, cols, row_cols;
+	/* Set once an error has been reported; further input is ignored */
+	bool failed;
+	/*
+	 * If set, every complete row r is handed to row instead of being kept, so
+	 * the buffer only ever holds one row. Returning false rejects the row.
+	 */
+	bool (*row)(void *ctx, size_t r, const union mat_parse_val *vals, size_t cols);
+	void *ctx;
+};
+
+/* Start parsing integer or floating-point values for func */
+void mat_parse_init(struct mat_parse *ps, bool integer, const char *func);
+/* Free the values buffer */
+void mat_parse_release(struct mat_parse *ps);
+
+/*
+ * Parse len bytes of text and return how many were consumed. Unless final is
+ * set, more text may follow, so a number running up to the end is left
+ * unconsumed for the caller to present again with the text after it.
+ */
+size_t mat_parse_feed(struct mat_parse *ps, const char *p, size_t len, bool final);
+/*
+ * Parse everything up to the end of f, or of the file descriptor fd if f is
+ * NULL, a fixed-size chunk at a time; false on a read or parse error
+ */
+bool mat_parse_stream(struct mat_parse *ps, FILE *f, int fd);
+/* End the input; false if it was malformed or had no values */
+bool mat_parse_finish(struct mat_parse *ps);
+
+#endif /* PARSE_H */
@@ -10,16 +10,23 @@ int main(void)
 
 		/* Allocation test */
 		cmocka_unit_test(test_matrix_stack_creation),
+		cmocka_unit_test(test_matrix_stack_spill),
+		cmocka_unit_test(test_matrix_stack_views),
 		cmocka_unit_test(test_matrix_heap_creation),
 		cmocka_unit_test(test_matrix_heap_multiplication),
 		cmocka_unit_test(test_matrix_alloc_valid),
 		cmocka_unit_test(test_matrix_alloc_invalid_dims),
+		cmocka_unit_test(test_matrix_alloc_contiguous),
+		cmocka_unit_test(test_matrix_arena_allocator),
 
 		/* Setters */
 		cmocka_unit_test(test_matrix_set_identity),
 		cmocka_unit_test(test_matrix_identity_new),
 
 		cmocka_unit_test(test_matrix_set_string),
+		cmocka_unit_test(test_matrix_set_stringn),
+		cmocka_unit_test(test_matrix_read),
+		cmocka_unit_test(test_matrix_save_map),
 		cmocka_unit_test(test_matrix_set_and_reset),
 		cmocka_unit_test(test_matrix_set_row_gf2),
 
@@ -34,8 +41,12 @@ int main(void)
 		cmocka_unit_test(test_matrix_addition),
 		cmocka_unit_test(test_matrix_subtraction),
 		cmocka_unit_test(test_matrix_heap_multiplication),
+		cmocka_unit_test(test_matrix_gemm),
 
 		cmocka_unit_test(test_matrix_transposition),
+		cmocka_unit_test(test_matrix_transposition_in_place),
+		cmocka_unit_test(test_matrix_transpose_view),
+		cmocka_unit_test(test_matrix_block_view),
 
 		/* Floating-point matrix tests */
 
@@ -44,11 +55,16 @@ int main(void)
 		cmocka_unit_test(test_fmatrix_heap_multiplication),
 		cmocka_unit_test(test_fmatrix_alloc_valid),
 		cmocka_unit_test(test_fmatrix_alloc_invalid_dims),
+		cmocka_unit_test(test_fmatrix_alloc_contiguous),
+		cmocka_unit_test(test_fmatrix_pool_allocator),
 
 		cmocka_unit_test(test_fmatrix_set_identity),
 		cmocka_unit_test(test_fmatrix_identity_new),
 
 		cmocka_unit_test(test_fmatrix_set_string),
+		cmocka_unit_test(test_fmatrix_set_stringn),
+		cmocka_unit_test(test_fmatrix_read),
+		cmocka_unit_test(test_fmatrix_save_map),
 		cmocka_unit_test(test_fmatrix_set_and_reset),
 		cmocka_unit_test(test_fmatrix_set_row_gf2),
 
@@ -63,9 +79,43 @@ int main(void)
 		cmocka_unit_test(test_fmatrix_addition),
 		cmocka_unit_test(test_fmatrix_subtraction),
 		cmocka_unit_test(test_fmatrix_heap_multiplication),
+		cmocka_unit_test(test_fmatrix_blocked_multiplication),
+		cmocka_unit_test(test_fmatrix_threaded_multiplication),
+		cmocka_unit_test(test_fmatrix_kernels),
+		cmocka_unit_test(test_fmatrix_gemm_accumulate),
+		cmocka_unit_test(test_fmatrix_expression),
+		cmocka_unit_test(test_fmatrix_chain_multiplication),
+		cmocka_unit_test(test_fmatrix_gemv),
+		cmocka_unit_test(test_fmatrix_gemv_batch),
+		cmocka_unit_test(test_fmatrix_batch),
+		cmocka_unit_test(test_fmatrix_fixed),
 
 		cmocka_unit_test(test_fmatrix_transposition),
+		cmocka_unit_test(test_fmatrix_tiled_transposition),
+		cmocka_unit_test(test_fmatrix_tiled),
+		cmocka_unit_test(test_fmatrix_tiled_lu),
+		cmocka_unit_test(test_fmatrix_transposed_multiplication),
+		cmocka_unit_test(test_fmatrix_block_view),
 		cmocka_unit_test(test_fmatrix_inverse),
+		cmocka_unit_test(test_fmatrix_lu_solve),
+		cmocka_unit_test(test_fmatrix_lu_singular),
+		cmocka_unit_test(test_fmatrix_lu_row_order),
+		cmocka_unit_test(test_fmatrix_blocked_inverse),
+		cmocka_unit_test(test_fmatrix_workspace),
+		cmocka_unit_test(test_fmatrix_workspace_inverse),
+
+		/* GF(2) matrix tests */
+
+		cmocka_unit_test(test_gf2matrix_set_row),
+		cmocka_unit_test(test_gf2matrix_addition),
+		cmocka_unit_test(test_gf2matrix_multiplication),
+		cmocka_unit_test(test_gf2matrix_large_multiplication),
+		cmocka_unit_test(test_gf2matrix_transposition),
+		cmocka_unit_test(test_gf2matrix_views),
+		cmocka_unit_test(test_gf2matrix_rank),
+		cmocka_unit_test(test_gf2matrix_inverse),
+		cmocka_unit_test(test_gf2matrix_nullspace),
+		cmocka_unit_test(test_gf2matrix_solve),
 	};
 
 	return cmocka_run_group_tests(tests, NULL, NULL);
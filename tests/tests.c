@@ -143,6 +143,124 @@ void test_matrix_stack_creation(void **state)
 	}
 }
 
+/* Multiply two n x n scoped matrices; returns where the product lived, or NULL if it was wrong */
+static void *matrix_stack_spill_worker(void *arg)
+{
+	const size_t n = *(const size_t *)arg;
+	MATRIX(A, n, n);
+	MATRIX(B, n, n);
+
+	for (size_t i = 0; i < n; i++) {
+		mat_set(A, i, i, 2);
+		mat_set(B, i, (i + 1) % n, 3);
+	}
+
+	MAT_MUL(C, A, B);
+
+	bool ok = C != NULL;
+	for (size_t i = 0; ok && i < n; i++)
+		for (size_t j = 0; ok && j < n; j++)
+			ok = C->data[i][j] == (j == (i + 1) % n ? 6 : 0);
+
+	return ok ? (void *)C : NULL;
+}
+
+void test_matrix_stack_spill(void **state)
+{
+	(void)state;
+
+	/* Small matrices stay inline and own no storage */
+	MATRIX(small, 3, 3);
+	assert_null(small->alloc);
+
+	/* Large ones spill to the thread's pool, which reuses the block */
+	size_t n = 64;
+	void *first = matrix_stack_spill_worker(&n);
+	assert_non_null(first);
+	assert_ptr_equal(matrix_stack_spill_worker(&n), first);
+
+	/* A runtime size well beyond a small thread stack */
+	pthread_attr_t attr;
+	pthread_t thread;
+	void *ret = NULL;
+
+	n = 300;
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, 256 * 1024);
+	assert_int_equal(pthread_create(&thread, &attr, matrix_stack_spill_worker, &n), 0);
+	pthread_join(thread, &ret);
+	pthread_attr_destroy(&attr);
+	assert_non_null(ret);
+}
+
+void test_matrix_stack_views(void **state)
+{
+	(void)state;
+
+	/* Transposed views of non-square matrices are read in place */
+	MATRIX(A, 2, 5);
+	MATRIX(B, 2, 3);
+	MATRIX(S, 5, 2);
+	for (size_t r = 0; r < 2; r++) {
+		for (size_t c = 0; c < 5; c++) {
+			A->data[r][c] = (val_t)(r * 5 + c);
+			S->data[c][r] = 1;
+		}
+		for (size_t c = 0; c < 3; c++)
+			B->data[r][c] = (val_t)(r + c + 1);
+	}
+
+	const struct matrix At = mat_trans_view(A);
+	MAT_MUL(C, &At, B);
+	MAT_ADD(D, &At, S);
+	MAT_SUB(E, &At, S);
+	MAT_TRANS(T, &At);
+	MAT_COPY(K, &At);
+
+	assert_int_equal(C->rows, 5);
+	assert_int_equal(C->cols, 3);
+	for (size_t i = 0; i < 5; i++) {
+		for (size_t j = 0; j < 3; j++)
+			assert_true(C->data[i][j] == A->data[0][i] * B->data[0][j] + A->data[1][i] * B->data[1][j]);
+		for (size_t j = 0; j < 2; j++) {
+			assert_true(D->data[i][j] == A->data[j][i] + 1);
+			assert_true(E->data[i][j] == A->data[j][i] - 1);
+			assert_true(K->data[i][j] == A->data[j][i]);
+		}
+	}
+	assert_true(mat_equal(T, A));
+
+	/* The same through the floating-point macros */
+	FMATRIX(F, 2, 5);
+	FMATRIX(G, 2, 3);
+	for (size_t r = 0; r < 2; r++) {
+		for (size_t c = 0; c < 5; c++)
+			F->data[r][c] = (fval_t)(r * 5 + c) / 4;
+		for (size_t c = 0; c < 3; c++)
+			G->data[r][c] = (fval_t)(r + c + 1);
+	}
+
+	const struct fmatrix Ft = fmat_trans_view(F);
+	FMAT_MUL(H, &Ft, G);
+	FMAT_ADD(I, &Ft, &Ft);
+	FMAT_SUB(Z, &Ft, &Ft);
+	FMAT_TRANS(U, &Ft);
+	FMAT_COPY(V, &Ft);
+
+	assert_int_equal(H->rows, 5);
+	assert_int_equal(H->cols, 3);
+	for (size_t i = 0; i < 5; i++) {
+		for (size_t j = 0; j < 3; j++)
+			assert_true(H->data[i][j] == F->data[0][i] * G->data[0][j] + F->data[1][i] * G->data[1][j]);
+		for (size_t j = 0; j < 2; j++) {
+			assert_true(I->data[i][j] == 2 * F->data[j][i]);
+			assert_true(Z->data[i][j] == 0);
+			assert_true(V->data[i][j] == F->data[j][i]);
+		}
+	}
+	assert_true(fmat_equal(U, F));
+}
+
 void test_matrix_heap_creation(void **state)
 {
 	(void)state;
@@ -200,6 +318,56 @@ void test_matrix_alloc_invalid_dims(void **state)
 	assert_null(A);
 }
 
+void test_matrix_alloc_contiguous(void **state)
+{
+	(void)state;
+
+	struct matrix *A = mat_alloc(3, 5);
+	assert_non_null(A);
+	assert_int_equal((size_t)A->buf % MATRIX_ALIGN, 0);
+	assert_true(A->stride >= A->cols);
+
+	for (size_t r = 0; r < A->rows; r++)
+		assert_ptr_equal(A->data[r], A->buf + r * A->stride);
+
+	mat_free(A);
+}
+
+void test_matrix_arena_allocator(void **state)
+{
+	(void)state;
+
+	struct mat_arena *arena = mat_arena_new(1024);
+	const struct mat_allocator *prev = mat_allocator_set(mat_arena_allocator(arena));
+
+	for (int frame = 0; frame < 3; frame++) {
+		struct matrix *A = mat_alloc(3, 5);
+		struct matrix *B = mat_alloc(3, 5);
+		mat_set(A, 1, 2, 4);
+		mat_set(B, 1, 2, 3);
+
+		/* Intermediate results come from the arena as well */
+		struct matrix *C = mat_add(NULL, A, B);
+		assert_ptr_equal(C->alloc, mat_arena_allocator(arena));
+		assert_int_equal((size_t)C->buf % MATRIX_ALIGN, 0);
+		assert_int_equal(C->data[1][2], 7);
+
+		/* Freeing a single matrix is allowed and reclaims nothing */
+		mat_free(A);
+
+		mat_arena_reset(arena);
+	}
+
+	assert_ptr_equal(mat_allocator_set(prev), mat_arena_allocator(arena));
+	assert_ptr_equal(mat_allocator_get(), &mat_heap_allocator);
+
+	struct matrix *D = mat_alloc(2, 2);
+	assert_ptr_equal(D->alloc, &mat_heap_allocator);
+	mat_free(D);
+
+	mat_arena_free(arena);
+}
+
 void test_matrix_set_identity(void **state)
 {
 	(void)state;
@@ -264,6 +432,139 @@ void test_matrix_set_string(void **state)
 	mat_free(A);
 }
 
+void test_matrix_set_stringn(void **state)
+{
+	(void)state;
+
+	/* 64-bit integers come through exactly, beyond what a double holds */
+	struct matrix *A = mat_set_string("[9223372036854775807 -9223372036854775808; 9007199254740993 -1]");
+	assert_non_null(A);
+	assert_true(A->data[0][0] == LLONG_MAX);
+	assert_true(A->data[0][1] == LLONG_MIN);
+	assert_true(A->data[1][0] == 9007199254740993LL);
+	assert_true(A->data[1][1] == -1);
+	mat_free(A);
+
+	assert_null(mat_set_string("9223372036854775808"));
+
+	/* Only the first len bytes are read; a trailing ';' adds no row */
+	const char buf[] = { '1', ' ', '2', ';', '3', ' ', '4', ';', '5' };
+	struct matrix *B = mat_set_stringn(buf, 8);
+	assert_non_null(B);
+	assert_int_equal(B->rows, 2);
+	assert_int_equal(B->cols, 2);
+	assert_true(B->data[1][1] == 4);
+	mat_free(B);
+
+	assert_null(mat_set_string("1 2; 3"));
+	assert_null(mat_set_string(""));
+}
+
+void test_matrix_read(void **state)
+{
+	(void)state;
+
+	/* Several chunks, so numbers straddle chunk boundaries */
+	FILE *f = tmpfile();
+	assert_non_null(f);
+	for (size_t r = 0; r < 300; r++) {
+		for (size_t c = 0; c < 300; c++)
+			fprintf(f, "%lld ", (long long)(r * 300 + c) * 1000003LL - 40000000000LL);
+		fputs(";\n", f);
+	}
+
+	rewind(f);
+	struct matrix *A = mat_read(NULL, f);
+	assert_non_null(A);
+	assert_int_equal(A->rows, 300);
+	assert_int_equal(A->cols, 300);
+	for (size_t r = 0; r < 300; r++)
+		for (size_t c = 0; c < 300; c++)
+			assert_true(A->data[r][c] == (long long)(r * 300 + c) * 1000003LL - 40000000000LL);
+
+	/* Straight into a destination through the file descriptor */
+	struct matrix *B = mat_alloc(300, 300);
+	assert_int_equal(lseek(fileno(f), 0, SEEK_SET), 0);
+	assert_ptr_equal(mat_read_fd(B, fileno(f)), B);
+	assert_true(mat_equal(A, B));
+
+	/* A destination of another shape is refused */
+	struct matrix *C = mat_alloc(299, 300);
+	rewind(f);
+	assert_null(mat_read(C, f));
+
+	fclose(f);
+	mat_free(A);
+	mat_free(B);
+	mat_free(C);
+}
+
+void test_matrix_save_map(void **state)
+{
+	(void)state;
+
+	char path[] = "/tmp/matfile_XXXXXX";
+	const int fd = mkstemp(path);
+	assert_true(fd >= 0);
+	close(fd);
+
+	struct matrix *A = mat_alloc(37, 21);
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			A->data[r][c] = (val_t)(r * 1000 + c) * 1000000007LL - 5000000000LL;
+
+	assert_true(mat_save(A, path));
+	struct matrix *B = mat_map(path, MAT_MAP_VERIFY);
+	assert_non_null(B);
+	assert_true(mat_equal(A, B));
+	/* Rows come straight from the mapping, aligned as in memory */
+	for (size_t r = 0; r < B->rows; r++)
+		assert_int_equal((uintptr_t)B->data[r] % MATRIX_ALIGN, 0);
+
+	/* The header records the alignment the rows were written with */
+	struct matfile_header hdr;
+	FILE *h = fopen(path, "rb");
+	assert_non_null(h);
+	assert_int_equal(fread(&hdr, sizeof(hdr), 1, h), 1);
+	fclose(h);
+	assert_int_equal(hdr.align, MATRIX_ALIGN);
+	assert_int_equal(hdr.data_offset % MATRIX_ALIGN, 0);
+	assert_int_equal(hdr.stride, B->stride);
+
+	/* Writes to a mapped matrix stay private */
+	B->data[3][4] = 0;
+	struct matrix *C = mat_map(path, 0);
+	assert_non_null(C);
+	assert_true(mat_equal(A, C));
+
+	/* A transposed view is saved as it reads */
+	const struct matrix T = mat_trans_view(A);
+	assert_true(mat_save(&T, path));
+	struct matrix *D = mat_map(path, MAT_MAP_VERIFY);
+	assert_non_null(D);
+	assert_int_equal(D->rows, 21);
+	assert_int_equal(D->cols, 37);
+	assert_true(mat_equal(&T, D));
+
+	/* A damaged element is only caught when verifying; a float file is refused */
+	FILE *f = fopen(path, "r+b");
+	assert_non_null(f);
+	assert_int_equal(fseek(f, sizeof(struct matfile_header) + 8 * 3, SEEK_SET), 0);
+	fputc(0x5a, f);
+	fclose(f);
+	assert_null(mat_map(path, MAT_MAP_VERIFY));
+	struct matrix *E = mat_map(path, 0);
+	assert_non_null(E);
+	assert_null(fmat_map(path, 0));
+
+	unlink(path);
+	mat_free(A);
+	mat_free(B);
+	mat_free(C);
+	mat_free(D);
+	mat_free(E);
+}
+
 void test_matrix_shift_east(void **state)
 {
 	(void)state;
@@ -402,6 +703,29 @@ void test_matrix_multiplication(void **state)
 	mat_free(C);
 }
 
+void test_matrix_gemm(void **state)
+{
+	(void)state;
+
+	struct matrix *A = mat_set_string("1 2; 3 4");
+	struct matrix *B = mat_set_string("5 6; 7 8");
+	struct matrix *C = mat_set_string("1 1; 1 1");
+
+	/* C = 2 * A * B - 3 * C */
+	assert_ptr_equal(mat_gemm(2, A, B, -3, C), C);
+	assert_int_equal(C->data[0][0], 35);
+	assert_int_equal(C->data[0][1], 41);
+	assert_int_equal(C->data[1][0], 83);
+	assert_int_equal(C->data[1][1], 97);
+
+	/* C must exist to accumulate into */
+	assert_null(mat_gemm(1, A, B, 0, NULL));
+
+	mat_free(A);
+	mat_free(B);
+	mat_free(C);
+}
+
 void test_matrix_transposition(void **state)
 {
 	(void)state;
@@ -419,6 +743,111 @@ void test_matrix_transposition(void **state)
 	mat_free(T);
 }
 
+void test_matrix_transposition_in_place(void **state)
+{
+	(void)state;
+
+	/* Not a multiple of the tile or block edge */
+	struct matrix *A = mat_alloc(37, 37);
+
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			mat_set(A, r, c, (val_t)(r * 100 + c));
+
+	struct matrix *T = mat_trans(NULL, A);
+	assert_ptr_equal(mat_trans(A, A), A);
+	assert_true(mat_equal(A, T));
+
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			assert_int_equal(A->data[r][c], (val_t)(c * 100 + r));
+
+	/* Only square matrices can be transposed into themselves */
+	struct matrix *B = mat_alloc(3, 5);
+	assert_null(mat_trans(B, B));
+
+	mat_free(A);
+	mat_free(B);
+	mat_free(T);
+}
+
+void test_matrix_transpose_view(void **state)
+{
+	(void)state;
+
+	struct matrix *A = mat_alloc(3, 2);
+	struct matrix *B = mat_alloc(3, 4);
+
+	for (size_t r = 0; r < 3; r++) {
+		for (size_t c = 0; c < 2; c++)
+			mat_set(A, r, c, (val_t)(r * 2 + c));
+		for (size_t c = 0; c < 4; c++)
+			mat_set(B, r, c, (val_t)(r + c));
+	}
+
+	/* A^T * B straight from the view, against the materialized transpose */
+	struct matrix At = mat_trans_view(A);
+	struct matrix *T = mat_trans(NULL, A);
+	struct matrix *expected = mat_mul(NULL, T, B);
+	struct matrix *C = mat_mul(NULL, &At, B);
+
+	assert_int_equal(At.rows, 2);
+	assert_int_equal(At.cols, 3);
+	assert_int_equal(At.data[0][1], A->data[0][1]);
+	assert_true(mat_equal(&At, T));
+	assert_true(mat_equal(C, expected));
+
+	/* Writing through the view lands in the viewed matrix */
+	mat_copy(&At, T);
+	mat_add(&At, T, &At);
+	for (size_t r = 0; r < 3; r++)
+		for (size_t c = 0; c < 2; c++)
+			assert_int_equal(A->data[r][c], (val_t)(2 * (r * 2 + c)));
+
+	mat_free(A);
+	mat_free(B);
+	mat_free(T);
+	mat_free(expected);
+	mat_free(C);
+}
+
+void test_matrix_block_view(void **state)
+{
+	(void)state;
+
+	struct matrix *A = mat_alloc(5, 6);
+
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			mat_set(A, r, c, (val_t)(r * 10 + c));
+
+	struct matrix *B = mat_block_view(A, 1, 2, 3, 3);
+	assert_non_null(B);
+	assert_int_equal(B->data[0][0], 12);
+
+	/* Update the block in place; everything around it stays put */
+	struct matrix *I = mat_identity_new(3);
+	assert_ptr_equal(mat_add(B, B, I), B);
+	mat_shift_east(B, 1);
+
+	for (size_t r = 0; r < A->rows; r++) {
+		for (size_t c = 0; c < A->cols; c++) {
+			val_t expected = (val_t)(r * 10 + c);
+
+			if (r >= 1 && r < 4 && c >= 2 && c < 5)
+				expected = c == 2 ? 0 : (val_t)(r * 10 + c - 1) + (c == r + 2 ? 1 : 0);
+			assert_int_equal(A->data[r][c], expected);
+		}
+	}
+
+	/* Blocks past the edge are refused */
+	assert_null(mat_block_view(A, 3, 0, 3, 1));
+
+	mat_free(B);
+	mat_free(I);
+	mat_free(A);
+}
+
 /*
  * Floating-point matrix tests
  */
@@ -503,6 +932,51 @@ void test_fmatrix_alloc_invalid_dims(void **state)
 	assert_null(A);
 }
 
+void test_fmatrix_alloc_contiguous(void **state)
+{
+	(void)state;
+
+	struct fmatrix *A = fmat_alloc(3, 5);
+	assert_non_null(A);
+	assert_int_equal((size_t)A->buf % FMATRIX_ALIGN, 0);
+	assert_true(A->stride >= A->cols);
+
+	for (size_t r = 0; r < A->rows; r++)
+		assert_ptr_equal(A->data[r], A->buf + r * A->stride);
+
+	fmat_free(A);
+}
+
+void test_fmatrix_pool_allocator(void **state)
+{
+	(void)state;
+
+	struct mat_pool *pool = mat_pool_new();
+	const struct mat_allocator *prev = mat_allocator_set(mat_pool_allocator(pool));
+
+	struct fmatrix *A = fmat_alloc(4, 6);
+	fval_t *storage = A->buf;
+	fmat_free(A);
+
+	/* A freed block is handed out again to a matrix of the same size class */
+	struct fmatrix *B = fmat_alloc(4, 6);
+	assert_ptr_equal(B->buf, storage);
+	assert_float_equal(B->data[3][5], 0.0, 0.0);
+	assert_int_equal((size_t)B->buf % FMATRIX_ALIGN, 0);
+
+	/* Reset takes back every outstanding block at once */
+	struct fmatrix *C = fmat_alloc(4, 6);
+	assert_ptr_not_equal(C->buf, storage);
+	mat_pool_reset(pool);
+
+	struct fmatrix *D = fmat_alloc(4, 6);
+	struct fmatrix *E = fmat_alloc(4, 6);
+	assert_true(D->buf == storage || E->buf == storage);
+
+	mat_allocator_set(prev);
+	mat_pool_free(pool);
+}
+
 void test_fmatrix_set_identity(void **state)
 {
 	(void)state;
@@ -567,6 +1041,244 @@ void test_fmatrix_set_string(void **state)
 	fmat_free(A);
 }
 
+void test_fmatrix_set_stringn(void **state)
+{
+	(void)state;
+
+	/* Exponents, signs and leading points are single numbers */
+	const char buf[] = "[1e3, -2.5E-2; .5 +4] trailing 6";
+	struct fmatrix *A = fmat_set_stringn(buf, strlen("[1e3, -2.5E-2; .5 +4]"));
+	assert_non_null(A);
+	assert_int_equal(A->rows, 2);
+	assert_int_equal(A->cols, 2);
+	assert_true(A->data[0][0] == 1000.0);
+	assert_true(A->data[0][1] == -0.025);
+	assert_true(A->data[1][0] == 0.5);
+	assert_true(A->data[1][1] == 4.0);
+	fmat_free(A);
+
+	/* Values the fast path cannot do exactly still round like strtod */
+	const char *hard = "0.1 2.2250738585072014e-308 1.7976931348623157e308 123456789012345678901234567890";
+	struct fmatrix *B = fmat_set_string(hard);
+	assert_non_null(B);
+	const char *p = hard;
+	for (size_t c = 0; c < B->cols; c++) {
+		char *end;
+		assert_true(B->data[0][c] == strtod(p, &end));
+		p = end;
+	}
+	fmat_free(B);
+
+	assert_null(fmat_set_string("1 - 2"));
+}
+
+void test_fmatrix_read(void **state)
+{
+	(void)state;
+
+	FILE *f = tmpfile();
+	assert_non_null(f);
+	for (size_t r = 0; r < 200; r++) {
+		for (size_t c = 0; c < 200; c++)
+			fprintf(f, "%.17g ", ((double)r - 100.5) / ((double)c + 0.3));
+		fputs(";\n", f);
+	}
+
+	/* The same text read whole and streamed gives the same matrix */
+	const long len = ftell(f);
+	char *text = malloc((size_t)len);
+	assert_non_null(text);
+	rewind(f);
+	assert_int_equal(fread(text, 1, (size_t)len, f), len);
+
+	struct fmatrix *A = fmat_set_stringn(text, (size_t)len);
+	rewind(f);
+	struct fmatrix *B = fmat_read(NULL, f);
+	assert_non_null(A);
+	assert_non_null(B);
+	assert_true(fmat_equal(A, B));
+
+	/* Into a transposed view, row by row */
+	struct fmatrix *C = fmat_alloc(200, 200);
+	struct fmatrix Ct = fmat_trans_view(C);
+	rewind(f);
+	assert_ptr_equal(fmat_read(&Ct, f), &Ct);
+	assert_true(fmat_equal(&Ct, A));
+
+	fclose(f);
+	free(text);
+	fmat_free(A);
+	fmat_free(B);
+	fmat_free(C);
+}
+
+void test_fmatrix_save_map(void **state)
+{
+	(void)state;
+
+	char path[] = "/tmp/fmatfile_XXXXXX";
+	const int fd = mkstemp(path);
+	assert_true(fd >= 0);
+	close(fd);
+
+	struct fmatrix *A = fmat_alloc(19, 40);
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			A->data[r][c] = sin((double)(r * 40 + c)) * 1e10;
+
+	assert_true(fmat_save(A, path));
+	struct fmatrix *B = fmat_map(path, MAT_MAP_VERIFY);
+	assert_non_null(B);
+	assert_int_equal(B->rows, 19);
+	assert_int_equal(B->cols, 40);
+	for (size_t r = 0; r < A->rows; r++)
+		assert_memory_equal(A->data[r], B->data[r], A->cols * sizeof(fval_t));
+
+	/* Mapped matrices work as operands like any other */
+	struct fmatrix *C = fmat_add(NULL, A, B);
+	assert_non_null(C);
+	assert_true(C->data[7][9] == 2 * A->data[7][9]);
+
+	/* A truncated file or an integer file is refused */
+	assert_int_equal(truncate(path, sizeof(struct matfile_header) + 8 * 40 * 10), 0);
+	assert_null(fmat_map(path, 0));
+	struct matrix *M = mat_alloc(2, 2);
+	assert_true(mat_save(M, path));
+	assert_null(fmat_map(path, 0));
+
+	unlink(path);
+	fmat_free(A);
+	fmat_free(B);
+	fmat_free(C);
+	mat_free(M);
+}
+
+void test_fmatrix_tiled(void **state)
+{
+	(void)state;
+
+	/* Edge tiles on every side, and a cache far smaller than the matrices */
+	struct fmatrix *A = fmat_alloc(37, 29);
+	struct fmatrix *B = fmat_alloc(29, 45);
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			A->data[r][c] = sin((double)(r * 31 + c));
+	for (size_t r = 0; r < B->rows; r++)
+		for (size_t c = 0; c < B->cols; c++)
+			B->data[r][c] = cos((double)(r * 17 + c));
+
+	struct fmat_tiled *TA = fmat_tiled_create(NULL, 37, 29, 8, 0);
+	struct fmat_tiled *TB = fmat_tiled_create(NULL, 29, 45, 8, 0);
+	assert_non_null(TA);
+	assert_non_null(TB);
+	assert_ptr_equal(fmat_tiled_load(TA, A), TA);
+	assert_ptr_equal(fmat_tiled_load(TB, B), TB);
+
+	struct fmatrix *C = fmat_mul(NULL, A, B);
+	struct fmat_tiled *TC = fmat_tiled_mul(NULL, TA, TB);
+	assert_non_null(TC);
+	struct fmatrix *D = fmat_tiled_store(NULL, TC);
+	assert_non_null(D);
+	for (size_t r = 0; r < C->rows; r++)
+		for (size_t c = 0; c < C->cols; c++)
+			assert_true(fabs(C->data[r][c] - D->data[r][c]) < 1e-12);
+
+	/* The sum reads each tile of its operands once */
+	struct fmat_tiled *TT = fmat_tiled_trans(NULL, TA);
+	assert_non_null(TT);
+	assert_true(fabs(fmat_tiled_get(TT, 20, 36) - A->data[36][20]) == 0);
+	const size_t reads = TB->reads;
+	struct fmat_tiled *TS = fmat_tiled_add(NULL, TT, TB);
+	assert_null(TS);
+	TS = fmat_tiled_add(NULL, TB, TB);
+	assert_non_null(TS);
+	assert_int_equal(TB->reads - reads, TB->tile_rows * TB->tile_cols);
+	assert_true(fmat_tiled_get(TS, 28, 44) == 2 * B->data[28][44]);
+
+	/* Saved to a file and opened again */
+	char path[] = "/tmp/fmat_tiled_XXXXXX";
+	const int fd = mkstemp(path);
+	assert_true(fd >= 0);
+	close(fd);
+	struct fmat_tiled *TP = fmat_tiled_create(path, 37, 29, 8, 0);
+	assert_non_null(TP);
+	fmat_tiled_load(TP, A);
+	fmat_tiled_set(TP, 36, 28, 5);
+	assert_true(fmat_tiled_free(TP));
+	TP = fmat_tiled_open(path, 1 << 20);
+	assert_non_null(TP);
+	assert_true(fmat_tiled_get(TP, 36, 28) == 5);
+	assert_true(fmat_tiled_get(TP, 10, 11) == A->data[10][11]);
+	unlink(path);
+
+	fmat_free(A);
+	fmat_free(B);
+	fmat_free(C);
+	fmat_free(D);
+	fmat_tiled_free(TA);
+	fmat_tiled_free(TB);
+	fmat_tiled_free(TC);
+	fmat_tiled_free(TT);
+	fmat_tiled_free(TS);
+	fmat_tiled_free(TP);
+}
+
+void test_fmatrix_tiled_lu(void **state)
+{
+	(void)state;
+
+	/* A symmetric positive definite matrix, B * B^T + n * I */
+	const size_t n = 45;
+	struct fmatrix *B = fmat_alloc(n, n);
+	for (size_t r = 0; r < n; r++)
+		for (size_t c = 0; c < n; c++)
+			B->data[r][c] = sin((double)(r * n + c));
+	struct fmatrix *A = fmat_alloc(n, n);
+	for (size_t r = 0; r < n; r++)
+		for (size_t c = 0; c < n; c++)
+			for (size_t k = 0; k < n; k++)
+				A->data[r][c] += B->data[r][k] * B->data[c][k];
+	for (size_t i = 0; i < n; i++)
+		A->data[i][i] += n;
+
+	struct fmat_tiled *T = fmat_tiled_create(NULL, n, n, 8, 0);
+	assert_non_null(T);
+	fmat_tiled_load(T, A);
+	assert_ptr_equal(fmat_tiled_lu(T), T);
+
+	/* L * U gives back A */
+	struct fmatrix *LU = fmat_tiled_store(NULL, T);
+	assert_non_null(LU);
+	for (size_t r = 0; r < n; r++) {
+		for (size_t c = 0; c < n; c++) {
+			fval_t sum = 0;
+			for (size_t k = 0; k <= (r < c ? r : c); k++)
+				sum += (k == r ? 1 : LU->data[r][k]) * LU->data[k][c];
+			assert_true(fabs(sum - A->data[r][c]) < 1e-9 * n);
+		}
+	}
+
+	/* A vanishing pivot is reported */
+	struct fmat_tiled *Z = fmat_tiled_create(NULL, 10, 10, 8, 0);
+	assert_null(fmat_tiled_lu(Z));
+
+	/* So is a tiny one, on the same matrices the in-memory LU finds singular */
+	struct fmatrix *N = fmat_identity_new(10);
+	N->data[9][9] = 1e-14;
+	struct fmat_lu *lu = fmat_lu_new(N);
+	assert_true(lu->singular);
+	fmat_lu_free(lu);
+	fmat_tiled_load(Z, N);
+	assert_null(fmat_tiled_lu(Z));
+	fmat_free(N);
+
+	fmat_free(A);
+	fmat_free(B);
+	fmat_free(LU);
+	fmat_tiled_free(T);
+	fmat_tiled_free(Z);
+}
+
 void test_fmatrix_shift_east(void **state)
 {
 	(void)state;
@@ -705,48 +1417,1293 @@ void test_fmatrix_multiplication(void **state)
 	fmat_free(C);
 }
 
-void test_fmatrix_transposition(void **state)
+void test_fmatrix_blocked_multiplication(void **state)
 {
 	(void)state;
 
-	struct fmatrix *A = fmat_alloc(2, 3);
-	fmat_set(A, 0, 1, 1);
-	fmat_set(A, 1, 2, 1);
+	/* Large enough to go through the packed GEMM path, with ragged edges */
+	struct fmatrix *A = fmat_alloc(150, 97);
+	struct fmatrix *B = fmat_alloc(97, 203);
 
-	struct fmatrix *T = fmat_trans(NULL, A);
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			fmat_set(A, r, c, (double)((r * 7 + c * 3) % 11) - 5.0);
 
-	if (!jl_test_fmat(T, "[0. 0.; 1. 0.; 0. 1.]", 1e-12, 1e-12))
-		fail();
+	for (size_t r = 0; r < B->rows; r++)
+		for (size_t c = 0; c < B->cols; c++)
+			fmat_set(B, r, c, (double)((r * 5 + c) % 13) / 4.0);
+
+	struct fmatrix *C = fmat_mul(NULL, A, B);
+	assert_non_null(C);
+
+	for (size_t i = 0; i < C->rows; i++) {
+		for (size_t j = 0; j < C->cols; j++) {
+			double sum = 0.0;
+
+			for (size_t k = 0; k < A->cols; k++)
+				sum += A->data[i][k] * B->data[k][j];
+
+			assert_float_equal(C->data[i][j], sum, 1e-9);
+		}
+	}
 
 	fmat_free(A);
-	fmat_free(T);
+	fmat_free(B);
+	fmat_free(C);
 }
 
-void test_fmatrix_inverse(void **state)
+void test_fmatrix_threaded_multiplication(void **state)
 {
 	(void)state;
 
-	struct fmatrix *A = fmat_alloc(3, 3);
-	fmat_set(A, 0, 0, 2);
-	fmat_set(A, 1, 0, 1);
-	fmat_set(A, 2, 0, 0);
-	fmat_set(A, 0, 1, -1);
-	fmat_set(A, 1, 1, 2);
-	fmat_set(A, 2, 1, -1);
-	fmat_set(A, 0, 2, 0);
-	fmat_set(A, 1, 2, -2);
-	fmat_set(A, 2, 2, 1);
+	struct fmatrix *A = fmat_alloc(300, 120);
+	struct fmatrix *B = fmat_alloc(120, 90);
 
-	struct fmatrix *T = fmat_inv(NULL, A);
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			fmat_set(A, r, c, (double)((r + 3 * c) % 17) - 8.0);
 
-	if (!jl_test_fmat(T,
-			  "inv([2. -1. 0.;"
-			  "     1. 2. -2.;"
-			  "     0. -1. 1.])",
+	for (size_t r = 0; r < B->rows; r++)
+		for (size_t c = 0; c < B->cols; c++)
+			fmat_set(B, r, c, (double)((2 * r + c) % 7) / 2.0);
+
+	threadpool_set_threads(1);
+	struct fmatrix *serial = fmat_mul(NULL, A, B);
+
+	threadpool_set_threads(4);
+	assert_int_equal(threadpool_get_threads(), 4);
+	struct fmatrix *parallel = fmat_mul(NULL, A, B);
+
+	/* Every element is accumulated in the same order regardless of the split */
+	assert_true(fmat_equal(serial, parallel));
+
+	threadpool_set_threads(0);
+
+	fmat_free(A);
+	fmat_free(B);
+	fmat_free(serial);
+	fmat_free(parallel);
+}
+
+/* True if x and y agree to a few ulps of the larger magnitudes in play, scale */
+static bool kernels_close(fval_t x, fval_t y, fval_t scale)
+{
+	return fabs(x - y) <= 1e-13 * (scale > 1 ? scale : 1);
+}
+
+void test_fmatrix_kernels(void **state)
+{
+	(void)state;
+
+	/* Lengths with every tail the vector loops can leave */
+	static const size_t lens[] = { 0, 1, 3, 4, 7, 8, 9, 15, 16, 17, 31, 33, 64, 67 };
+	const struct fkernels *selected = fkernels;
+	const struct fkernels *k;
+	fval_t a[67], b[67], d[67], ref[67];
+
+	for (size_t i = 0; i < 67; i++) {
+		a[i] = sin((double)i + 0.5) * 3;
+		b[i] = cos((double)i * 1.7) - 0.25;
+	}
+
+	for (size_t t = 0; (k = fkernels_available(t)); t++) {
+		for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+			const size_t n = lens[l];
+			fval_t dot = 0;
+
+			/* Elements past n must be left alone */
+			for (size_t i = 0; i < 67; i++)
+				d[i] = ref[i] = 42;
+
+			k->add(d, a, b, n);
+			for (size_t i = 0; i < n; i++)
+				ref[i] = a[i] + b[i];
+			assert_memory_equal(d, ref, sizeof(d));
+
+			k->sub(d, a, b, n);
+			for (size_t i = 0; i < n; i++)
+				ref[i] = a[i] - b[i];
+			assert_memory_equal(d, ref, sizeof(d));
+
+			k->mul(d, a, b, n);
+			for (size_t i = 0; i < n; i++)
+				ref[i] = a[i] * b[i];
+			assert_memory_equal(d, ref, sizeof(d));
+
+			k->scale(d, -1.5, a, n);
+			for (size_t i = 0; i < n; i++)
+				ref[i] = -1.5 * a[i];
+			assert_memory_equal(d, ref, sizeof(d));
+
+			/* Fused and unfused multiply-adds round differently */
+			k->madd(d, a, b, n);
+			k->msub(d, b, b, n);
+			k->axpy(d, 0.75, a, n);
+			for (size_t i = 0; i < n; i++) {
+				ref[i] += a[i] * b[i] - b[i] * b[i] + 0.75 * a[i];
+				dot += a[i] * b[i];
+			}
+			for (size_t i = 0; i < 67; i++)
+				assert_true(kernels_close(d[i], ref[i], 10));
+
+			assert_true(kernels_close(k->dot(a, b, n), dot, (fval_t)n * 3));
+		}
+
+		/* A 4 x 4 transpose between rows of a wider matrix */
+		fval_t src[4][6], dst[4][6];
+		void *dp[4];
+		const void *sp[4];
+		for (size_t i = 0; i < 4; i++) {
+			for (size_t j = 0; j < 6; j++) {
+				src[i][j] = (fval_t)(i * 6 + j);
+				dst[i][j] = -1;
+			}
+			sp[i] = &src[i][1];
+			dp[i] = &dst[i][2];
+		}
+		k->trans4(dp, sp);
+		for (size_t i = 0; i < 4; i++)
+			for (size_t j = 0; j < 6; j++)
+				assert_true(dst[i][j] == (j >= 2 && j < 6 ? src[j - 2][i + 1] : -1));
+
+		/* One micro-kernel call on aligned packed panels, stored whole and at every partial corner */
+		const size_t kc = 5;
+		_Alignas(64) fval_t pa[16 * 5], pb[32 * 5];
+		fval_t cbuf[16][32], *c[16];
+		for (size_t i = 0; i < k->mr * kc; i++)
+			pa[i] = sin((double)i);
+		for (size_t i = 0; i < k->nr * kc; i++)
+			pb[i] = cos((double)i);
+		for (size_t i = 0; i < 16; i++)
+			c[i] = cbuf[i];
+
+		for (size_t rows = 1; rows <= k->mr; rows++) {
+			for (size_t cols = 1; cols <= k->nr; cols++) {
+				for (int acc = 0; acc < 2; acc++) {
+					for (size_t i = 0; i < 16; i++)
+						for (size_t j = 0; j < 32; j++)
+							cbuf[i][j] = 1;
+
+					k->gemm(kc, pa, pb, c, 1, 2, rows, cols, acc);
+
+					for (size_t i = 0; i < 16; i++) {
+						for (size_t j = 0; j < 32; j++) {
+							fval_t want = 1;
+
+							if (i >= 1 && i < 1 + rows && j >= 2 && j < 2 + cols) {
+								want = acc ? 1 : 0;
+								for (size_t p = 0; p < kc; p++)
+									want += pa[p * k->mr + i - 1] * pb[p * k->nr + j - 2];
+							}
+							assert_true(kernels_close(cbuf[i][j], want, 10));
+						}
+					}
+				}
+			}
+		}
+
+		/* Whole products through the blocked engine, on shapes off the register tile */
+		fkernels = k;
+		struct fmatrix *A = fmat_alloc(37, 29);
+		struct fmatrix *B = fmat_alloc(29, 23);
+		for (size_t i = 0; i < 37; i++)
+			for (size_t j = 0; j < 29; j++)
+				A->data[i][j] = sin((double)(i * 29 + j));
+		for (size_t i = 0; i < 29; i++)
+			for (size_t j = 0; j < 23; j++)
+				B->data[i][j] = cos((double)(i * 23 + j));
+		struct fmatrix *C = fmat_mul(NULL, A, B);
+		fkernels = selected;
+
+		assert_non_null(C);
+		for (size_t i = 0; i < 37; i++) {
+			for (size_t j = 0; j < 23; j++) {
+				fval_t want = 0;
+				for (size_t p = 0; p < 29; p++)
+					want += A->data[i][p] * B->data[p][j];
+				assert_true(kernels_close(C->data[i][j], want, 29));
+			}
+		}
+
+		fmat_free(A);
+		fmat_free(B);
+		fmat_free(C);
+	}
+}
+
+void test_fmatrix_gemm_accumulate(void **state)
+{
+	(void)state;
+
+	/* Large enough for the packed product */
+	struct fmatrix *A = fmat_alloc(100, 70);
+	struct fmatrix *B = fmat_alloc(70, 90);
+	struct fmatrix *C = fmat_alloc(100, 90);
+
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			fmat_set(A, r, c, (double)((r + 2 * c) % 7) - 3.0);
+	for (size_t r = 0; r < B->rows; r++)
+		for (size_t c = 0; c < B->cols; c++)
+			fmat_set(B, r, c, (double)((3 * r + c) % 5) - 2.0);
+	for (size_t r = 0; r < C->rows; r++)
+		for (size_t c = 0; c < C->cols; c++)
+			fmat_set(C, r, c, (double)(r + c));
+
+	struct fmatrix *P = fmat_mul(NULL, A, B);
+	struct fmatrix *old = fmat_copy(NULL, C);
+
+	/* C = 2 * A * B + 0.5 * C in one pass */
+	assert_ptr_equal(fmat_gemm(2.0, A, B, 0.5, C), C);
+	for (size_t r = 0; r < C->rows; r++)
+		for (size_t c = 0; c < C->cols; c++)
+			assert_float_equal(C->data[r][c], 2.0 * P->data[r][c] + 0.5 * old->data[r][c], 0.0);
+
+	/* With beta 0 the old contents are not read, not even a NaN */
+	fmat_set(C, 3, 4, NAN);
+	assert_ptr_equal(fmat_gemm(1.0, A, B, 0.0, C), C);
+	assert_true(fmat_equal(C, P));
+
+	assert_null(fmat_gemm(1.0, B, A, 1.0, C));
+
+	fmat_free(A);
+	fmat_free(B);
+	fmat_free(C);
+	fmat_free(P);
+	fmat_free(old);
+}
+
+void test_fmatrix_expression(void **state)
+{
+	(void)state;
+
+	/* Wider than one evaluation strip */
+	struct fmatrix *A = fmat_alloc(5, 700);
+	struct fmatrix *B = fmat_alloc(5, 700);
+	struct fmatrix *C = fmat_alloc(700, 5);
+
+	for (size_t r = 0; r < A->rows; r++) {
+		for (size_t c = 0; c < A->cols; c++) {
+			fmat_set(A, r, c, (double)(r + c));
+			fmat_set(B, r, c, (double)c - 2.0 * (double)r);
+			fmat_set(C, c, r, (double)(c % 9));
+		}
+	}
+
+	/* |0.5 * (A + B) .* C^T - B|, with C^T read through a view */
+	struct fmatrix Ct = fmat_trans_view(C);
+	struct fexpr *half_sum = fexpr_scale(fexpr_add(fexpr_mat(A), fexpr_mat(B)), 0.5);
+	struct fexpr *e = fexpr_map(fexpr_sub(fexpr_mul(half_sum, fexpr_mat(&Ct)), fexpr_mat(B)), fabs);
+	assert_non_null(e);
+	assert_int_equal(fexpr_rows(e), 5);
+	assert_int_equal(fexpr_cols(e), 700);
+
+	struct fmatrix *R = fexpr_eval(NULL, e);
+	assert_non_null(R);
+	for (size_t r = 0; r < R->rows; r++) {
+		for (size_t c = 0; c < R->cols; c++) {
+			const double v = 0.5 * (A->data[r][c] + B->data[r][c]) * C->data[c][r] - B->data[r][c];
+
+			assert_float_equal(R->data[r][c], fabs(v), 0.0);
+		}
+	}
+
+	/* Evaluating into one of the operands */
+	struct fexpr *sum = fexpr_add(fexpr_mat(A), fexpr_mat(B));
+	struct fmatrix *expected = fmat_add(NULL, A, B);
+	assert_ptr_equal(fexpr_eval(A, sum), A);
+	assert_true(fmat_equal(A, expected));
+
+	/* Shape mismatches fail while building, freeing the operands */
+	assert_null(fexpr_add(fexpr_mat(A), fexpr_mat(C)));
+
+	fexpr_free(e);
+	fexpr_free(sum);
+	fmat_free(A);
+	fmat_free(B);
+	fmat_free(C);
+	fmat_free(R);
+	fmat_free(expected);
+}
+
+void test_fmatrix_chain_multiplication(void **state)
+{
+	(void)state;
+
+	struct fmatrix *A = fmat_alloc(10, 100);
+	struct fmatrix *B = fmat_alloc(100, 5);
+	struct fmatrix *C = fmat_alloc(5, 50);
+	struct fmatrix *D = fmat_alloc(50, 1);
+
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			fmat_set(A, r, c, (double)((r + c) % 3));
+	for (size_t r = 0; r < B->rows; r++)
+		for (size_t c = 0; c < B->cols; c++)
+			fmat_set(B, r, c, (double)((r * c) % 4) - 1.0);
+	for (size_t r = 0; r < C->rows; r++)
+		for (size_t c = 0; c < C->cols; c++)
+			fmat_set(C, r, c, (double)(r + 2 * c) / 4.0);
+	for (size_t r = 0; r < D->rows; r++)
+		fmat_set(D, r, 0, (double)(r % 5));
+
+	/* (A * B) * C takes 7500 multiply-adds against 75000 for A * (B * C) */
+	const struct fmatrix *abc[] = { A, B, C };
+	struct fmat_chain *chain = fmat_chain_new(abc, 3);
+	assert_non_null(chain);
+	assert_int_equal(fmat_chain_cost(chain), 7500);
+
+	struct fmatrix *AB = fmat_mul(NULL, A, B);
+	struct fmatrix *expected = fmat_mul(NULL, AB, C);
+	struct fmatrix *R = fmat_chain_mul(NULL, chain, abc);
+	assert_true(fmat_equal(R, expected));
+
+	/* The plan runs again into the same destination */
+	fmat_reset(R);
+	assert_ptr_equal(fmat_chain_mul(R, chain, abc), R);
+	assert_true(fmat_equal(R, expected));
+
+	/* Longer chain in one call, planned as A * (B * (C * D)) */
+	const struct fmatrix *abcd[] = { A, B, C, D };
+	struct fmatrix *v = fmat_mul_chain(NULL, abcd, 4);
+	struct fmatrix *expected_v = fmat_mul(NULL, expected, D);
+	assert_non_null(v);
+	assert_int_equal(v->rows, 10);
+	assert_int_equal(v->cols, 1);
+	assert_true(fmat_equal(v, expected_v));
+
+	/* Shapes that do not chain */
+	const struct fmatrix *bad[] = { A, C };
+	assert_null(fmat_chain_new(bad, 2));
+
+	fmat_chain_free(chain);
+	fmat_free(A);
+	fmat_free(B);
+	fmat_free(C);
+	fmat_free(D);
+	fmat_free(AB);
+	fmat_free(expected);
+	fmat_free(R);
+	fmat_free(v);
+	fmat_free(expected_v);
+}
+
+void test_fmatrix_gemv(void **state)
+{
+	(void)state;
+
+	struct fmatrix *A = fmat_set_string("1 2 3; 4 5 6");
+	struct fvector *x = fvec_alloc(3);
+	struct fvector *y = fvec_alloc(2);
+
+	x->data[0] = 1;
+	x->data[1] = 0;
+	x->data[2] = -1;
+	y->data[0] = 10;
+	y->data[1] = 20;
+
+	/* y = 2 * A * x + y */
+	assert_ptr_equal(fmat_gemv(2.0, A, x, 1.0, y), y);
+	assert_float_equal(y->data[0], 6.0, 0.0);
+	assert_float_equal(y->data[1], 16.0, 0.0);
+
+	/* x = y^T * A, and the same through A^T */
+	FVECTOR(v, 2);
+	v->data[0] = 1;
+	v->data[1] = -1;
+	assert_ptr_equal(fmat_gevm(1.0, v, A, 0.0, x), x);
+	assert_float_equal(x->data[0], -3.0, 0.0);
+	assert_float_equal(x->data[1], -3.0, 0.0);
+	assert_float_equal(x->data[2], -3.0, 0.0);
+
+	struct fmatrix At = fmat_trans_view(A);
+	struct fvector *z = fvec_alloc(3);
+	assert_ptr_equal(fmat_gemv(1.0, &At, v, 0.0, z), z);
+	for (size_t i = 0; i < 3; i++)
+		assert_float_equal(z->data[i], x->data[i], 0.0);
+
+	/* Lengths must match the matrix */
+	assert_null(fmat_gemv(1.0, A, y, 0.0, y));
+
+	/* A scoped vector too long for its inline buffer spills instead of growing the stack */
+	assert_null(v->alloc);
+	FVECTOR(big, 5000);
+	assert_non_null(big);
+	assert_ptr_equal(big->alloc, mat_spill_allocator());
+	for (size_t i = 0; i < big->len; i++)
+		assert_true(big->data[i] == 0);
+
+	fmat_free(A);
+	fvec_free(x);
+	fvec_free(y);
+	fvec_free(z);
+}
+
+void test_fmatrix_gemv_batch(void **state)
+{
+	(void)state;
+
+	/* Big enough to be split into several panels */
+	struct fmatrix *A = fmat_alloc(300, 200);
+	struct fvector *x[3];
+	struct fvector *y[3];
+
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			fmat_set(A, r, c, (double)((r * 3 + c) % 7) - 3.0);
+
+	for (size_t v = 0; v < 3; v++) {
+		x[v] = fvec_alloc(A->cols);
+		y[v] = fvec_alloc(A->rows);
+		for (size_t c = 0; c < A->cols; c++)
+			x[v]->data[c] = (double)((c + v) % 4);
+	}
+
+	assert_true(fmat_gemv_batch(1.0, A, (const struct fvector *const *)x, 0.0, y, 3));
+
+	struct fvector *expected = fvec_alloc(A->rows);
+	for (size_t v = 0; v < 3; v++) {
+		fmat_gemv(1.0, A, x[v], 0.0, expected);
+		for (size_t r = 0; r < A->rows; r++)
+			assert_float_equal(y[v]->data[r], expected->data[r], 0.0);
+	}
+
+	/* A vector cannot be both an input and its own output */
+	struct fmatrix *S = fmat_alloc(A->cols, A->cols);
+	struct fvector *aliased[3] = { x[2], x[1], x[0] };
+	assert_false(fmat_gemv_batch(1.0, S, (const struct fvector *const *)x, 0.0, aliased, 3));
+	fmat_free(S);
+
+	for (size_t v = 0; v < 3; v++) {
+		fvec_free(x[v]);
+		fvec_free(y[v]);
+	}
+	fvec_free(expected);
+	fmat_free(A);
+}
+
+void test_fmatrix_batch(void **state)
+{
+	(void)state;
+
+	/* Enough matrices to end on a partial strip */
+	const size_t count = 300;
+
+	for (size_t order = 2; order <= 4; order++) {
+		struct fmat_batch *a = fmat_batch_alloc(count, order, order);
+		struct fmat_batch *b = fmat_batch_alloc(count, order, order);
+		struct fmatrix *m = fmat_alloc(order, order);
+		struct fmatrix *n = fmat_alloc(order, order);
+		struct fmatrix *expected = fmat_alloc(order, order);
+		struct fmatrix *got = fmat_alloc(order, order);
+
+		/* Diagonally dominant, so every matrix is invertible */
+		for (size_t k = 0; k < count; k++) {
+			for (size_t r = 0; r < order; r++) {
+				for (size_t c = 0; c < order; c++) {
+					const fval_t v = (double)((k + 3 * r + 5 * c) % 7) - 3.0;
+
+					fmat_batch_set(a, k, r, c, r == c ? v + 10.0 : v);
+					fmat_batch_set(b, k, r, c, (double)((k * r + c) % 5));
+				}
+			}
+		}
+
+		struct fmat_batch *sum = fmat_batch_add(NULL, a, b);
+		struct fmat_batch *prod = fmat_batch_mul(NULL, a, b);
+		struct fmat_batch *trans = fmat_batch_trans(NULL, a);
+		struct fvector *det = fvec_alloc(count);
+		struct fmat_batch *inv = fmat_batch_inv(NULL, a, det);
+		struct fmat_batch *id = fmat_batch_mul(NULL, a, inv);
+
+		assert_non_null(sum);
+		assert_non_null(prod);
+		assert_non_null(trans);
+		assert_non_null(inv);
+
+		for (size_t k = 0; k < count; k++) {
+			fmat_batch_store(m, a, k);
+			fmat_batch_store(n, b, k);
+
+			fmat_add(expected, m, n);
+			assert_true(fmat_equal(fmat_batch_store(got, sum, k), expected));
+			fmat_mul(expected, m, n);
+			assert_true(fmat_equal(fmat_batch_store(got, prod, k), expected));
+			fmat_trans(expected, m);
+			assert_true(fmat_equal(fmat_batch_store(got, trans, k), expected));
+
+			struct fmat_lu *lu = fmat_lu_new(m);
+			const fval_t d = fmat_lu_det(lu);
+			fmat_lu_free(lu);
+			assert_float_equal(det->data[k], d, 1e-9 * fabs(d));
+
+			for (size_t r = 0; r < order; r++)
+				for (size_t c = 0; c < order; c++)
+					assert_float_equal(fmat_batch_get(id, k, r, c), r == c ? 1.0 : 0.0, 1e-12);
+		}
+
+		/* Determinants on their own match those of the inverse */
+		struct fvector *det_only = fmat_batch_det(NULL, a);
+		for (size_t k = 0; k < count; k++)
+			assert_float_equal(det_only->data[k], det->data[k], 0.0);
+
+		/* Operands may not be overwritten while they are read */
+		assert_null(fmat_batch_mul(a, a, b));
+		assert_null(fmat_batch_inv(a, a, NULL));
+
+		fmat_batch_free(a);
+		fmat_batch_free(b);
+		fmat_batch_free(sum);
+		fmat_batch_free(prod);
+		fmat_batch_free(trans);
+		fmat_batch_free(inv);
+		fmat_batch_free(id);
+		fvec_free(det);
+		fvec_free(det_only);
+		fmat_free(m);
+		fmat_free(n);
+		fmat_free(expected);
+		fmat_free(got);
+	}
+
+	/* Closed forms only exist up to order 4 */
+	struct fmat_batch *big = fmat_batch_alloc(4, 5, 5);
+	assert_null(fmat_batch_det(NULL, big));
+	fmat_batch_free(big);
+}
+
+/* A family for an order with no predefined type */
+FMAT_FIXED_DEFINE(5)
+
+void test_fmatrix_fixed(void **state)
+{
+	(void)state;
+
+	struct fmat4 a, b;
+
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			a.m[i][j] = (i == j ? 10.0 : 0.0) + (double)((i * 3 + j) % 5);
+			b.m[i][j] = (double)((i + 2 * j) % 3);
+		}
+	}
+
+	/* Every operation agrees with the general matrices */
+	FMATRIX(m, 4, 4);
+	FMATRIX(n, 4, 4);
+	FMATRIX(expected, 4, 4);
+	FMATRIX(got, 4, 4);
+
+	fmat4_store(m, a);
+	fmat4_store(n, b);
+
+	fmat_add(expected, m, n);
+	assert_true(fmat_equal(fmat4_store(got, fmat4_add(a, b)), expected));
+	fmat_mul(expected, m, n);
+	assert_true(fmat_equal(fmat4_store(got, fmat4_mul(a, b)), expected));
+	fmat_trans(expected, m);
+	assert_true(fmat_equal(fmat4_store(got, fmat4_trans(a)), expected));
+
+	struct fmat4 back;
+	assert_true(fmat4_load(&back, m));
+	assert_true(fmat4_equal(back, a));
+
+	/* Closed-form inverses multiply back to the identity */
+	struct fmat4 inv4;
+	assert_true(fmat4_inv(&inv4, a));
+	struct fmat4 id4 = fmat4_mul(a, inv4);
+
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
+			assert_float_equal(id4.m[i][j], i == j ? 1.0 : 0.0, 1e-12);
+
+	struct fmat_lu *lu = fmat_lu_new(m);
+	assert_float_equal(fmat4_det(a), fmat_lu_det(lu), 1e-9 * fabs(fmat_lu_det(lu)));
+	fmat_lu_free(lu);
+
+	struct fmat3 c = { { { 2, 1, 0 }, { 1, 3, 1 }, { 0, 1, 4 } } };
+	struct fmat3 inv3;
+	assert_float_equal(fmat3_det(c), 18.0, 1e-12);
+	assert_true(fmat3_inv(&inv3, c));
+	struct fmat3 id3 = fmat3_mul(c, inv3);
+
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			assert_float_equal(id3.m[i][j], i == j ? 1.0 : 0.0, 1e-12);
+
+	struct fmat2 d = { { { 2, 1 }, { 1, 1 } } };
+	struct fmat2 inv2;
+	assert_true(fmat2_inv(&inv2, d));
+	assert_true(fmat2_equal(fmat2_mul(d, inv2), fmat2_identity()));
+
+	/* A singular matrix has no inverse and leaves the destination alone */
+	struct fmat2 singular = { { { 1, 2 }, { 2, 4 } } };
+	assert_false(fmat2_inv(&inv2, singular));
+	assert_true(fmat2_equal(fmat2_mul(d, inv2), fmat2_identity()));
+
+	/* A generated order */
+	struct fmat5 e = fmat5_scale(fmat5_identity(), 2.0);
+	assert_true(fmat5_equal(fmat5_sub(fmat5_mul(e, e), e), e));
+
+	/* Its inverse pivots past the zero leading element */
+	struct fmat5 g, inv5;
+
+	for (int i = 0; i < 5; i++)
+		for (int j = 0; j < 5; j++)
+			g.m[i][j] = (i == j ? 6.0 : 0.0) + (double)((i * 2 + j * 3) % 7) - 3.0;
+	g.m[0][0] = 0.0;
+	assert_true(fmat5_inv(&inv5, g));
+	struct fmat5 id5 = fmat5_mul(g, inv5);
+
+	for (int i = 0; i < 5; i++)
+		for (int j = 0; j < 5; j++)
+			assert_float_equal(id5.m[i][j], i == j ? 1.0 : 0.0, 1e-12);
+
+	/* A zero column leaves no pivot for it */
+	for (int i = 0; i < 5; i++)
+		g.m[i][2] = 0.0;
+	assert_false(fmat5_inv(&e, g));
+	assert_true(fmat5_equal(e, fmat5_scale(fmat5_identity(), 2.0)));
+}
+
+void test_fmatrix_transposition(void **state)
+{
+	(void)state;
+
+	struct fmatrix *A = fmat_alloc(2, 3);
+	fmat_set(A, 0, 1, 1);
+	fmat_set(A, 1, 2, 1);
+
+	struct fmatrix *T = fmat_trans(NULL, A);
+
+	if (!jl_test_fmat(T, "[0. 0.; 1. 0.; 0. 1.]", 1e-12, 1e-12))
+		fail();
+
+	fmat_free(A);
+	fmat_free(T);
+}
+
+void test_fmatrix_tiled_transposition(void **state)
+{
+	(void)state;
+
+	struct fmatrix *A = fmat_alloc(70, 45);
+
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			fmat_set(A, r, c, (double)r + (double)c / 100.0);
+
+	struct fmatrix *T = fmat_trans(NULL, A);
+	assert_non_null(T);
+
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			assert_float_equal(T->data[c][r], A->data[r][c], 0.0);
+
+	struct fmatrix *S = fmat_alloc(45, 45);
+	for (size_t r = 0; r < S->rows; r++)
+		for (size_t c = 0; c < S->cols; c++)
+			fmat_set(S, r, c, T->data[r][c]);
+
+	/* In place, then back again */
+	assert_ptr_equal(fmat_trans(S, S), S);
+	for (size_t r = 0; r < S->rows; r++)
+		for (size_t c = 0; c < S->cols; c++)
+			assert_float_equal(S->data[r][c], A->data[r][c], 0.0);
+
+	fmat_free(A);
+	fmat_free(S);
+	fmat_free(T);
+}
+
+void test_fmatrix_transposed_multiplication(void **state)
+{
+	(void)state;
+
+	/* Large enough for the packed product */
+	struct fmatrix *A = fmat_alloc(90, 70);
+	struct fmatrix *B = fmat_alloc(80, 90);
+
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			fmat_set(A, r, c, (double)((r * 7 + c * 3) % 11) - 5.0);
+	for (size_t r = 0; r < B->rows; r++)
+		for (size_t c = 0; c < B->cols; c++)
+			fmat_set(B, r, c, (double)((r * 5 + c) % 13) - 6.0);
+
+	struct fmatrix At = fmat_trans_view(A);
+	struct fmatrix Bt = fmat_trans_view(B);
+	struct fmatrix *Am = fmat_trans(NULL, A);
+	struct fmatrix *Bm = fmat_trans(NULL, B);
+	struct fmatrix *expected = fmat_mul(NULL, Am, Bm);
+
+	/* A^T * B^T with either or both operands left as views */
+	struct fmatrix *C = fmat_mul(NULL, &At, &Bt);
+	assert_true(fmat_equal(C, expected));
+	assert_ptr_equal(fmat_mul(C, Am, &Bt), C);
+	assert_true(fmat_equal(C, expected));
+	assert_ptr_equal(fmat_mul(C, &At, Bm), C);
+	assert_true(fmat_equal(C, expected));
+
+	/* Into a transposed view of the destination: D = (A^T * B^T)^T */
+	struct fmatrix *D = fmat_alloc(80, 70);
+	struct fmatrix Dt = fmat_trans_view(D);
+	assert_ptr_equal(fmat_mul(&Dt, &At, &Bt), &Dt);
+	assert_true(fmat_equal(&Dt, expected));
+
+	/* Mixed orientations in add and sub */
+	struct fmatrix *S = fmat_add(NULL, &At, Am);
+	struct fmatrix *Z = fmat_sub(NULL, S, &At);
+	assert_true(fmat_equal(Z, Am));
+
+	fmat_free(A);
+	fmat_free(B);
+	fmat_free(Am);
+	fmat_free(Bm);
+	fmat_free(expected);
+	fmat_free(C);
+	fmat_free(D);
+	fmat_free(S);
+	fmat_free(Z);
+}
+
+void test_fmatrix_block_view(void **state)
+{
+	(void)state;
+
+	struct fmatrix *A = fmat_alloc(6, 6);
+	struct fmatrix *X = fmat_alloc(2, 2);
+
+	fmat_set(X, 0, 0, 4);
+	fmat_set(X, 0, 1, 7);
+	fmat_set(X, 1, 0, 2);
+	fmat_set(X, 1, 1, 6);
+
+	/* Invert the lower-right block of A in place from X */
+	struct fmatrix *D = fmat_block_view(A, 4, 4, 2, 2);
+	assert_ptr_equal(fmat_inv(D, X), D);
+	assert_float_equal(A->data[4][4], 0.6, 1e-12);
+	assert_float_equal(A->data[4][5], -0.7, 1e-12);
+	assert_float_equal(A->data[5][4], -0.2, 1e-12);
+	assert_float_equal(A->data[5][5], 0.4, 1e-12);
+
+	/* The upper-left block gets X times the inverse, which is the identity */
+	struct fmatrix *U = fmat_block_view(A, 0, 0, 2, 2);
+	assert_ptr_equal(fmat_mul(U, X, D), U);
+	assert_float_equal(A->data[0][0], 1.0, 1e-12);
+	assert_float_equal(A->data[0][1], 0.0, 1e-12);
+	assert_float_equal(A->data[1][1], 1.0, 1e-12);
+
+	/* Nothing outside the two blocks was written */
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			if ((r > 1 || c > 1) && (r < 4 || c < 4))
+				assert_float_equal(A->data[r][c], 0.0, 0.0);
+
+	/* Whole rows alias the parent's slab directly */
+	struct fmatrix *R = fmat_block_view(A, 4, 0, 2, 6);
+	assert_ptr_equal(R->buf, A->data[4]);
+	fmat_reset(R);
+	assert_float_equal(A->data[5][5], 0.0, 0.0);
+	assert_float_equal(A->data[0][0], 1.0, 1e-12);
+
+	fmat_free(R);
+	fmat_free(U);
+	fmat_free(D);
+	fmat_free(X);
+	fmat_free(A);
+}
+
+void test_fmatrix_inverse(void **state)
+{
+	(void)state;
+
+	struct fmatrix *A = fmat_alloc(3, 3);
+	fmat_set(A, 0, 0, 2);
+	fmat_set(A, 1, 0, 1);
+	fmat_set(A, 2, 0, 0);
+	fmat_set(A, 0, 1, -1);
+	fmat_set(A, 1, 1, 2);
+	fmat_set(A, 2, 1, -1);
+	fmat_set(A, 0, 2, 0);
+	fmat_set(A, 1, 2, -2);
+	fmat_set(A, 2, 2, 1);
+
+	struct fmatrix *T = fmat_inv(NULL, A);
+
+	if (!jl_test_fmat(T,
+			  "inv([2. -1. 0.;"
+			  "     1. 2. -2.;"
+			  "     0. -1. 1.])",
+			  1e-12,
+			  1e-12))
+		fail();
+
+	fmat_free(A);
+	fmat_free(T);
+}
+
+void test_fmatrix_lu_solve(void **state)
+{
+	(void)state;
+
+	struct fmatrix *A = fmat_alloc(3, 3);
+	fmat_set(A, 0, 0, 2);
+	fmat_set(A, 1, 0, 1);
+	fmat_set(A, 2, 0, 0);
+	fmat_set(A, 0, 1, -1);
+	fmat_set(A, 1, 1, 2);
+	fmat_set(A, 2, 1, -1);
+	fmat_set(A, 0, 2, 0);
+	fmat_set(A, 1, 2, -2);
+	fmat_set(A, 2, 2, 1);
+
+	struct fmat_lu *lu = fmat_lu_new(A);
+	assert_non_null(lu);
+
+	const fval_t b[3] = { 1.0, 2.0, 3.0 };
+	fval_t x[3];
+	assert_ptr_equal(fmat_lu_solve(x, lu, b), x);
+
+	for (size_t r = 0; r < 3; r++) {
+		fval_t sum = 0.0;
+
+		for (size_t c = 0; c < 3; c++)
+			sum += A->data[r][c] * x[c];
+
+		assert_float_equal(sum, b[r], 1e-12);
+	}
+
+	struct fmatrix *B = fmat_alloc(3, 2);
+	for (size_t r = 0; r < 3; r++) {
+		fmat_set(B, r, 0, b[r]);
+		fmat_set(B, r, 1, (double)r - 1.0);
+	}
+
+	struct fmatrix *X = fmat_lu_solve_many(NULL, lu, B);
+
+	if (!jl_test_fmat(X,
+			  "[2. -1. 0.;"
+			  " 1. 2. -2.;"
+			  " 0. -1. 1.] \\ [1. -1.; 2. 0.; 3. 1.]",
 			  1e-12,
 			  1e-12))
 		fail();
 
+	/* det = 2 * (2 - 2) + 1 * (1 - 0) */
+	assert_float_equal(fmat_lu_det(lu), 1.0, 1e-12);
+
+	fmat_lu_free(lu);
+	fmat_free(A);
+	fmat_free(B);
+	fmat_free(X);
+}
+
+void test_fmatrix_lu_row_order(void **state)
+{
+	(void)state;
+
+	/* Every column pivots on a different row */
+	struct fmatrix *A = fmat_alloc(4, 4);
+	for (size_t r = 0; r < 4; r++)
+		for (size_t c = 0; c < 4; c++)
+			fmat_set(A, r, c, (r + c) % 4 == 3 ? 8.0 : (double)(r + 1));
+
+	struct fmat_lu *lu = fmat_lu_new(A);
+	assert_non_null(lu);
+
+	/* Pivoting swaps row pointers, but the factors end up in slab order */
+	for (size_t r = 0; r < 4; r++)
+		assert_ptr_equal(lu->lu->data[r], lu->lu->buf + r * lu->lu->stride);
+
+	struct fmatrix *C = fmat_copy(NULL, lu->lu);
+	assert_true(fmat_equal(C, lu->lu));
+
+	fmat_lu_free(lu);
+	fmat_free(A);
+	fmat_free(C);
+}
+
+void test_fmatrix_workspace(void **state)
+{
+	(void)state;
+
+	struct fmat_workspace *ws = fmat_workspace_new(fmat_workspace_matrix_size(3, 5) + 100);
+	assert_non_null(ws);
+
+	const size_t mark = fmat_workspace_mark(ws);
+
+	struct fmatrix *M = fmat_workspace_matrix(ws, 3, 5);
+	assert_non_null(M);
+	assert_int_equal(M->rows, 3);
+	assert_int_equal(M->cols, 5);
+	assert_int_equal((uintptr_t)M->buf % FMATRIX_ALIGN, 0);
+	fmat_set(M, 2, 4, 1.5);
+	assert_float_equal(M->buf[2 * M->stride + 4], 1.5, 0.0);
+
+	/* Laid out exactly as fmat_alloc lays out a matrix of the same shape */
+	struct fmatrix *H = fmat_alloc(3, 5);
+	assert_int_equal(M->stride, H->stride);
+	assert_int_equal((unsigned char *)M->buf - (unsigned char *)M, (unsigned char *)H->buf - (unsigned char *)H);
+	fmat_free(H);
+
+	void *p = fmat_workspace_alloc(ws, 100);
+	assert_non_null(p);
+	assert_int_equal((uintptr_t)p % FMATRIX_ALIGN, 0);
+
+	/* Exhausted until released */
+	assert_null(fmat_workspace_alloc(ws, 1));
+	fmat_workspace_release(ws, mark);
+	assert_int_equal(fmat_workspace_mark(ws), mark);
+	assert_non_null(fmat_workspace_alloc(ws, 1));
+
+	fmat_workspace_free(ws);
+}
+
+void test_fmatrix_workspace_inverse(void **state)
+{
+	(void)state;
+
+	const size_t n = 100;
+	struct fmatrix *A = fmat_alloc(n, n);
+
+	for (size_t r = 0; r < n; r++)
+		for (size_t c = 0; c < n; c++)
+			fmat_set(A, r, c, (double)((r * 5 + c * 3) % 11) - 5.0 + (r == c ? 30.0 : 0.0));
+
+	struct fmat_workspace *ws = fmat_workspace_new(fmat_lu_workspace_size(n));
+	struct fmatrix *expected = fmat_inv(NULL, A);
+	struct fmatrix *T = fmat_alloc(n, n);
+
+	/* The workspace is handed back after every call, so it can be reused */
+	for (int i = 0; i < 3; i++) {
+		assert_ptr_equal(fmat_inv_ws(T, A, ws), T);
+		assert_int_equal(fmat_workspace_mark(ws), 0);
+		assert_true(fmat_equal(T, expected));
+	}
+
+	/* A workspace that is too small fails without touching dest */
+	struct fmat_workspace *small = fmat_workspace_new(fmat_lu_workspace_size(n) / 2);
+	assert_null(fmat_inv_ws(T, A, small));
+	assert_true(fmat_equal(T, expected));
+
+	fmat_workspace_free(ws);
+	fmat_workspace_free(small);
 	fmat_free(A);
 	fmat_free(T);
+	fmat_free(expected);
+}
+
+void test_fmatrix_blocked_inverse(void **state)
+{
+	(void)state;
+
+	/* Large enough for several factorization panels */
+	const size_t n = 150;
+	struct fmatrix *A = fmat_alloc(n, n);
+
+	for (size_t r = 0; r < n; r++)
+		for (size_t c = 0; c < n; c++)
+			fmat_set(A, r, c, (double)((r * 7 + c * 13) % 23) - 11.0 + (r == c ? 40.0 : 0.0));
+
+	struct fmatrix *T = fmat_inv(NULL, A);
+	assert_non_null(T);
+
+	struct fmatrix *P = fmat_mul(NULL, A, T);
+
+	for (size_t r = 0; r < n; r++)
+		for (size_t c = 0; c < n; c++)
+			assert_float_equal(P->data[r][c], r == c ? 1.0 : 0.0, 1e-10);
+
+	fmat_free(A);
+	fmat_free(T);
+	fmat_free(P);
+}
+
+void test_fmatrix_lu_singular(void **state)
+{
+	(void)state;
+
+	struct fmatrix *A = fmat_alloc(3, 3);
+	for (size_t r = 0; r < 3; r++)
+		for (size_t c = 0; c < 3; c++)
+			fmat_set(A, r, c, (double)(r + c));
+
+	struct fmat_lu *lu = fmat_lu_new(A);
+	assert_non_null(lu);
+	assert_true(lu->singular);
+	assert_float_equal(fmat_lu_det(lu), 0.0, 0.0);
+	assert_null(fmat_lu_inv(NULL, lu));
+	assert_null(fmat_inv(NULL, A));
+
+	fmat_lu_free(lu);
+	fmat_free(A);
+}
+
+/*
+ * GF(2) matrix tests
+ */
+
+void test_gf2matrix_set_row(void **state)
+{
+	(void)state;
+
+	struct gf2matrix *A = gf2mat_alloc(2, 4);
+	gf2mat_set_row(A, 0, 0b1010);
+	gf2mat_set_row(A, 1, 0b0111);
+
+	struct matrix *M = gf2mat_to_mat(NULL, A);
+
+	if (!jl_test_mat(M, "[1 0 1 0; 0 1 1 1]"))
+		fail();
+
+	gf2mat_free(A);
+	mat_free(M);
+}
+
+void test_gf2matrix_addition(void **state)
+{
+	(void)state;
+
+	struct matrix *A = mat_set_string("[1 1 0; 0 1 1]");
+	struct matrix *B = mat_set_string("[1 0 1; 1 1 0]");
+
+	struct gf2matrix *GA = gf2mat_from_mat(NULL, A);
+	struct gf2matrix *GB = gf2mat_from_mat(NULL, B);
+	struct gf2matrix *GC = gf2mat_add(NULL, GA, GB);
+	struct matrix *C = gf2mat_to_mat(NULL, GC);
+
+	if (!jl_test_mat(C, "mod.([1 1 0; 0 1 1] + [1 0 1; 1 1 0], 2)"))
+		fail();
+
+	mat_free(A);
+	mat_free(B);
+	mat_free(C);
+	gf2mat_free(GA);
+	gf2mat_free(GB);
+	gf2mat_free(GC);
+}
+
+void test_gf2matrix_multiplication(void **state)
+{
+	(void)state;
+
+	struct matrix *A = mat_set_string("[1 1 0 1; 0 1 1 0; 1 0 1 1]");
+	struct matrix *B = mat_set_string("[1 0 1; 1 1 0; 0 1 1; 1 1 1]");
+
+	struct gf2matrix *GA = gf2mat_from_mat(NULL, A);
+	struct gf2matrix *GB = gf2mat_from_mat(NULL, B);
+	struct gf2matrix *GC = gf2mat_mul(NULL, GA, GB);
+	struct matrix *C = gf2mat_to_mat(NULL, GC);
+
+	if (!jl_test_mat(C, "mod.([1 1 0 1; 0 1 1 0; 1 0 1 1] * [1 0 1; 1 1 0; 0 1 1; 1 1 1], 2)"))
+		fail();
+
+	mat_free(A);
+	mat_free(B);
+	mat_free(C);
+	gf2mat_free(GA);
+	gf2mat_free(GB);
+	gf2mat_free(GC);
+}
+
+void test_gf2matrix_large_multiplication(void **state)
+{
+	(void)state;
+
+	/* Spans several words and lookup tables per row */
+	struct gf2matrix *A = gf2mat_alloc(70, 150);
+	struct gf2matrix *B = gf2mat_alloc(150, 130);
+
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			gf2mat_set(A, r, c, (r * 7 + c * 3) % 5 < 2);
+
+	for (size_t r = 0; r < B->rows; r++)
+		for (size_t c = 0; c < B->cols; c++)
+			gf2mat_set(B, r, c, (r + c * 11) % 3 == 0);
+
+	struct gf2matrix *C = gf2mat_mul(NULL, A, B);
+	assert_non_null(C);
+
+	for (size_t i = 0; i < C->rows; i++) {
+		for (size_t j = 0; j < C->cols; j++) {
+			bool sum = false;
+
+			for (size_t k = 0; k < A->cols; k++)
+				sum ^= gf2mat_get(A, i, k) && gf2mat_get(B, k, j);
+
+			assert_int_equal(gf2mat_get(C, i, j), sum);
+		}
+	}
+
+	gf2mat_free(A);
+	gf2mat_free(B);
+	gf2mat_free(C);
+}
+
+void test_gf2matrix_transposition(void **state)
+{
+	(void)state;
+
+	struct gf2matrix *A = gf2mat_alloc(100, 70);
+
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			gf2mat_set(A, r, c, (r * 5 + c) % 7 == 0);
+
+	struct gf2matrix *T = gf2mat_trans(NULL, A);
+	assert_non_null(T);
+
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			assert_int_equal(gf2mat_get(T, c, r), gf2mat_get(A, r, c));
+
+	struct gf2matrix *TT = gf2mat_trans(NULL, T);
+	assert_true(gf2mat_equal(A, TT));
+
+	gf2mat_free(A);
+	gf2mat_free(T);
+	gf2mat_free(TT);
+}
+
+void test_gf2matrix_views(void **state)
+{
+	(void)state;
+
+	/* Non-square, so a view indexed as its storage leaves the row table */
+	struct matrix *A = mat_alloc(3, 70);
+
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			mat_set(A, r, c, (val_t)(r * 5 + c));
+
+	struct matrix T = mat_trans_view(A);
+	struct gf2matrix *G = gf2mat_from_mat(NULL, &T);
+	assert_non_null(G);
+	assert_int_equal(G->rows, 70);
+	assert_int_equal(G->cols, 3);
+
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = 0; c < A->cols; c++)
+			assert_int_equal(gf2mat_get(G, c, r), (r * 5 + c) & 0x1);
+
+	/* Back into a transposed view of a zeroed matrix of the original shape */
+	struct matrix *B = mat_alloc(3, 70);
+	struct matrix BT = mat_trans_view(B);
+	assert_non_null(gf2mat_to_mat(&BT, G));
+
+	for (size_t r = 0; r < B->rows; r++)
+		for (size_t c = 0; c < B->cols; c++)
+			assert_int_equal(B->data[r][c], (r * 5 + c) & 0x1);
+
+	mat_free(A);
+	mat_free(B);
+	gf2mat_free(G);
+}
+
+void test_gf2matrix_rank(void **state)
+{
+	(void)state;
+
+	struct gf2matrix *A = gf2mat_alloc(4, 4);
+	gf2mat_set_row(A, 0, 0b1100);
+	gf2mat_set_row(A, 1, 0b0110);
+	gf2mat_set_row(A, 2, 0b1010);
+	gf2mat_set_row(A, 3, 0b0001);
+
+	/* Row 2 is the sum of rows 0 and 1 */
+	assert_int_equal(gf2mat_rank(A), 3);
+
+	gf2mat_free(A);
+}
+
+void test_gf2matrix_inverse(void **state)
+{
+	(void)state;
+
+	/* Upper unitriangular, so invertible for any pattern above the diagonal */
+	struct gf2matrix *A = gf2mat_alloc(100, 100);
+
+	for (size_t r = 0; r < A->rows; r++)
+		for (size_t c = r; c < A->cols; c++)
+			gf2mat_set(A, r, c, r == c || (r * 3 + c) % 4 == 0);
+
+	/* Mix the rows so the elimination has to pivot */
+	struct gf2matrix *P = gf2mat_alloc(100, 100);
+	for (size_t r = 0; r < P->rows; r++)
+		gf2mat_set(P, r, (r * 37) % 100, true);
+
+	struct gf2matrix *B = gf2mat_mul(NULL, P, A);
+	struct gf2matrix *Binv = gf2mat_inv(NULL, B);
+	assert_non_null(Binv);
+
+	struct gf2matrix *I = gf2mat_identity_new(100);
+	struct gf2matrix *C = gf2mat_mul(NULL, B, Binv);
+	assert_true(gf2mat_equal(C, I));
+
+	gf2mat_free(A);
+	gf2mat_free(P);
+	gf2mat_free(B);
+	gf2mat_free(Binv);
+	gf2mat_free(I);
+	gf2mat_free(C);
+}
+
+void test_gf2matrix_nullspace(void **state)
+{
+	(void)state;
+
+	struct gf2matrix *A = gf2mat_alloc(3, 5);
+	gf2mat_set_row(A, 0, 0b11000);
+	gf2mat_set_row(A, 1, 0b01100);
+	gf2mat_set_row(A, 2, 0b10100);
+
+	struct gf2matrix *N = NULL;
+	assert_int_equal(gf2mat_nullspace(&N, A), 3);
+	assert_non_null(N);
+	assert_int_equal(N->rows, 5);
+	assert_int_equal(N->cols, 3);
+
+	/* The basis vectors are independent and annihilated by A */
+	assert_int_equal(gf2mat_rank(N), 3);
+
+	struct gf2matrix *Z = gf2mat_mul(NULL, A, N);
+	struct gf2matrix *zero = gf2mat_alloc(3, 3);
+	assert_true(gf2mat_equal(Z, zero));
+
+	gf2mat_free(A);
+	gf2mat_free(N);
+	gf2mat_free(Z);
+	gf2mat_free(zero);
+}
+
+void test_gf2matrix_solve(void **state)
+{
+	(void)state;
+
+	struct gf2matrix *A = gf2mat_alloc(3, 4);
+	gf2mat_set_row(A, 0, 0b1101);
+	gf2mat_set_row(A, 1, 0b0111);
+	gf2mat_set_row(A, 2, 0b1010);
+
+	struct gf2matrix *B = gf2mat_alloc(3, 1);
+	gf2mat_set_row(B, 0, 0b1);
+	gf2mat_set_row(B, 1, 0b0);
+	gf2mat_set_row(B, 2, 0b1);
+
+	struct gf2matrix *X = gf2mat_solve(NULL, A, B);
+	assert_non_null(X);
+
+	struct gf2matrix *AX = gf2mat_mul(NULL, A, X);
+	assert_true(gf2mat_equal(AX, B));
+
+	/* Rows 0 and 1 sum to row 2, so b must satisfy the same relation */
+	gf2mat_set_row(B, 2, 0b0);
+	assert_null(gf2mat_solve(NULL, A, B));
+
+	gf2mat_free(A);
+	gf2mat_free(B);
+	gf2mat_free(X);
+	gf2mat_free(AX);
 }
@@ -5,12 +5,30 @@
 #include <julia.h>
 
 #include <cmocka.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
 
+#include "../allocator.h"
+#include "../fexpr.h"
+#include "../fkernels.h"
 #include "../fmatrix.h"
+#include "../fmatrix_batch.h"
+#include "../fmatrix_chain.h"
+#include "../fmatrix_fixed.h"
+#include "../fmatrix_lu.h"
+#include "../fmatrix_tiled.h"
+#include "../fmatrix_workspace.h"
 #include "../format.h"
+#include "../fvector.h"
+#include "../gf2matrix.h"
+#include "../matfile.h"
 #include "../matrix.h"
+#include "../threadpool.h"
 
 #define TEST(...)                                                                 \
 	do {                                                                      \
@@ -26,17 +44,24 @@ int jl_test_fmat(const struct fmatrix *m, const char *julia_expr, double rtol, d
 /* CMocka tests */
 
 void test_matrix_stack_creation(void **state);
+void test_matrix_stack_spill(void **state);
+void test_matrix_stack_views(void **state);
 void test_matrix_heap_creation(void **state);
 void test_matrix_heap_multiplication(void **state);
 
 void test_matrix_alloc_valid(void **state);
 void test_matrix_alloc_invalid_dims(void **state);
+void test_matrix_alloc_contiguous(void **state);
+void test_matrix_arena_allocator(void **state);
 
 void test_matrix_set_identity(void **state);
 void test_matrix_identity_new(void **state);
 void test_matrix_set_and_reset(void **state);
 void test_matrix_set_row_gf2(void **state);
 void test_matrix_set_string(void **state);
+void test_matrix_set_stringn(void **state);
+void test_matrix_read(void **state);
+void test_matrix_save_map(void **state);
 
 void test_matrix_shift_east(void **state);
 void test_matrix_shift_west(void **state);
@@ -50,7 +75,11 @@ void test_matrix_addition(void **state);
 void test_matrix_subtraction(void **state);
 void test_matrix_multiplication(void **state);
 
+void test_matrix_gemm(void **state);
 void test_matrix_transposition(void **state);
+void test_matrix_transposition_in_place(void **state);
+void test_matrix_transpose_view(void **state);
+void test_matrix_block_view(void **state);
 
 void test_fmatrix_stack_creation(void **state);
 void test_fmatrix_heap_creation(void **state);
@@ -58,12 +87,19 @@ void test_fmatrix_heap_multiplication(void **state);
 
 void test_fmatrix_alloc_valid(void **state);
 void test_fmatrix_alloc_invalid_dims(void **state);
+void test_fmatrix_alloc_contiguous(void **state);
+void test_fmatrix_pool_allocator(void **state);
 
 void test_fmatrix_set_identity(void **state);
 void test_fmatrix_identity_new(void **state);
 void test_fmatrix_set_and_reset(void **state);
 void test_fmatrix_set_row_gf2(void **state);
 void test_fmatrix_set_string(void **state);
+void test_fmatrix_set_stringn(void **state);
+void test_fmatrix_read(void **state);
+void test_fmatrix_save_map(void **state);
+void test_fmatrix_tiled(void **state);
+void test_fmatrix_tiled_lu(void **state);
 
 void test_fmatrix_shift_east(void **state);
 void test_fmatrix_shift_west(void **state);
@@ -76,8 +112,38 @@ void test_fmatrix_duplication(void **state);
 void test_fmatrix_addition(void **state);
 void test_fmatrix_subtraction(void **state);
 void test_fmatrix_multiplication(void **state);
-
+void test_fmatrix_blocked_multiplication(void **state);
+void test_fmatrix_threaded_multiplication(void **state);
+
+void test_fmatrix_kernels(void **state);
+void test_fmatrix_gemm_accumulate(void **state);
+void test_fmatrix_expression(void **state);
+void test_fmatrix_chain_multiplication(void **state);
+void test_fmatrix_gemv(void **state);
+void test_fmatrix_gemv_batch(void **state);
+void test_fmatrix_batch(void **state);
+void test_fmatrix_fixed(void **state);
 void test_fmatrix_transposition(void **state);
+void test_fmatrix_tiled_transposition(void **state);
+void test_fmatrix_transposed_multiplication(void **state);
+void test_fmatrix_block_view(void **state);
 void test_fmatrix_inverse(void **state);
+void test_fmatrix_lu_solve(void **state);
+void test_fmatrix_lu_singular(void **state);
+void test_fmatrix_lu_row_order(void **state);
+void test_fmatrix_blocked_inverse(void **state);
+void test_fmatrix_workspace(void **state);
+void test_fmatrix_workspace_inverse(void **state);
+
+void test_gf2matrix_set_row(void **state);
+void test_gf2matrix_addition(void **state);
+void test_gf2matrix_multiplication(void **state);
+void test_gf2matrix_large_multiplication(void **state);
+void test_gf2matrix_transposition(void **state);
+void test_gf2matrix_views(void **state);
+void test_gf2matrix_rank(void **state);
+void test_gf2matrix_inverse(void **state);
+void test_gf2matrix_nullspace(void **state);
+void test_gf2matrix_solve(void **state);
 
 #endif /* end of include guard TESTS_H */
@@ -0,0 +1,246 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "threadpool.h"
+
+static struct {
+	pthread_mutex_t lock;
+	/* Signalled when a new job is posted or the pool is stopping */
+	pthread_cond_t wake;
+	/* Signalled when the last task finishes or the last worker goes idle */
+	pthread_cond_t done;
+
+	pthread_t *workers;
+	size_t nworkers;
+	/* Requested size, 0 until resolved from the environment */
+	size_t nthreads;
+	bool started;
+	bool stop;
+	/* Set while a job owns the pool */
+	bool busy;
+
+	/* Bumped for every posted job */
+	unsigned long generation;
+	/* Generation the current workers were spawned at */
+	unsigned long spawn_generation;
+	/* Workers currently inside a job */
+	size_t active;
+
+	void (*fn)(void *arg, size_t task);
+	void *arg;
+	size_t ntasks;
+	atomic_size_t next;
+	atomic_size_t finished;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wake = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+};
+
+/* Set on pool workers and on a caller while it runs its share of a job */
+static _Thread_local bool in_pool;
+
+static size_t threadpool_default_threads(void)
+{
+	const char *env = getenv("MATRIX_NUM_THREADS");
+
+	if (env) {
+		char *end;
+		unsigned long n = strtoul(env, &end, 10);
+
+		if (end != env && !*end && n > 0)
+			return n;
+
+		fprintf(stderr, "%s: ignoring invalid MATRIX_NUM_THREADS '%s'\n", __func__, env);
+	}
+
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return ncpus > 0 ? (size_t)ncpus : 1;
+}
+
+/* Claim and run tasks of the current job until none are left */
+static void threadpool_work(void)
+{
+	size_t task;
+
+	while ((task = atomic_fetch_add(&pool.next, 1)) < pool.ntasks) {
+		pool.fn(pool.arg, task);
+
+		if (atomic_fetch_add(&pool.finished, 1) + 1 == pool.ntasks) {
+			pthread_mutex_lock(&pool.lock);
+			pthread_cond_broadcast(&pool.done);
+			pthread_mutex_unlock(&pool.lock);
+		}
+	}
+}
+
+static void *threadpool_worker(void *unused)
+{
+	(void)unused;
+
+	in_pool = true;
+
+	pthread_mutex_lock(&pool.lock);
+
+	unsigned long seen = pool.spawn_generation;
+
+	for (;;) {
+		while (!pool.stop && pool.generation == seen)
+			pthread_cond_wait(&pool.wake, &pool.lock);
+
+		if (pool.stop)
+			break;
+
+		seen = pool.generation;
+		pool.active++;
+		pthread_mutex_unlock(&pool.lock);
+
+		threadpool_work();
+
+		pthread_mutex_lock(&pool.lock);
+		if (--pool.active == 0)
+			pthread_cond_broadcast(&pool.done);
+	}
+
+	pthread_mutex_unlock(&pool.lock);
+
+	return NULL;
+}
+
+/* Spawn the workers, called with the lock held */
+static void threadpool_start(void)
+{
+	static bool registered;
+	const size_t nworkers = pool.nthreads - 1;
+
+	if (!registered) {
+		atexit(threadpool_shutdown);
+		registered = true;
+	}
+
+	pool.started = true;
+	pool.nworkers = 0;
+	pool.spawn_generation = pool.generation;
+
+	pool.workers = malloc(nworkers * sizeof(pthread_t));
+	if (!pool.workers) {
+		perror(__func__);
+		return;
+	}
+
+	/* Run with however many workers could be created */
+	for (size_t i = 0; i < nworkers; i++) {
+		errno = pthread_create(&pool.workers[i], NULL, threadpool_worker, NULL);
+		if (errno) {
+			perror(__func__);
+			break;
+		}
+		pool.nworkers++;
+	}
+}
+
+void threadpool_shutdown(void)
+{
+	pthread_mutex_lock(&pool.lock);
+
+	if (!pool.started) {
+		pthread_mutex_unlock(&pool.lock);
+		return;
+	}
+
+	pool.stop = true;
+	pthread_cond_broadcast(&pool.wake);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (size_t i = 0; i < pool.nworkers; i++)
+		pthread_join(pool.workers[i], NULL);
+
+	pthread_mutex_lock(&pool.lock);
+	free(pool.workers);
+	pool.workers = NULL;
+	pool.nworkers = 0;
+	pool.started = false;
+	pool.stop = false;
+	pthread_mutex_unlock(&pool.lock);
+}
+
+void threadpool_set_threads(size_t nthreads)
+{
+	threadpool_shutdown();
+
+	pthread_mutex_lock(&pool.lock);
+	pool.nthreads = nthreads ? nthreads : threadpool_default_threads();
+	pthread_mutex_unlock(&pool.lock);
+}
+
+size_t threadpool_get_threads(void)
+{
+	pthread_mutex_lock(&pool.lock);
+
+	if (!pool.nthreads)
+		pool.nthreads = threadpool_default_threads();
+
+	size_t nthreads = pool.nthreads;
+
+	pthread_mutex_unlock(&pool.lock);
+
+	return nthreads;
+}
+
+void threadpool_run(size_t ntasks, void (*fn)(void *arg, size_t task), void *arg)
+{
+	if (ntasks < 2 || in_pool || threadpool_get_threads() < 2)
+		goto serial;
+
+	pthread_mutex_lock(&pool.lock);
+
+	if (pool.busy) {
+		pthread_mutex_unlock(&pool.lock);
+		goto serial;
+	}
+
+	if (!pool.started)
+		threadpool_start();
+
+	if (!pool.nworkers) {
+		pthread_mutex_unlock(&pool.lock);
+		goto serial;
+	}
+
+	pool.busy = true;
+
+	/* Stragglers from the previous job must not see the fields change under them */
+	while (pool.active)
+		pthread_cond_wait(&pool.done, &pool.lock);
+
+	pool.fn = fn;
+	pool.arg = arg;
+	pool.ntasks = ntasks;
+	atomic_store(&pool.next, 0);
+	atomic_store(&pool.finished, 0);
+	pool.generation++;
+	pthread_cond_broadcast(&pool.wake);
+	pthread_mutex_unlock(&pool.lock);
+
+	in_pool = true;
+	threadpool_work();
+	in_pool = false;
+
+	pthread_mutex_lock(&pool.lock);
+	while (atomic_load(&pool.finished) < ntasks)
+		pthread_cond_wait(&pool.done, &pool.lock);
+	pool.busy = false;
+	pthread_mutex_unlock(&pool.lock);
+
+	return;
+
+serial:
+	for (size_t task = 0; task < ntasks; task++)
+		fn(arg, task);
+}
@@ -0,0 +1,28 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stddef.h>
+
+/*
+ * Library-owned worker pool used by the multiplication routines. The pool is
+ * created on first use and reused by every later call. Its size defaults to
+ * the MATRIX_NUM_THREADS environment variable, or the number of online CPUs.
+ */
+
+/* Set the number of threads used by the matrix routines, 0 restores the default */
+void threadpool_set_threads(size_t nthreads);
+/* Get the number of threads used by the matrix routines */
+size_t threadpool_get_threads(void);
+
+/*
+ * Run fn(arg, task) for every task in [0, ntasks) across the pool and return
+ * once all of them have finished. The calling thread takes part in the work.
+ * Calls from inside a task, or while another thread is using the pool, run
+ * the tasks serially on the calling thread.
+ */
+void threadpool_run(size_t ntasks, void (*fn)(void *arg, size_t task), void *arg);
+
+/* Stop and join the worker threads; the pool is recreated on next use */
+void threadpool_shutdown(void);
+
+#endif /* THREADPOOL_H */